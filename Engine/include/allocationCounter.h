@@ -0,0 +1,15 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+//Counter of the heap allocations made by every thread, to check that the hot loops of the engine don't allocate.
+//Counting replaces the global operator new and delete of the program, so it's compiled only when
+//FIREFLY_ALLOCATION_COUNTER is defined (cmake option FIREFLY_ALLOCATION_COUNTER); otherwise the counters stay 0
+class AllocationCounter {
+public:
+	static bool IsEnabled();
+	static uint64_t GetThreadAllocations();
+};
+
+#endif
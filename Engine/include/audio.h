@@ -94,7 +94,7 @@ public:
     AudioEngine(const AudioEngine&) = delete;
     AudioEngine& operator=(const AudioEngine&) = delete;
 
-	void Init(AudioOptions& options);
+	void Init(AudioOptions& options, bool headless = false);
 	unsigned long GetTaskQueueLen();
 
 	void PollRequests();
@@ -164,6 +164,7 @@ private:
 	std::map <EntityName, Mix_Music*> _musicTracks;
 	
 	bool _mute;
+	bool _headless;		//null backend: no audio device, the requests are dropped
 	bool _playSoundtrack;
 	bool _playRandomMusic;
 
@@ -47,6 +47,7 @@ private:
 	std::atomic <int> _channel = -1;	//channel where the track is being played or was played
 	std::atomic <AudioStatus> _status;	//track status
 	double _updateTimer, _playTimer;
+	bool _audible;		//the source was near the camera at the last update
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "physics_structs.h"
+
+class Rigidbody;
+
+//Sweep and prune broadphase. The min and max of the bounding box of every body are kept sorted along x and y,
+//the lists are sorted again every frame with an insertion sort that starts from the order of the previous frame:
+//the bodies move a little between two frames, so only a few endpoints move and the sort is close to linear.
+//Two boxes start or stop overlapping only when an endpoint of one passes an endpoint of the other, so the set of
+//overlapping pairs is kept by the swaps of the sort instead of being searched again: a min passing a max adds the pair
+//if the boxes overlap, a max passing a min removes it.
+//Pairs of two static bodies are never reported. Many new bodies at once (e.g. a scene load) or a body that changes
+//between static and non static rebuild the lists with a full sort and a sweep.
+//Not thread safe: Update() and the body changes run on one thread, the pairs can be read by many threads after Update()
+class SweepAndPrune {
+	struct Proxy {
+		Rigidbody* body;		//nullptr for a free proxy
+		AABB box;
+		bool isStatic;
+		int activeIndex;		//position in the active list of the sweep of a rebuild
+	};
+
+	struct Endpoint {
+		double value;
+		uint32_t data;		//proxy id << 1 | 1 for a max
+	};
+public:
+	SweepAndPrune();
+
+	void AddBody(Rigidbody* body);
+	void RemoveBody(Rigidbody* body);
+	void Invalidate();
+	void Update();
+
+	const std::vector <BroadphasePair>& GetPairs();
+	const std::vector <BroadphasePair>& GetAddedPairs();
+	const std::vector <BroadphasePair>& GetRemovedPairs();
+	int GetProxyCount();
+
+private:
+	void purgeRemoved();
+	void insertPending();
+	void sortAxis(int axis);
+	void rebuild();
+	BroadphasePair orientedPair(uint32_t a, uint32_t b);
+	void addPair(uint32_t a, uint32_t b);
+	void removePair(uint32_t a, uint32_t b);
+	bool canCollide(uint32_t a, uint32_t b);
+
+	static uint64_t pairKey(uint32_t a, uint32_t b) {
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+	static double endpointValue(const AABB& box, int axis, bool max) {
+		if (axis == 0) {
+			return max ? box.max.x : box.min.x;
+		}
+		return max ? box.max.y : box.min.y;
+	}
+	//order of the endpoints: by value, a min before a max with the same value so touching boxes overlap
+	static bool endpointLess(const Endpoint& a, const Endpoint& b) {
+		return a.value < b.value || (a.value == b.value && (a.data & 1) < (b.data & 1));
+	}
+
+	std::vector <Proxy> _proxies;
+	std::vector <uint32_t> _freeProxies;
+	std::unordered_map <Rigidbody*, uint32_t> _proxyOf;
+	std::vector <uint32_t> _pendingProxies;		//added since the last update
+	std::vector <uint32_t> _removedProxies;		//removed since the last update, not reused yet
+	std::vector <Endpoint> _endpoints[2];		//sorted along x and y
+
+	std::vector <BroadphasePair> _pairs;
+	std::vector <uint64_t> _pairKeys;		//key of every pair of _pairs
+	std::unordered_map <uint64_t, int> _pairIndex;		//position in _pairs
+	std::vector <BroadphasePair> _addedPairs;
+	std::vector <BroadphasePair> _removedPairs;
+	bool _rebuild;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include "structures.h"
+#include "physics_structs.h"
+
+class Rigidbody;
+
+//Sequential impulse solver of the contacts of a physics frame.
+//The velocities of the bodies (with the forces of the frame applied) are copied in a packed array, every contact
+//is solved many times in a row (iterations) with an impulse along the normal that stops the bodies from approaching,
+//clamped so the accumulated impulse only pushes, and a friction impulse clamped by the normal one. Then the velocities are copied back.
+//Two contacts that share a body can't be solved at the same time, so the contacts are coloured: the contacts of a colour
+//have no body in common (static bodies excluded, they are never written) and are solved in parallel, the colours one after the other.
+//The contacts that don't find a colour are solved by a single thread after the others.
+//All the iterations are a single parallel loop: the blocks of a colour wait for the colours before them, no loop is started per colour.
+//The colours are given in the order of the contacts, so the result doesn't depend on the threads
+class ContactSolver {
+	//velocities of an awake body in the solver. Angular velocity in radians
+	struct SolverBody {
+		vector2 v;
+		double w;
+		double invMass;
+		double invI;
+		vector2 correction;		//position correction of the contacts
+	};
+
+	struct SolverContact {
+		int a, b;		//solver bodies, -1 for a body that is not moved (static)
+		int contact;		//index in the contacts of the frame
+		vector2 normal;		//from b to a
+		vector2 ra, rb;		//contact point relative to the centers
+		double normalMass;
+		double tangentMass;
+		double friction;
+		double bias;		//separating velocity of the restitution
+		double normalImpulse;		//accumulated over the iterations
+		double tangentImpulse;
+	};
+
+	struct SolverBlock {
+		int start, end;		//contacts
+	};
+public:
+	ContactSolver();
+
+	void SetIterations(int iterations);
+	int GetIterations();
+	int GetColorCount();
+
+	void Solve(std::vector <CollisionStruct>& contacts, const std::vector <Rigidbody*>& bodies, double timeElapsed);
+
+private:
+	void loadBodies(const std::vector <Rigidbody*>& bodies, double timeElapsed);
+	int solverBody(Rigidbody* body, const std::vector <Rigidbody*>& bodies);
+	void prepareContacts(const std::vector <CollisionStruct>& contacts, const std::vector <Rigidbody*>& bodies);
+	void addCorrection(SolverBody& body, vector2 correction);
+	void colorContacts();
+	void buildBlocks();
+	static void solveRoutine(int start_index, int end_index, void* args);
+	void solveBlocks();
+	void solveContact(SolverContact& c);
+	void storeBodies(const std::vector <Rigidbody*>& bodies);
+
+	static const int MAX_COLORS = 24;		//the last one is for the contacts left without colour
+	static const int GRAIN = 64;		//contacts of a block of a parallel loop
+
+	std::vector <SolverBody> _bodies;
+	std::vector <SolverContact> _unsorted;
+	std::vector <SolverContact> _contacts;		//sorted by colour
+	std::vector <int> _color;		//colour of every contact of _unsorted
+	std::vector <uint32_t> _bodyColors;		//colours used by the contacts of every body
+	int _colorStart[MAX_COLORS + 1];		//first contact of every colour, plus the end
+	int _colorCount;
+	std::vector <SolverBlock> _blocks;		//blocks of an iteration, colour after colour
+	std::vector <int> _phaseStart;		//first block of every non empty colour, plus the end
+	int _widestColor;		//blocks of the biggest colour: the threads that can work at the same time
+	std::atomic <int> _nextBlock;		//next block of the solve to take
+	std::atomic <int> _doneBlocks;
+	int _iterations;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef DYNAMIC_TREE_H
+#define DYNAMIC_TREE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "structures.h"
+
+class Rigidbody;
+
+//Dynamic bounding volume hierarchy of the rigidbodies, used by the scene queries of the physics engine.
+//Every leaf keeps a box a little bigger than the body (margin), so a body that moves a little doesn't change the tree:
+//a leaf is moved only when the body leaves its box. New leaves go down the branch that grows the least (perimeter cost),
+//and the tree is kept balanced with rotations, so the queries visit O(log n) nodes.
+//The tree is changed by a single thread; Query() and RayCast() only read it and can run on many threads at the same time,
+//as long as nobody changes the tree
+class DynamicTree {
+	struct TreeNode {
+		AABB box;
+		Rigidbody* body;		//nullptr for the inner nodes
+		int parent;		//next free node for the free nodes
+		int child1;
+		int child2;
+		int height;		//0 for a leaf, -1 for a free node
+	};
+
+	//stack of the nodes to visit. Lives on the stack of the calling thread unless the tree is very deep
+	class NodeStack {
+	public:
+		NodeStack() : _count(0) {}
+		void push(int node) {
+			if (_count < FIXED_SIZE) {
+				_fixed[_count] = node;
+			}
+			else {
+				_more.push_back(node);
+			}
+			_count++;
+		}
+		int pop() {
+			_count--;
+			if (_count < FIXED_SIZE) {
+				return _fixed[_count];
+			}
+			int node = _more.back();
+			_more.pop_back();
+			return node;
+		}
+		bool empty() {
+			return _count == 0;
+		}
+	private:
+		static const int FIXED_SIZE = 128;
+		int _fixed[FIXED_SIZE];
+		std::vector <int> _more;
+		int _count;
+	};
+public:
+	static const int NULL_NODE = -1;
+
+	DynamicTree(double margin);
+
+	int CreateProxy(const AABB& box, Rigidbody* body);
+	void DestroyProxy(int proxy);
+	bool MoveProxy(int proxy, const AABB& box);
+	const AABB& GetFatAABB(int proxy) const;
+	int GetHeight() const;
+	int GetProxyCount() const;
+
+	//callback(Rigidbody* body) for every leaf whose box overlaps box. The visit stops when the callback returns false
+	template <typename Callback>
+	void Query(const AABB& box, Callback& callback) const {
+		NodeStack stack;
+		stack.push(_root);
+		while (!stack.empty()) {
+			int id = stack.pop();
+			if (id == NULL_NODE) {
+				continue;
+			}
+			const TreeNode& node = _nodes[id];
+			if (!node.box.overlaps(box)) {
+				continue;
+			}
+			if (node.height == 0) {
+				if (!callback(node.body)) {
+					return;
+				}
+			}
+			else {
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	//callback(Rigidbody* body, double maxFraction) for every leaf whose box is crossed by the segment from p1 to p2,
+	//before maxFraction of the segment. The callback returns the new maxFraction (the fraction of its hit to keep
+	//only the closer bodies, maxFraction to go on, 0 to stop)
+	template <typename Callback>
+	void RayCast(vector2 p1, vector2 p2, Callback& callback) const {
+		vector2 d = { p2.x - p1.x, p2.y - p1.y };
+		double length = sqrt(d.x * d.x + d.y * d.y);
+		if (length == 0) {
+			return;
+		}
+		vector2 v = { -d.y / length, d.x / length };		//normal of the segment
+		vector2 absV = { fabs(v.x), fabs(v.y) };
+		double maxFraction = 1.0;
+		AABB segmentBox = segmentAABB(p1, d, maxFraction);
+
+		NodeStack stack;
+		stack.push(_root);
+		while (!stack.empty()) {
+			int id = stack.pop();
+			if (id == NULL_NODE) {
+				continue;
+			}
+			const TreeNode& node = _nodes[id];
+			if (!node.box.overlaps(segmentBox)) {
+				continue;
+			}
+			//separating axis along the normal of the segment: |dot(v, p1 - c)| > dot(|v|, h)
+			vector2 c = { (node.box.min.x + node.box.max.x) * 0.5, (node.box.min.y + node.box.max.y) * 0.5 };
+			vector2 h = { (node.box.max.x - node.box.min.x) * 0.5, (node.box.max.y - node.box.min.y) * 0.5 };
+			double separation = fabs(v.x * (p1.x - c.x) + v.y * (p1.y - c.y)) - (absV.x * h.x + absV.y * h.y);
+			if (separation > 0) {
+				continue;
+			}
+			if (node.height == 0) {
+				double fraction = callback(node.body, maxFraction);
+				if (fraction <= 0) {
+					return;
+				}
+				if (fraction < maxFraction) {
+					maxFraction = fraction;
+					segmentBox = segmentAABB(p1, d, maxFraction);
+				}
+			}
+			else {
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	//callback(Rigidbody* body, double maxDistance) for the leaves whose box is closer than maxDistance to point,
+	//the closest boxes first. The callback returns the new maxDistance (the distance of the body to keep only the closer ones)
+	template <typename Callback>
+	void QueryNearest(vector2 point, double maxDistance, Callback& callback) const {
+		NodeStack stack;
+		stack.push(_root);
+		while (!stack.empty()) {
+			int id = stack.pop();
+			if (id == NULL_NODE || boxDistance(_nodes[id].box, point) > maxDistance) {
+				continue;
+			}
+			const TreeNode& node = _nodes[id];
+			if (node.height == 0) {
+				maxDistance = std::min(maxDistance, callback(node.body, maxDistance));
+				continue;
+			}
+			//visit the closer child first, so the far one is likely pruned
+			if (boxDistance(_nodes[node.child1].box, point) < boxDistance(_nodes[node.child2].box, point)) {
+				stack.push(node.child2);
+				stack.push(node.child1);
+			}
+			else {
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+private:
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void fixUpwards(int node);
+
+	static AABB combine(const AABB& a, const AABB& b) {
+		return { { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y) }, { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y) } };
+	}
+	static double perimeter(const AABB& a) {
+		return 2.0 * ((a.max.x - a.min.x) + (a.max.y - a.min.y));
+	}
+	static bool contains(const AABB& outer, const AABB& inner) {
+		return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+	}
+	static AABB segmentAABB(vector2 p1, vector2 d, double fraction) {
+		vector2 p2 = { p1.x + d.x * fraction, p1.y + d.y * fraction };
+		return { { std::min(p1.x, p2.x), std::min(p1.y, p2.y) }, { std::max(p1.x, p2.x), std::max(p1.y, p2.y) } };
+	}
+	static double boxDistance(const AABB& box, vector2 p) {
+		double dx = std::max(0.0, std::max(box.min.x - p.x, p.x - box.max.x));
+		double dy = std::max(0.0, std::max(box.min.y - p.y, p.y - box.max.y));
+		return sqrt(dx * dx + dy * dy);
+	}
+
+	std::vector <TreeNode> _nodes;
+	int _root;
+	int _freeList;
+	int _proxyCount;
+	double _margin;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef EPOCH_MANAGER_H
+#define EPOCH_MANAGER_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <stddef.h>
+
+//Quiescent state based reclamation.
+//Every thread that reads shared objects (game, render, helpers) registers itself and periodically announces
+//a quiescent point, i.e. a moment where it holds no pointer returned by FindGameObject() and similar calls.
+//A retired object is freed as soon as every online thread announced a quiescent point after the retirement.
+//Threads that sleep for a long time (e.g. parked helpers) go offline so they don't hold the reclamation back
+class EpochManager {
+	struct RetiredObject {
+		void* ptr;
+		void (*deleter)(void*);
+		uint64_t epoch;
+	};
+
+	struct alignas(64) Participant {
+		std::atomic <uint64_t> epoch;		//last epoch observed by the thread. 0 if the thread is offline
+		std::atomic <bool> used;
+	};
+public:
+	static EpochManager& getInstance() {
+		static EpochManager instance;
+		return instance;
+	}
+
+	EpochManager(const EpochManager&) = delete;
+	EpochManager& operator=(const EpochManager&) = delete;
+
+	bool RegisterThread();
+	void UnregisterThread();
+	void QuiescentPoint();
+	void Offline();
+	void Online();
+
+	void Retire(void* ptr, void (*deleter)(void*));
+	template <typename T>
+	void Retire(T* ptr) {
+		Retire(ptr, [](void* p) { delete (T*)p; });
+	}
+	size_t Collect();
+
+	uint64_t GetEpoch();
+	size_t GetRetiredCount();
+
+private:
+	EpochManager();
+	~EpochManager();
+
+	bool TryAdvance();
+	uint64_t MinimumEpoch();
+
+	static const int MAX_PARTICIPANTS = 128;
+	static thread_local int _threadIndex;
+
+	std::atomic <uint64_t> _globalEpoch;
+	Participant _participants[MAX_PARTICIPANTS];
+	std::deque <RetiredObject> _retired;		//sorted by epoch
+	std::mutex _retired_mutex;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <chrono>
+#include <mutex>
+#include <atomic>
+
+//frame time statistics of a loop over the last frames. Times are in seconds
+typedef struct frameStats {
+	double lastFrameTime;
+	double averageFrameTime;
+	double minFrameTime;
+	double maxFrameTime;
+	double jitter;					//standard deviation of the frame time
+	double averageFPS;
+	unsigned long long frames;			//frames since the start
+	unsigned long long missedDeadlines;	//frames whose work ended after the deadline
+}FrameStats;
+
+//Paces a loop to a target rate using absolute deadlines: the deadline of a frame is the deadline of the previous one
+//plus the period, so the time lost when a wait wakes up late is recovered in the next frame and the rate doesn't drift.
+//The wait sleeps while the deadline is far and spins for the last part, since a sleep can overshoot by up to a millisecond.
+//The overshoot of the sleeps is measured to decide when to stop sleeping.
+//A pacer is used by a single loop, the statistics can be read from any thread
+class FramePacer {
+	typedef std::chrono::high_resolution_clock Clock;
+public:
+	FramePacer(double targetFPS);
+
+	void SetTargetFPS(double fps);
+	double GetTargetFPS();
+
+	void Start();
+	double TimeLeft();
+	double EndFrame(bool wait);
+	FrameStats GetStats();
+
+private:
+	void WaitUntil(Clock::time_point deadline);
+	void Record(double frameTime, bool missed);
+
+	static const int STATS_WINDOW = 120;		//number of frames used for the statistics
+
+	std::atomic <double> _targetFPS;
+	double _period;					//period used for the current deadline
+	Clock::time_point _frameStart;
+	Clock::time_point _deadline;
+
+	//estimate of the real duration of a 1ms sleep
+	double _sleepMean;
+	double _sleepVariance;
+
+	std::mutex stats_mutex;
+	double _frameTimes[STATS_WINDOW];
+	int _frameTimesCount;
+	int _frameTimesHead;
+	double _lastFrameTime;
+	unsigned long long _frames;
+	unsigned long long _missedDeadlines;
+};
+
+#endif
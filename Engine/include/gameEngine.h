@@ -8,6 +8,11 @@
 #include "entity.h"
 #include "game_options.h"
 #include "gameEngine_structs.h"
+#include "objectRegistry.h"
+#include "mpscQueue.h"
+#include "spatialGrid.h"
+#include "taskGraph.h"
+#include "framePacer.h"
 
 
 #include <vector>
@@ -16,6 +21,7 @@
 #include <map>
 #include <atomic>
 #include <random>
+#include <chrono>
 
 class GameObject;
 class Input;
@@ -39,34 +45,72 @@ class GameEngine {
 		REGISTER_GAME_OBJECT,
 		REGISTER_LIGHT_OBJECT,
 		DESTROY_GAME_OBJECT,
+		REGISTER_GAME_OBJECTS,
+		DESTROY_GAME_OBJECTS,
 		DESTROY_ALL
 	};
 
-	typedef struct gameObjectData {
-		EntityName name;
-		GameObject* obj;
-	}GameObjectData;
-
 	typedef struct requestData {
 		GameObjectData objectData;
-		Scene *scene;
+		std::vector <GameObjectData>* objects = nullptr;		//bulk requests only
+		Scene *scene = nullptr;
 		GameEngineRequestType requestType;
 	}RequestData;
+	typedef MPSCQueue<RequestData>::Block RequestBlock;
 
 	struct UpdateHelperData {
 		std::vector <GameObjectData>* objects;
 		double elapsedTime;
+		bool saveTransform;		//save the transforms for the render interpolation
 	};
 	struct DrawHelperData {
-		std::vector <GameObjectData>* objects;
+		std::vector <GameObject*>* objects;
 		double maxRenderRadius;
 		vector2 cameraPos;
+		bool interpolate;
+	};
+	//new position of an object in the grid, recorded during the post update
+	struct GridUpdate {
+		uint32_t id;
+		vector2 position;
+		double radius;
 	};
 	struct PhysicsHelperData {
 		double timeElapsed;
 		int threads;
 	};
+	//arguments of the tasks of a frame graph
+	struct FrameTaskData {
+		UpdateHelperData update;			//all the objects
+		UpdateHelperData physicsObjects;	//objects that can move a rigidbody during the post update
+		UpdateHelperData otherObjects;
+		DrawHelperData draw;
+		PhysicsHelperData physics;
+		GameObject* camera;
+		std::chrono::high_resolution_clock::time_point frameStart;
+		int postUpdatePhysicsTask;
+		int postUpdateTask;
+		int drawTask;
+		int narrowphaseTask;
+		int resolveTask;
+	};
 public:
+	//number of requests created and handled by the game engine since the start
+	struct RequestCounters {
+		unsigned long long submitted;
+		unsigned long long completed;
+	};
+
+	//While a RequestBatch is alive, the requests created by the same thread are buffered and submitted
+	//all together when the outermost batch is destroyed. Batches can be nested
+	class RequestBatch {
+	public:
+		RequestBatch();
+		~RequestBatch();
+		RequestBatch(const RequestBatch&) = delete;
+		RequestBatch& operator=(const RequestBatch&) = delete;
+	};
+
     static GameEngine& getInstance() {
         static GameEngine instance;
         return instance;
@@ -75,15 +119,23 @@ public:
     GameEngine(const GameEngine&) = delete;
     GameEngine& operator=(const GameEngine&) = delete;
 
-	void GameEngine_Start(void (*GameInit)(), GraphicsOptions& g_options, AudioOptions& a_options);
+	void GameEngine_Start(void (*GameInit)(), GraphicsOptions& g_options, AudioOptions& a_options, const EngineOptions& e_options = EngineOptions());
 
 	uint32_t posToZone(vector2 pos);
 	int zoneDistance(uint32_t zone1, uint32_t zone2);
+	void QueryZone(AABB rect, std::vector <GameObject*>& objects);
+	bool IsNearCamera(vector2 pos, double distance);
 	GameObject* FindGameObject(EntityName name);
+	GameObject* FindGameObject(ObjectHandle handle);
+	ObjectHandle GetObjectHandle(EntityName name);
+	bool IsObjectAlive(ObjectHandle handle);
 	EntityName RegisterGameObject(GameObject* obj, EntityName name);
 	EntityName RegisterLightObject(LightObject* obj, EntityName name);
 	std::vector <LightObject*>* GetLightObjects();
 	void DestroyGameObject(EntityName name);
+	void RegisterGameObjects(GameObject* const* objects, EntityName* names, size_t count);
+	void DestroyGameObjects(const EntityName* names, size_t count);
+	void DestroyGameObjects(const std::vector <EntityName>& names);
 	void CreateScene(Scene *scene);
 	void LoadScene(int sceneId);
 	void Quit();
@@ -105,21 +157,37 @@ public:
 	
 	double GetRenderFPS();
 	double GetGameFPS();
+	FrameStats GetRenderFrameStats();
+	FrameStats GetGameFrameStats();
 	void SetGameFPS(double gameFps);
-	unsigned long GetTaskQueueLen();
+	void PaceRenderToDisplay(bool enable);
+	void SetFixedTimestep(bool enable, double tickRate = 60, int maxTicksPerLoop = 5);
+	bool IsFixedTimestep();
+	bool IsHeadless();
+	std::vector <TaskTiming> GetFrameCriticalPath();
+	std::vector <TaskStats> GetPhaseStats();
+	void ResetPhaseStats();
+	std::vector <WorkerStats> GetWorkerStats();
+	void ResetWorkerStats();
+	RequestCounters GetRequestCounters();
+	unsigned long GetPendingRequests();
+	[[deprecated]] unsigned long GetTaskQueueLen();	//use GetPendingRequests()
 
 	//internal use
 	void _GuiListener(GUI_Element* element, GuiAction action);
+	void _ParallelRun(int count, void(*function)(int start_index, int end_index, void* args), void* args);
 private:
 	GameEngine();
 	~GameEngine();
 
 	void Init_Engines(GraphicsOptions& g_options, AudioOptions& a_options);
+	bool planThreadPlacement(const struct cpuTopology& topology);
 	void mainThread();
 	void gameThread();
 
-	double limit_fps(double elapsedTime, double maxFPS);
-	void ThrowTheGarbage();
+	int addUpdateTasks(FrameTaskData& data, double elapsedTime, bool saveTransform);
+	int addDrawTasks(FrameTaskData& data, bool interpolate, int after);
+	void runFrameGraph(FrameTaskData& data);
 
 	void LoadScene_Internal();
 	void ChangeScene_Internal(Scene* scene);
@@ -128,10 +196,16 @@ private:
 	void FreeAllGlobalVars(void);
 
 	void PollRequests(double timeLeft);
+	void PushRequest(const RequestData& request);
 	void RegisterGameObject_Internal(GameObject* obj, EntityName name);
 	void RegisterLightObject_Internal(GameObject* obj, EntityName name);
 	void DestroyGameObject_Internal(EntityName name);
-	std::pair <bool, int> FindObject_Internal(EntityName name);
+	void RegisterGameObjects_Internal(std::vector <GameObjectData>& objects);
+	void DestroyGameObjects_Internal(std::vector <GameObjectData>& objects);
+	void ReleaseObjects_Internal(std::vector <GameObject*>& objects);
+	void InsertInGrid_Internal(GameObject* obj, ObjectHandle handle, uint8_t flags);
+	void UpdateGrid_Internal();
+	static double cullRadius(GameObject* obj, uint8_t flags);
 
 	//helper routines
 	static void animation_helper_routine(int start_index, int end_index, void* args);
@@ -140,23 +214,50 @@ private:
 	static void post_update_helper_routine(int start_index, int end_index, void* args);
 	static void draw_helper_routine(int start_index, int end_index, void* args);
 	static void physics_helper_routine(int start_index, int end_index, void* args);
-
-	std::vector <GameObjectData> _objects;
-	std::vector <GameObjectData> _lightObj;
-	std::atomic <int> _obj_vect_size;
-	std::vector < RequestData> _requests;
-	std::vector <std::pair <GameObject*, int>> _garbageCollector;
+	static void scene_task_routine(int start_index, int end_index, void* args);
+	static void partition_task_routine(int start_index, int end_index, void* args);
+	static void grid_task_routine(int start_index, int end_index, void* args);
+	static void gui_task_routine(int start_index, int end_index, void* args);
+	static void draw_prepare_task_routine(int start_index, int end_index, void* args);
+	static void draw_finish_task_routine(int start_index, int end_index, void* args);
+	static void physics_frame_task_routine(int start_index, int end_index, void* args);
+	static void physics_tree_task_routine(int start_index, int end_index, void* args);
+	static void physics_resolve_task_routine(int start_index, int end_index, void* args);
+	static void requests_task_routine(int start_index, int end_index, void* args);
+	static bool background_job_routine(void* args);
+
+	ObjectRegistry _objects;
+	SpatialGrid _grid;		//protected by the registry lock
+	std::vector <GridUpdate> _gridUpdates;		//positions of the objects after the post update, applied by the grid task
+	std::vector <GameObject*> _drawList;
+	std::vector <LightObject*> _visibleLights;		//light objects near the camera in the last drawn frame
+	std::vector <GameObjectData> _physicsObjects;	//split of the objects done every frame for the post update
+	std::vector <GameObjectData> _otherObjects;
+	TaskGraph _frameGraph;
+	std::vector <TaskTiming> _frameCriticalPath;	//critical path of the frame being run
+	std::vector <TaskTiming> _criticalPath;			//critical path of the last completed frame
+	std::vector <TaskStats> _phaseStats;			//duration of the frame tasks since the last reset
+	std::atomic <uint32_t> _cameraZone;
+	std::atomic <bool> _cameraZoneValid;
+	MPSCQueue <RequestData> _requests;
+	std::vector <RequestData> _pendingRequests;		//drained requests, only accessed by the game thread
+	size_t _pendingHead;
+	std::atomic <unsigned long long> _submittedRequests;
+	std::atomic <unsigned long long> _completedRequests;
+	static thread_local RequestBlock* _threadRequestBuffer;
+	static thread_local int _threadBatchDepth;
 	std::map <EntityName, Variable*> globalVars;
 
 	std::atomic <vector2> _mousePosition;
 	std::atomic <vector2> _lastClickPosition;
 
-	//std::mutex object_vector_mutex;
-	RWLock object_vector_mutex;		//read write lock for the object vector
+	RWLock object_vector_mutex;		//read write lock for the object registry
 	std::mutex global_var_mutex;
 	std::mutex scene_loading_mutex;
-	std::mutex request_mutex;
 	std::mutex scene_mutex;
+	std::mutex grid_updates_mutex;
+	std::mutex visible_lights_mutex;
+	std::mutex frame_stats_mutex;
 	
 	std::mutex sync_render_mutex;
 	std::condition_variable sync_cv;
@@ -167,14 +268,20 @@ private:
 	std::atomic <double> renderFPS;
 	std::atomic <double> gameFPS;
 
-	std::atomic <double> renderCurrentFPS;
-	std::atomic <double> gameCurrentFPS;
+	FramePacer _renderPacer;
+	FramePacer _gamePacer;
+	std::atomic <bool> _paceToDisplay;
 
 	std::atomic <bool> lockRenderFPS;
 	std::atomic <bool> lockGameFPS;
 
 	std::atomic <double> gameSpeed;
+	std::atomic <bool> _fixedTimestep;
+	std::atomic <double> _tickRate;
+	std::atomic <int> _maxTicksPerLoop;
 	std::atomic <bool> gameRunning;
+	bool _headless;
+	unsigned long _frameLimit;		//frames to run before stopping, 0 for no limit
 	std::atomic <bool> _sceneReady;
 	std::atomic <bool> _freeingScene;
 	std::atomic <GameEvent> _lastGameEvent;
@@ -188,6 +295,12 @@ private:
 
 	MultithreadManager *_helperManager;
 	int _helperCount;
+
+	//logical cpus of the threads when EngineOptions::pinThreads is set
+	bool _pinThreads;
+	std::vector <int> _renderCpus;
+	std::vector <int> _gameCpus;
+	std::vector <int> _helperCpus;		//one for every helper
 	Barrier * _syncBarrier;
 };
 
@@ -3,12 +3,26 @@
 
 #include <mutex>
 #include <shared_mutex>
+#include <stdint.h>
 
 typedef unsigned long long EntityName;
 typedef std::shared_mutex RWLock;
 typedef std::unique_lock< RWLock >  WriteLock;
 typedef std::shared_lock< RWLock >  ReadLock;
 
+//generational handle to a registered game object.
+//The handle stops being valid as soon as the object is destroyed, even if the slot is reused later
+typedef struct objectHandle {
+	uint32_t index;
+	uint32_t generation;	//generation 0 is never assigned, so a zeroed handle is always invalid
+	bool operator==(const objectHandle& other) const {
+		return index == other.index && generation == other.generation;
+	}
+	bool operator!=(const objectHandle& other) const {
+		return !(*this == other);
+	}
+}ObjectHandle;
+
 enum class GameEvent {
 	NO_EVENT,
 	GAME_QUIT
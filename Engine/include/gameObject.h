@@ -6,6 +6,7 @@
 #include "rigidbody.h"
 #include "entity.h"
 #include "transform.h"
+#include "gameEngine_structs.h"
 
 
 #include <vector>
@@ -36,6 +37,7 @@ public:
 	virtual void update(double timeElapsed);
 
 	EntityName getObjectName();
+	ObjectHandle getObjectHandle();
 	void setTexture(EntityName textureName);
 
 	void AnimateSprite(bool animate);
@@ -65,6 +67,7 @@ public:
 	[[nodiscard]] std::vector <EntityName>* GetChild();
 
 	void AttachRigidbody(std::vector <vector2>& vertexes);
+	void AttachStaticWorld(StaticWorld* world);
 	Rigidbody* GetRigidbody();
 
 	virtual void OnCollisionEnter(Collision &);
@@ -74,6 +77,13 @@ public:
 	virtual void OnTriggerStay(Collision&);
 	virtual void OnTriggerExit(Collision&);
 
+	//internal call. Don't use it
+	void _setObjectHandle(ObjectHandle handle);
+	void _setObjectName(EntityName name);
+	void _savePrevTransform();
+	TransformStruct _getTransformDelta();
+	bool _hasConstraintParent();
+
 	void setLayer(uint16_t layer);
 	uint16_t getLayer();
 
@@ -88,7 +98,9 @@ protected:
 	UInt spriteAnimationID;
 	std::vector <Animation *> _animations;
 	EntityName _objectName;
+	std::atomic <ObjectHandle> _objectHandle;		//set by the game engine once the object is registered
 	std::atomic <Sprite*> _texture;
+	TransformStruct _prevTransform;		//transform at the start of the last simulation step
 	
 	Rigidbody* rigidbody;
 
@@ -18,4 +18,11 @@ struct AudioOptions{
     uint8_t defaultTrackVol;
 };
 
+struct EngineOptions{
+    bool headless = false;          //no window and no audio device: the graphics and audio backends discard everything
+    unsigned long frameCount = 0;   //number of game frames to run before GameEngine_Start returns. 0 runs until Quit()
+    bool pinThreads = false;        //pin the render, game and helper threads to cpus. The render thread gets a physical core for itself.
+                                    //Ignored when the cpu topology can't be read
+};
+
 #endif
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "entity.h"
 #include "game_options.h"
 #include "graphics_structs.h"
+#include "jobSystem.h"
 
 
 struct SDL_Texture;
@@ -31,6 +32,7 @@ class GraphicsEngine {
 		vector2 scale;
 		double rot;
 		TextureFlip flip;
+		TransformStruct delta;		//movement since the previous simulation step, used for interpolation
 	} TextureObj;
 
 
@@ -65,6 +67,7 @@ class GraphicsEngine {
 		SDL_Surface* surface;
 		std::atomic <bool> done;
 		std::atomic <bool> abort;
+		JobHandle job;		//background job that draws the surface
 	};
 
 	typedef struct textureCreation {
@@ -122,6 +125,8 @@ class GraphicsEngine {
 		vector2 pos;
 		vector2 scale;
 		double rot;
+		TransformStruct delta;
+		double publishTime;		//time the frame was swapped in, in seconds
 	}CameraTransform;
 
 	struct LightRenderData {
@@ -140,18 +145,21 @@ public:
     GraphicsEngine(const GraphicsEngine&) = delete;
     GraphicsEngine& operator=(const GraphicsEngine&) = delete;
 
-	void Init(GraphicsOptions &options);
+	void Init(GraphicsOptions &options, bool headless = false);
 
 	//requests that can be processed immediately
 	void Flip();		//renders everything to the screen
 	void SwapScreenBuffersPhysics();
 	void SwapScreenBuffersGraphics();
-	void updateRenderCamera(bool present, vector2 pos, vector2 scale, double rotation);
+	void updateRenderCamera(bool present, vector2 pos, vector2 scale, double rotation, TransformStruct delta = {});
+	void SetInterpolationStep(double step);
+	void _setBlitDelta(TransformStruct delta);		//internal call. Don't use it
 	void BlitSurface(EntityName textureName, int screenLayer, vector2 pos, vector2 rect, double rot, TextureFlip flip);
 	void BlitTextSurface(EntityName atlasName, std::string text, int layer, vector2 pos, vector2 rect, double rot, TextureFlip flip, int cursorPos);
 	void EnableRenderingDepth(bool enable);
 
 	int GetWindowMode();
+	int GetDisplayRefreshRate();
 	std::pair <int, int> GetWindowSize();		//return the width of the window
 	void SetBackgroundColor(RGBA_Color& color);
 	
@@ -178,6 +186,7 @@ public:
 	void Calculate_Parabola_Coeff_From_Points(double x1, double y1, double x2, double y2, double x3, double y3, double &A, double &B, double &C);
 
 	void PollRequests(double timeLeft);		//poll requests from the request queue
+	void DiscardRequest_Internal(std::pair <GraphicRequestType, void*>& request);
 
 	void CompleteLightBaking();
 
@@ -272,6 +281,10 @@ private:
 	CameraTransform _CameraTransforms[3];
 	std::atomic <vector2> spaceToScreenScale;
 	std::atomic <vector2> _cameraPos;
+	bool _newFrame;		//a frame was swapped in by the game thread and not rendered yet
+	bool _headless;		//null backend: nothing is rendered and the requests are dropped
+	std::atomic <double> _interpolationStep;		//duration of a simulation step. 0 disables the interpolation
+	static thread_local TransformStruct _blitDelta;
 
 	//vector for parallel light baking
 	std::vector<LightTextureBakeData *> _lightBakingTasks;
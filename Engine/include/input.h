@@ -17,7 +17,8 @@ union SDL_Event;
 enum class InputEvent {
 	START_TEXT_INPUT,
 	STOP_TEXT_INPUT,
-	QUIT_APP
+	QUIT_APP,
+	NO_EVENT
 };
 
 class InputEngine {
@@ -0,0 +1,84 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class MultithreadManager;
+
+enum class JobPriority {
+	HIGH,
+	NORMAL,
+	LOW
+};
+
+typedef struct jobHandle {
+	unsigned long long id;		//0 is never a valid job
+}JobHandle;
+
+//Background jobs: heavy one-off work (pathfinding, level generation, saves, light baking) that must not block the game thread.
+//The jobs run on the helpers of the frame pool while they have no frame work: a helper takes a job only when no frame job is open
+//and at most helpers - 1 helpers run jobs at the same time, so there is always a helper ready for the frame.
+//A job is never interrupted, so a long job should be split in smaller ones; a helper running a job skips the frame jobs until it ends.
+//With one helper or none the game thread runs the jobs at the end of the frame, while the frame has time left.
+//The completion callbacks are called on the game thread after the frame graph and the rigidbody changes,
+//before the frame pacing, in the order the jobs completed.
+//
+//	JobHandle path = JobSystem::getInstance().Submit([=]() { ... }, JobPriority::HIGH, [=]() { ...use the result... });
+class JobSystem {
+	typedef struct job {
+		unsigned long long id;
+		std::function<void()> function;
+		std::function<void()> onComplete;
+	}Job;
+
+	enum class JobState {
+		QUEUED,
+		RUNNING,
+		COMPLETED		//waiting for the callback
+	};
+public:
+	static JobSystem& getInstance() {
+		static JobSystem instance;
+		return instance;
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	JobHandle Submit(std::function<void()> job, JobPriority priority = JobPriority::NORMAL, std::function<void()> onComplete = nullptr);
+	bool Cancel(JobHandle handle);
+	bool IsDone(JobHandle handle);
+	void Wait(JobHandle handle);
+	int GetPendingJobs();
+
+	//engine side
+	bool RunNextJob();
+	void DeliverCompletions();
+	void SetPool(MultithreadManager* pool);
+	void Clear();
+
+private:
+	JobSystem();
+	~JobSystem();
+
+	bool takeJob(Job& job);
+	void completeJob(Job& job);
+
+	static const int PRIORITIES = 3;
+
+	std::mutex jobs_mutex;
+	std::condition_variable _jobDone;
+	std::deque <Job> _queues[PRIORITIES];		//queued jobs of every priority
+	std::unordered_map <unsigned long long, JobState> _states;		//jobs not completed or with a callback not called yet
+	std::vector <Job> _completed;		//jobs with a callback to call
+	unsigned long long _nextId;
+	std::atomic <MultithreadManager*> _pool;
+};
+
+#endif
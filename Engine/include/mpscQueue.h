@@ -0,0 +1,141 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+//Lock-free multi producer single consumer queue.
+//Producers publish blocks of items with a single compare and swap on the head of a stack;
+//the consumer takes every published block at once with an exchange and restores the FIFO order.
+//Items pushed by the same thread are always drained in the order they were pushed.
+//The drained blocks are kept for the next pushes: the consumer returns them to a free stack and a producer that runs out
+//takes the whole stack at once into a cache of its thread, so a block is never popped alone (no ABA on the free stack)
+template <typename T>
+class MPSCQueue {
+public:
+	//a block of items published with a single atomic operation (submission buffer)
+	struct Block {
+		std::vector <T> items;
+		Block* next = nullptr;
+	};
+
+	MPSCQueue() : _head(nullptr), _free(nullptr) {}
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+	//the items still queued are dropped: drain the queue first if they own memory
+	~MPSCQueue() {
+		deleteBlocks(_head.exchange(nullptr));
+		deleteBlocks(_free.exchange(nullptr));
+	}
+
+	void Push(const T& item) {
+		Block* b = NewBlock();
+		b->items.push_back(item);
+		PushBlock(b);
+	}
+
+	//empty block from the free blocks of the thread, or a new one. Give it back with PushBlock()
+	Block* NewBlock() {
+		BlockCache& cache = _cache;
+		if (cache.blocks == nullptr) {
+			cache.blocks = _free.exchange(nullptr, std::memory_order_acquire);
+		}
+		Block* b = cache.blocks;
+		if (b == nullptr) {
+			return new Block();
+		}
+		cache.blocks = b->next;
+		b->next = nullptr;
+		return b;
+	}
+
+	//publish a block. The queue takes ownership of the block
+	void PushBlock(Block* b) {
+		if (b == nullptr) {
+			return;
+		}
+		if (b->items.size() == 0) {
+			recycle(b);
+			return;
+		}
+		Block* head = _head.load(std::memory_order_relaxed);
+		do {
+			b->next = head;
+		} while (!_head.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	//move every published item at the end of out. Only one thread at a time can drain the queue.
+	//Returns the number of items drained
+	size_t Drain(std::vector <T>& out) {
+		Block* b = _head.exchange(nullptr, std::memory_order_acquire);
+		if (b == nullptr) {
+			return 0;
+		}
+
+		//the stack holds the newest block first: reverse it
+		Block* fifo = nullptr;
+		while (b != nullptr) {
+			Block* next = b->next;
+			b->next = fifo;
+			fifo = b;
+			b = next;
+		}
+
+		size_t count = 0;
+		while (fifo != nullptr) {
+			Block* next = fifo->next;
+			count += fifo->items.size();
+			out.insert(out.end(), fifo->items.begin(), fifo->items.end());
+			recycle(fifo);
+			fifo = next;
+		}
+		return count;
+	}
+
+	bool Empty() {
+		return _head.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	//free blocks taken by a producer thread. They can be used with any queue of the same type, the thread frees them when it ends
+	struct BlockCache {
+		Block* blocks = nullptr;
+		~BlockCache() {
+			deleteBlocks(blocks);
+		}
+	};
+
+	static const size_t MAX_POOLED_ITEMS = 1024;		//the blocks of bigger batches are freed instead of keeping their memory
+
+	static void deleteBlocks(Block* b) {
+		while (b != nullptr) {
+			Block* next = b->next;
+			delete b;
+			b = next;
+		}
+	}
+
+	//empty the block and push it on the free stack. Pushing only with a compare and swap is safe from many threads
+	void recycle(Block* b) {
+		if (b->items.capacity() > MAX_POOLED_ITEMS) {
+			delete b;
+			return;
+		}
+		b->items.clear();
+		Block* head = _free.load(std::memory_order_relaxed);
+		do {
+			b->next = head;
+		} while (!_free.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	std::atomic <Block*> _head;
+	std::atomic <Block*> _free;		//drained blocks ready to be used again
+	static thread_local BlockCache _cache;
+};
+
+template <typename T>
+thread_local typename MPSCQueue<T>::BlockCache MPSCQueue<T>::_cache;
+
+#endif
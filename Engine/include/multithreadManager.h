@@ -2,24 +2,112 @@
 #define MULTITHREAD_WORK_H
 
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 #include "threadHelper.h"
 
+//utilisation of a worker of the pool since the start or the last reset. Times are in seconds.
+//Worker 0 is the thread that calls Wait(), the others are the helpers
+typedef struct workerStats {
+	double busyTime;		//time spent running chunks
+	double utilisation;		//busyTime / time since the last reset
+	unsigned long long items;
+	unsigned long long chunks;
+	unsigned long long steals;	//ranges taken from the queue of another worker
+	double backgroundTime;		//time spent running the idle work (background jobs)
+}WorkerStats;
+
+//Work stealing pool. startWork() splits [0, count) evenly between the queues of the workers (the helpers and the caller).
+//Every worker takes chunks from the front of its own queue, smaller and smaller as the queue gets shorter,
+//and when its queue is empty it steals the back half of the queue of another worker,
+//so a worker that got the expensive objects doesn't keep the others waiting.
+//The thread that calls Wait() runs chunks too until there is nothing left to take.
+//startOnHelpers() instead runs a function once on every helper, for schedulers that hand out the work themselves
+//(the task graph): they report the time of their own chunks with AddWorkerTime().
+//A new job is published by incrementing a generation counter. The helpers join the job while it's open and the end of the job
+//is a single atomic counter of the helpers that joined it: Wait() closes the job and waits only for them, so a helper that is
+//busy with background work is not waited for. The helpers and the waiting thread spin for a short time before parking
+//on the counters with a futex, so back to back jobs in the same frame don't pay a syscall per helper.
+//A helper with nothing left to take in the jobs of the pool runs the idle work (SetIdleWork()), one piece at a time,
+//so it's back for the next job as soon as the current piece ends.
+//The pool runs one work at a time: tryRun() gives up when the pool is busy or when it's called by a helper of the pool
+//(e.g. a background job), the calling thread can run the work itself
 class MultithreadManager {
+	//range of indices still to run. The owner pops from the front, the thieves split the back
+	struct alignas(64) WorkQueue {
+		std::mutex lock;
+		int begin;
+		int end;
+	};
+
+	struct alignas(64) WorkerCounters {
+		std::atomic <unsigned long long> busyTime;		//nanoseconds
+		std::atomic <unsigned long long> items;
+		std::atomic <unsigned long long> chunks;
+		std::atomic <unsigned long long> steals;
+		std::atomic <unsigned long long> backgroundTime;		//nanoseconds
+	};
 public:
 
-	MultithreadManager(int threads);
+	MultithreadManager(int threads, const std::vector <int>& helperCpus = std::vector <int>());
+	~MultithreadManager();
 	void startWork(int count, void(*function)(int start_index, int end_index, void* args), void *args);
+	void startOnHelpers(void(*function)(int worker, int unused, void* args), void* args);
 	void Wait();
-	void updateActiveTasks();
+	bool tryRun(int count, void(*function)(int start_index, int end_index, void* args), void* args);
+	void runWorker(int worker);
+	void AddWorkerTime(int worker, std::chrono::nanoseconds busy, int items);
+	void helperLoop(int worker, uint32_t generation);
 	void destroy();
+
+	void SetSpinTime(std::chrono::microseconds time);
+	void SetIdleWork(bool(*function)(void* args), void* args, int maxWorkers = -1);
+	void NotifyIdleWork();
+
+	int GetWorkerCount();
+	void GetWorkerStats(std::vector <WorkerStats>& stats);
+	void ResetWorkerStats();
 private:
+	bool takeChunk(int worker, int& start, int& end);
+	bool steal(int worker);
+	void wakeHelpers();
+	void acquire();
+	void dispatch(int count, void(*function)(int start_index, int end_index, void* args), void* args);
+	void openJob();
+	bool joinJob();
+	void leaveJob();
+	bool runIdleWork(int worker, uint32_t generation);
+	void waitForGeneration(uint32_t generation);
 
-	std::mutex taskMutex;
-	std::condition_variable taskCv;
-	int _activeTasks;
+	static const uint32_t JOB_OPEN = 0x80000000u;
+
+	alignas(64) std::atomic <uint32_t> _generation;		//incremented for every job given to the helpers and every NotifyIdleWork()
+	std::atomic <uint32_t> _parked;					//helpers sleeping on _generation
+	std::atomic <bool> _stop;
+	std::atomic <bool> _busy;						//a work is running: from startWork() / startOnHelpers() to the end of Wait()
+	alignas(64) std::atomic <uint32_t> _jobState;		//JOB_OPEN while the helpers can join the job + the helpers running it
+	std::atomic <uint32_t> _waiterParked;				//the thread in Wait() is sleeping on _jobState
+	std::atomic <long long> _spinTime;		//microseconds
+
+	//work run by the helpers when there is no job. Returns false when there was nothing to run
+	std::atomic <bool(*)(void* args)> _idleWork;
+	std::atomic <void*> _idleArgs;
+	std::atomic <int> _idleWorkers;		//helpers running the idle work
+	std::atomic <int> _maxIdleWorkers;
 
 	int threadCount;
 	std::vector <ThreadHelper*> threads;
+
+	void (*_function)(int start_index, int end_index, void* args);
+	void* _args;
+	bool _workPending;		//startWork() was called and the calling thread didn't help yet
+	bool _onHelpers;		//the current work is a startOnHelpers() call
+	int _workers;		//helpers + the calling thread
+	WorkQueue* _queues;
+	WorkerCounters* _counters;
+	std::chrono::steady_clock::time_point _statsStart;
 };
 
 #endif
@@ -0,0 +1,51 @@
+#ifndef OBJECT_REGISTRY_H
+#define OBJECT_REGISTRY_H
+
+#include "gameEngine_structs.h"
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+class GameObject;
+
+typedef struct gameObjectData {
+	EntityName name;
+	GameObject* obj;
+}GameObjectData;
+
+//Slot map of the registered game objects.
+//Insert, remove and lookup (by name or by handle) are O(1). The objects are also kept
+//in a dense vector that the helper routines iterate; removing an object moves the last one in its place.
+//The registry is not thread safe: the game engine protects it with its read write lock
+class ObjectRegistry {
+	struct Slot {
+		GameObject* obj;
+		EntityName name;
+		uint32_t generation;
+		uint32_t denseIndex;
+	};
+public:
+	ObjectRegistry();
+
+	ObjectHandle Insert(EntityName name, GameObject* obj);
+	GameObject* Remove(EntityName name);
+	void Clear(std::vector <GameObjectData>& removed);
+	GameObject* Find(EntityName name);
+	GameObject* Find(ObjectHandle handle);
+	ObjectHandle GetHandle(EntityName name);
+	bool IsValid(ObjectHandle handle);
+
+	std::vector <GameObjectData>& GetObjects();
+	size_t Size();
+private:
+	void FreeSlot(uint32_t slotIndex);
+
+	std::vector <Slot> _slots;
+	std::vector <uint32_t> _freeSlots;
+	std::vector <GameObjectData> _dense;
+	std::vector <uint32_t> _denseToSlot;
+	std::unordered_map <EntityName, uint32_t> _nameToSlot;
+};
+
+#endif
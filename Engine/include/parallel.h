@@ -0,0 +1,112 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <algorithm>
+
+//Parallel loops for engine and game code, run by the game thread and the helpers.
+//
+//	parallel_for(0, count, 64, [&](int i) { ... });
+//	float total = parallel_reduce(0, count, 64, 0.0f, [&](int i) { return value[i]; }, [](float a, float b) { return a + b; });
+//
+//The range [begin, end) is split in blocks of grain indices (grain <= 0 picks one) and the blocks are shared between the threads.
+//The body is called concurrently for different indices, so it must only write data that belongs to its index.
+//Called from a task of the frame (GameObject::update, Scene::scene_callback...) the loop becomes a task of the frame graph,
+//taken by the helpers that are idle. Outside of the frame it runs on the helpers pool, if the pool is busy it runs on the calling thread.
+//Loops can be nested. parallel_reduce joins the results of the blocks in order, so the result doesn't depend on the threads
+
+//runs function over [0, count) with the helpers and returns when it's completed. Defined in gameEngine.cpp
+void parallel_run(int count, void(*function)(int start_index, int end_index, void* args), void* args);
+
+template <typename Body>
+struct ParallelForData {
+	int begin;
+	int end;
+	int grain;
+	const Body* body;
+};
+
+template <typename Body>
+void parallel_for_routine(int start_index, int end_index, void* args) {
+	ParallelForData <Body>* data = (ParallelForData <Body>*)args;
+	int start = (int)(data->begin + (long long)start_index * data->grain);
+	int end = (int)std::min <long long>(data->end, data->begin + (long long)end_index * data->grain);
+	for (int i = start; i < end; i++) {
+		(*data->body)(i);
+	}
+}
+
+//call body(i) for every i in [begin, end)
+template <typename Body>
+void parallel_for(int begin, int end, int grain, const Body& body) {
+	int count = end - begin;
+	if (count <= 0) {
+		return;
+	}
+	if (grain <= 0) {
+		grain = std::max(1, count / 256);
+	}
+	int blocks = (int)(((long long)count + grain - 1) / grain);
+	ParallelForData <Body> data = { begin, end, grain, &body };
+	if (blocks == 1) {
+		parallel_for_routine <Body>(0, 1, &data);
+		return;
+	}
+	parallel_run(blocks, parallel_for_routine <Body>, &data);
+}
+
+template <typename T, typename Map, typename Join>
+struct ParallelReduceData {
+	int begin;
+	int end;
+	int grain;
+	const T* identity;
+	const Map* map;
+	const Join* join;
+	T* partial;		//result of every block
+};
+
+template <typename T, typename Map, typename Join>
+void parallel_reduce_routine(int start_index, int end_index, void* args) {
+	ParallelReduceData <T, Map, Join>* data = (ParallelReduceData <T, Map, Join>*)args;
+	for (int block = start_index; block < end_index; block++) {
+		int start = (int)(data->begin + (long long)block * data->grain);
+		int end = (int)std::min <long long>(data->end, start + (long long)data->grain);
+		T value = *data->identity;
+		for (int i = start; i < end; i++) {
+			value = (*data->join)(value, (*data->map)(i));
+		}
+		data->partial[block] = value;
+	}
+}
+
+//join(join(identity, map(begin)), map(begin + 1))... over [begin, end). join must be associative
+template <typename T, typename Map, typename Join>
+T parallel_reduce(int begin, int end, int grain, T identity, const Map& map, const Join& join) {
+	int count = end - begin;
+	if (count <= 0) {
+		return identity;
+	}
+	if (grain <= 0) {
+		grain = std::max(1, count / 256);
+	}
+	grain = std::max(grain, (count + 1023) / 1024);		//no more than 1024 partial results
+	int blocks = (int)(((long long)count + grain - 1) / grain);
+
+	std::vector <T> partial(blocks, identity);
+	ParallelReduceData <T, Map, Join> data = { begin, end, grain, &identity, &map, &join, partial.data() };
+	if (blocks == 1) {
+		parallel_reduce_routine <T, Map, Join>(0, 1, &data);
+	}
+	else {
+		parallel_run(blocks, parallel_reduce_routine <T, Map, Join>, &data);
+	}
+
+	T result = identity;
+	for (int i = 0; i < blocks; i++) {
+		result = join(result, partial[i]);
+	}
+	return result;
+}
+
+#endif
@@ -3,8 +3,15 @@
 
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <unordered_set>
+#include <unordered_map>
+#include <utility>
 #include "structures.h"
 #include "physics_structs.h"
+#include "broadphase.h"
+#include "dynamicTree.h"
+#include "contactSolver.h"
 
 
 class PhysicsEngine {
@@ -19,46 +26,127 @@ public:
 	
 	void RegisterRigidbody(Rigidbody *);
 	void RemoveRigidbody(Rigidbody *);
+	void RemoveRigidbodies(const std::vector <Rigidbody*>& bodies);
 	void _updateStatic(Rigidbody* r);
+	void ApplyBodyChanges();
+	void UpdateQueryTree();
 
-	void NewPhysicsFrame(double timeElapsed);
-	void UpdatePhysics(double timeElapsed, int thread, int threadCount);
+	void NewPhysicsFrame(double timeElapsed, int threadCount);
+	int GetNarrowphaseChunks();
+	void UpdatePhysics(double timeElapsed, int chunk);
 	void ResolvePhysics(double timeElapsed);
 	
-	double CollisionResponce(Rigidbody* body1, Rigidbody* body2, vector2& r1, vector2& r2, vector2 &collisionNormal,
-		vector2 &collisionVelocity);
-	
 	//developer calls
 	void SetGravity(vector2 force);
 	long GetBodiesCount();
+	long GetPairsCount();
+	long GetAwakeBodiesCount();
+	long GetSleepingBodiesCount();
+	unsigned long long GetNarrowphaseAllocations();
+	unsigned long long GetTotalNarrowphaseAllocations();
 	void createRegularPolygon(int sidesCount, double radius, std::vector <vector2>& vertexes);
 	void SetSleepVelocity(double velocity);
+	void SetSleepTime(double seconds);
+	void SetSolverIterations(int iterations);
+	int GetSolverColors();
+
+	//scene queries. Only the bodies whose game object group is in groupMask are returned. They can run on many threads
+	//at the same time, from the update of the objects to the end of the frame (not from the background jobs);
+	//the positions are the ones of the pre update
+	bool Raycast(vector2 origin, vector2 direction, double maxDistance, RaycastHit& hit, unsigned long groupMask = 0xffffffff);
+	void OverlapCircle(vector2 center, double radius, std::vector <Rigidbody*>& bodies, unsigned long groupMask = 0xffffffff);
+	void OverlapPolygon(const std::vector <vector2>& vertexes, std::vector <Rigidbody*>& bodies, unsigned long groupMask = 0xffffffff);
+	void QueryAABB(AABB box, std::vector <Rigidbody*>& bodies, unsigned long groupMask = 0xffffffff);
+	Rigidbody* FindNearest(vector2 point, double maxDistance, unsigned long groupMask = 0xffffffff);
 	
 private:
+	typedef SmallVector <struct CollisionPoint, 16> CollisionPoints;
+	struct NarrowphaseScratch {
+		ContactMesh mesh1;
+		ContactMesh mesh2;
+		CollisionPoints points;
+	};
+	//bodies that fell asleep together since they touch each other
+	struct SleepingIsland {
+		std::vector <Rigidbody*> bodies;
+		std::vector <Rigidbody*> touching;		//static bodies they rest on
+	};
+
 	PhysicsEngine();
 	~PhysicsEngine();
 
 	void Check_Convex_Convex_Collision(double timeElapsed, Rigidbody *r1, BoundingBox& box1, 
 		Rigidbody* r2, BoundingBox& box2, std::vector <CollisionStruct>& frameColl,
-		FMesh& mesh1, FMesh& mesh2);
-	bool checkPolygonPenetration(FMesh& mesh1, FMesh& mesh2);
-	bool checkPolygonPenetration(FMesh& m1, FMesh& m2, vector2& mtv);
-	void findVirtualCollisionPoints(FMesh& mesh1, FMesh& mesh2, vector2 velocityAxis,
-		std::vector <struct CollisionPoint> &collisions, int round);
+		NarrowphaseScratch& scratch);
+	void Check_Circle_Circle_Collision(Rigidbody* r1, BoundingBox& box1, Rigidbody* r2, BoundingBox& box2,
+		std::vector <CollisionStruct>& frameColl);
+	void Check_Circle_Convex_Collision(Rigidbody* r1, BoundingBox& box1, Rigidbody* r2, BoundingBox& box2,
+		std::vector <CollisionStruct>& frameColl);
+	void Check_World_Collision(Rigidbody* r1, BoundingBox& box1, Rigidbody* world, std::vector <CollisionStruct>& frameColl,
+		NarrowphaseScratch& scratch);
+	void convexMeshContact(Rigidbody* r1, Rigidbody* r2, vector2 origin, std::vector <CollisionStruct>& frameColl,
+		NarrowphaseScratch& scratch);
+	bool circleConvexContact(const VertexArray& v, vector2 origin, vector2 center, double radius,
+		vector2& point, vector2& normal, double& penetration);
+	void addContact(Rigidbody* r1, Rigidbody* r2, vector2 point, vector2 normal, double penetration,
+		std::vector <CollisionStruct>& frameColl);
+	void sweepBullets();
+	bool timeOfImpact(Rigidbody* bullet, vector2 motion, Rigidbody* body, double& t, vector2& normal);
+	bool sweepWorld(Rigidbody* bullet, vector2 motion, Rigidbody* world, double& t, vector2& normal);
+	bool checkPolygonPenetration(ContactMesh& mesh1, ContactMesh& mesh2);
+	bool checkPolygonPenetration(ContactMesh& m1, ContactMesh& m2, vector2& mtv);
+	void findVirtualCollisionPoints(ContactMesh& mesh1, ContactMesh& mesh2, vector2 velocityAxis,
+		CollisionPoints &collisions, int round);
 
 	
-	void filterCollisionPoints(std::vector <struct CollisionPoint>& collisions);
+	void filterCollisionPoints(CollisionPoints& collisions);
+	bool queryFilter(Rigidbody* body, unsigned long groupMask);
+	bool rayPolygon(Rigidbody* body, vector2 p1, vector2 d, double maxFraction, double& fraction, vector2& normal);
+	bool rayCircle(Rigidbody* body, vector2 p1, vector2 d, double maxFraction, double& fraction, vector2& normal);
+	bool circlePolygon(Rigidbody* body, vector2 center, double radius);
+	bool polygonsOverlap(Rigidbody* body, const std::vector <vector2>& vertexes);
+	double pointPolygonDistance(Rigidbody* body, vector2 point);
+	bool rayWorld(Rigidbody* world, vector2 p1, vector2 d, double maxFraction, double& fraction, vector2& normal);
+	double pointWorldDistance(Rigidbody* world, vector2 point);
+	bool worldOverlap(Rigidbody* world, const std::vector <vector2>& vertexes);
+	bool worldOverlap(Rigidbody* world, const AABB& box);
 	void _updatePhysics(double timeElapsed);
-	void _resolveCollision(CollisionStruct &c);
-	void _resolveFriction(CollisionStruct& c);
+	void buildNarrowphaseChunks(int threadCount);
+	void mergeContacts();
+	void updateIslands();
+	int findIsland(int body);
+	void wakeIsland(int island);
 
 	vector2 _gravity;
-	double _sleepVelocity;
+	double _sleepVelocity;		//0 disables the sleep
+	double _sleepTime;		//time below the sleep velocity before an island falls asleep
 	std::vector <Rigidbody*> _bodies;
+	std::unordered_set <Rigidbody*> _registeredBodies;
+	std::vector <Rigidbody*> _addedBodies;		//registered but not in the body list yet
+	bool _bodiesChanged;
 	std::mutex _update_mutex;
-	std::mutex _collision_buffer_mutex;
 	std::vector <CollisionStruct> frameCollisions;
+	std::vector <Rigidbody*> _awakeBodies;		//non static bodies simulated in this frame
+	std::vector <SleepingIsland> _islands;		//the index is the id of the island
+	std::vector <int> _freeIslands;
+	std::vector <int> _islandParent;		//union find of the awake bodies touching each other
+	std::vector <double> _islandSleepTime;		//shortest sleep time of the bodies of every island
+	std::vector <int> _islandOfRoot;		//sleeping island made for the root of an island
+	std::atomic <long> _sleepingCount;
+	std::vector <BroadphasePair> _narrowPairs;		//pairs of the broadphase that need the narrowphase
+	std::vector <int> _chunkStart;		//first pair of every chunk of the narrowphase, plus the end
+	std::vector <std::vector <CollisionStruct>> _chunkContacts;		//contacts found by every chunk. Kept between frames
+	std::vector <double> _pairCost;		//cost of the narrowphase pairs up to the pair included
+	static thread_local NarrowphaseScratch _narrowphaseScratch;
+	std::atomic <unsigned long long> _narrowphaseAllocations;
+	unsigned long long _totalNarrowphaseAllocations;
 	int _firstStatic;
+	SweepAndPrune _broadphase;
+	ContactSolver _solver;
+	DynamicTree _queryTree;		//changed only by UpdateQueryTree()
+	std::unordered_map <Rigidbody*, int> _treeProxies;
+	std::vector <std::pair <Rigidbody*, bool>> _treeChanges;		//bodies added (true) and removed since the last UpdateQueryTree()
+	bool _staticChanged;		//a body switched between static and non static since the last ApplyBodyChanges()
 };
 
 #endif
\ No newline at end of file
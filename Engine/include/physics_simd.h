@@ -0,0 +1,28 @@
+#ifndef PHYSICS_SIMD_H
+#define PHYSICS_SIMD_H
+
+//Vector kernels of the physics engine on vertexes stored as structure of arrays (all the x, then all the y),
+//so a single instruction works on 4 doubles (AVX2) or 2 doubles (SSE2), 8 or 4 floats in float precision.
+//SSE2 is used on every x86-64 compiler, plain C++ loops elsewhere or with FIREFLY_NO_SIMD. The cmake option
+//FIREFLY_AVX2 adds an AVX2 copy of the kernels (physics_simd_avx2.cpp), chosen at runtime if the cpu supports it.
+//The vertexes are in double precision unless FIREFLY_PHYSICS_FLOAT is defined (cmake option FIREFLY_PHYSICS_FLOAT):
+//floats halve the memory and double the vertexes per instruction, the narrowphase keeps its coordinates
+//relative to one of the bodies so the precision doesn't depend on the distance from the origin of the world
+#ifdef FIREFLY_PHYSICS_FLOAT
+typedef float physics_real;
+#else
+typedef double physics_real;
+#endif
+
+const char* SimdInstructionSet();
+
+void SimdTransformVertexes(const physics_real* x, const physics_real* y, int count, double scaleX, double scaleY,
+	double cosRot, double sinRot, physics_real* outX, physics_real* outY);
+void SimdTranslateVertexes(const physics_real* x, const physics_real* y, int count, double dx, double dy,
+	physics_real* outX, physics_real* outY);
+void SimdProjectMinMax(const physics_real* x, const physics_real* y, int count, double axisX, double axisY,
+	double& min, double& max);
+int SimdSupportPoint(const physics_real* x, const physics_real* y, int count, double axisX, double axisY);
+double SimdMaxLengthSquared(const physics_real* x, const physics_real* y, int count);
+
+#endif
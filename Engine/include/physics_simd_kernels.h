@@ -0,0 +1,238 @@
+#ifndef PHYSICS_SIMD_KERNELS_H
+#define PHYSICS_SIMD_KERNELS_H
+
+//Kernels of physics_simd.h for one instruction set, chosen by the flags of the file that includes this header:
+//physics_simd.cpp builds the SSE2 (or plain loops) copy and physics_simd_avx2.cpp, the only file compiled for AVX2,
+//builds the AVX2 one. SIMD_KERNELS is the namespace of the copy
+#include "physics_simd.h"
+
+#include <math.h>
+
+#ifndef SIMD_KERNELS
+#error "define SIMD_KERNELS before including physics_simd_kernels.h"
+#endif
+
+#if !defined(FIREFLY_NO_SIMD) && defined(__AVX2__)
+#define SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(FIREFLY_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace SIMD_KERNELS {
+
+//a register of LANES coordinates and the few operations the kernels need
+#if defined(SIMD_AVX2) && defined(FIREFLY_PHYSICS_FLOAT)
+#define SIMD_LANES 8
+typedef __m256 simd_t;
+static inline simd_t simd_load(const float* p) { return _mm256_loadu_ps(p); }
+static inline void simd_store(float* p, simd_t a) { _mm256_storeu_ps(p, a); }
+static inline simd_t simd_set(double a) { return _mm256_set1_ps((float)a); }
+static inline simd_t simd_add(simd_t a, simd_t b) { return _mm256_add_ps(a, b); }
+static inline simd_t simd_sub(simd_t a, simd_t b) { return _mm256_sub_ps(a, b); }
+static inline simd_t simd_mul(simd_t a, simd_t b) { return _mm256_mul_ps(a, b); }
+static inline simd_t simd_min(simd_t a, simd_t b) { return _mm256_min_ps(a, b); }
+static inline simd_t simd_max(simd_t a, simd_t b) { return _mm256_max_ps(a, b); }
+static inline simd_t simd_greater(simd_t a, simd_t b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline simd_t simd_select(simd_t mask, simd_t a, simd_t b) { return _mm256_blendv_ps(b, a, mask); }
+static inline simd_t simd_lane_index() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+#elif defined(SIMD_AVX2)
+#define SIMD_LANES 4
+typedef __m256d simd_t;
+static inline simd_t simd_load(const double* p) { return _mm256_loadu_pd(p); }
+static inline void simd_store(double* p, simd_t a) { _mm256_storeu_pd(p, a); }
+static inline simd_t simd_set(double a) { return _mm256_set1_pd(a); }
+static inline simd_t simd_add(simd_t a, simd_t b) { return _mm256_add_pd(a, b); }
+static inline simd_t simd_sub(simd_t a, simd_t b) { return _mm256_sub_pd(a, b); }
+static inline simd_t simd_mul(simd_t a, simd_t b) { return _mm256_mul_pd(a, b); }
+static inline simd_t simd_min(simd_t a, simd_t b) { return _mm256_min_pd(a, b); }
+static inline simd_t simd_max(simd_t a, simd_t b) { return _mm256_max_pd(a, b); }
+static inline simd_t simd_greater(simd_t a, simd_t b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+static inline simd_t simd_select(simd_t mask, simd_t a, simd_t b) { return _mm256_blendv_pd(b, a, mask); }
+static inline simd_t simd_lane_index() { return _mm256_setr_pd(0, 1, 2, 3); }
+#elif defined(SIMD_SSE2) && defined(FIREFLY_PHYSICS_FLOAT)
+#define SIMD_LANES 4
+typedef __m128 simd_t;
+static inline simd_t simd_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void simd_store(float* p, simd_t a) { _mm_storeu_ps(p, a); }
+static inline simd_t simd_set(double a) { return _mm_set1_ps((float)a); }
+static inline simd_t simd_add(simd_t a, simd_t b) { return _mm_add_ps(a, b); }
+static inline simd_t simd_sub(simd_t a, simd_t b) { return _mm_sub_ps(a, b); }
+static inline simd_t simd_mul(simd_t a, simd_t b) { return _mm_mul_ps(a, b); }
+static inline simd_t simd_min(simd_t a, simd_t b) { return _mm_min_ps(a, b); }
+static inline simd_t simd_max(simd_t a, simd_t b) { return _mm_max_ps(a, b); }
+static inline simd_t simd_greater(simd_t a, simd_t b) { return _mm_cmpgt_ps(a, b); }
+static inline simd_t simd_select(simd_t mask, simd_t a, simd_t b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline simd_t simd_lane_index() { return _mm_setr_ps(0, 1, 2, 3); }
+#elif defined(SIMD_SSE2)
+#define SIMD_LANES 2
+typedef __m128d simd_t;
+static inline simd_t simd_load(const double* p) { return _mm_loadu_pd(p); }
+static inline void simd_store(double* p, simd_t a) { _mm_storeu_pd(p, a); }
+static inline simd_t simd_set(double a) { return _mm_set1_pd(a); }
+static inline simd_t simd_add(simd_t a, simd_t b) { return _mm_add_pd(a, b); }
+static inline simd_t simd_sub(simd_t a, simd_t b) { return _mm_sub_pd(a, b); }
+static inline simd_t simd_mul(simd_t a, simd_t b) { return _mm_mul_pd(a, b); }
+static inline simd_t simd_min(simd_t a, simd_t b) { return _mm_min_pd(a, b); }
+static inline simd_t simd_max(simd_t a, simd_t b) { return _mm_max_pd(a, b); }
+static inline simd_t simd_greater(simd_t a, simd_t b) { return _mm_cmpgt_pd(a, b); }
+static inline simd_t simd_select(simd_t mask, simd_t a, simd_t b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+static inline simd_t simd_lane_index() { return _mm_setr_pd(0, 1); }
+#endif
+
+const char* InstructionSet() {
+#if defined(SIMD_AVX2)
+	return "AVX2";
+#elif defined(SIMD_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+//scale then rotate the vertexes: out = R * (S * v)
+void TransformVertexes(const physics_real* x, const physics_real* y, int count, double scaleX, double scaleY,
+	double cosRot, double sinRot, physics_real* outX, physics_real* outY) {
+	int i = 0;
+#ifdef SIMD_LANES
+	simd_t sx = simd_set(scaleX), sy = simd_set(scaleY);
+	simd_t c = simd_set(cosRot), s = simd_set(sinRot);
+	for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+		simd_t vx = simd_mul(simd_load(x + i), sx);
+		simd_t vy = simd_mul(simd_load(y + i), sy);
+		simd_store(outX + i, simd_sub(simd_mul(vx, c), simd_mul(vy, s)));
+		simd_store(outY + i, simd_add(simd_mul(vx, s), simd_mul(vy, c)));
+	}
+#endif
+	for (; i < count; i++) {
+		double vx = x[i] * scaleX;
+		double vy = y[i] * scaleY;
+		outX[i] = (physics_real)(vx * cosRot - vy * sinRot);
+		outY[i] = (physics_real)(vx * sinRot + vy * cosRot);
+	}
+}
+
+void TranslateVertexes(const physics_real* x, const physics_real* y, int count, double dx, double dy,
+	physics_real* outX, physics_real* outY) {
+	int i = 0;
+#ifdef SIMD_LANES
+	simd_t tx = simd_set(dx), ty = simd_set(dy);
+	for (; i + SIMD_LANES <= count; i += SIMD_LANES) {
+		simd_store(outX + i, simd_add(simd_load(x + i), tx));
+		simd_store(outY + i, simd_add(simd_load(y + i), ty));
+	}
+#endif
+	for (; i < count; i++) {
+		outX[i] = (physics_real)(x[i] + dx);
+		outY[i] = (physics_real)(y[i] + dy);
+	}
+}
+
+//smallest and biggest projection of the vertexes on the axis. count must be at least 1
+void ProjectMinMax(const physics_real* x, const physics_real* y, int count, double axisX, double axisY,
+	double& min, double& max) {
+	int i = 0;
+	double mn = INFINITY, mx = -INFINITY;
+#ifdef SIMD_LANES
+	if (count >= SIMD_LANES) {
+		simd_t ax = simd_set(axisX), ay = simd_set(axisY);
+		simd_t vmin = simd_add(simd_mul(simd_load(x), ax), simd_mul(simd_load(y), ay));
+		simd_t vmax = vmin;
+		for (i = SIMD_LANES; i < count; i += SIMD_LANES) {
+			int start = i + SIMD_LANES <= count ? i : count - SIMD_LANES;		//the last block overlaps the previous one
+			simd_t p = simd_add(simd_mul(simd_load(x + start), ax), simd_mul(simd_load(y + start), ay));
+			vmin = simd_min(vmin, p);
+			vmax = simd_max(vmax, p);
+		}
+		physics_real lanesMin[SIMD_LANES], lanesMax[SIMD_LANES];
+		simd_store(lanesMin, vmin);
+		simd_store(lanesMax, vmax);
+		for (int k = 0; k < SIMD_LANES; k++) {
+			mn = lanesMin[k] < mn ? lanesMin[k] : mn;
+			mx = lanesMax[k] > mx ? lanesMax[k] : mx;
+		}
+		i = count;
+	}
+#endif
+	for (; i < count; i++) {
+		double p = (physics_real)(x[i] * (physics_real)axisX + y[i] * (physics_real)axisY);
+		mn = p < mn ? p : mn;
+		mx = p > mx ? p : mx;
+	}
+	min = mn;
+	max = mx;
+}
+
+//index of the vertex farthest along the axis (the first one if many are at the same distance). count must be at least 1
+int SupportPoint(const physics_real* x, const physics_real* y, int count, double axisX, double axisY) {
+	int i = 0;
+	int best = 0;
+	double bestProjection = -INFINITY;
+#ifdef SIMD_LANES
+	if (count >= SIMD_LANES) {
+		//every lane keeps its best projection and the index of its vertex, the indexes are exact as floats too
+		simd_t ax = simd_set(axisX), ay = simd_set(axisY);
+		simd_t laneIndex = simd_lane_index();
+		simd_t vbest = simd_add(simd_mul(simd_load(x), ax), simd_mul(simd_load(y), ay));
+		simd_t vindex = laneIndex;
+		for (i = SIMD_LANES; i < count; i += SIMD_LANES) {
+			int start = i + SIMD_LANES <= count ? i : count - SIMD_LANES;
+			simd_t p = simd_add(simd_mul(simd_load(x + start), ax), simd_mul(simd_load(y + start), ay));
+			simd_t greater = simd_greater(p, vbest);
+			vbest = simd_select(greater, p, vbest);
+			vindex = simd_select(greater, simd_add(laneIndex, simd_set(start)), vindex);
+		}
+		physics_real lanesBest[SIMD_LANES], lanesIndex[SIMD_LANES];
+		simd_store(lanesBest, vbest);
+		simd_store(lanesIndex, vindex);
+		for (int k = 0; k < SIMD_LANES; k++) {
+			int index = (int)lanesIndex[k];
+			if (lanesBest[k] > bestProjection || (lanesBest[k] == bestProjection && index < best)) {
+				bestProjection = lanesBest[k];
+				best = index;
+			}
+		}
+		i = count;
+	}
+#endif
+	for (; i < count; i++) {
+		double p = (physics_real)(x[i] * (physics_real)axisX + y[i] * (physics_real)axisY);
+		if (p > bestProjection) {
+			bestProjection = p;
+			best = i;
+		}
+	}
+	return best;
+}
+
+//squared distance of the farthest vertex from the origin
+double MaxLengthSquared(const physics_real* x, const physics_real* y, int count) {
+	int i = 0;
+	double mx = 0;
+#ifdef SIMD_LANES
+	if (count >= SIMD_LANES) {
+		simd_t vmax = simd_set(0);
+		for (; i < count; i += SIMD_LANES) {
+			int start = i + SIMD_LANES <= count ? i : count - SIMD_LANES;
+			simd_t vx = simd_load(x + start), vy = simd_load(y + start);
+			vmax = simd_max(vmax, simd_add(simd_mul(vx, vx), simd_mul(vy, vy)));
+		}
+		physics_real lanes[SIMD_LANES];
+		simd_store(lanes, vmax);
+		for (int k = 0; k < SIMD_LANES; k++) {
+			mx = lanes[k] > mx ? lanes[k] : mx;
+		}
+		i = count;
+	}
+#endif
+	for (; i < count; i++) {
+		double l = (double)x[i] * x[i] + (double)y[i] * y[i];
+		mx = l > mx ? l : mx;
+	}
+	return mx;
+}
+
+}
+
+#endif
@@ -2,6 +2,8 @@
 #define PHYSICS_STRUCTS_H
 
 #include "structures.h"
+#include "smallVector.h"
+#include "physics_simd.h"
 
 #include <vector>
 #include <memory>
@@ -20,6 +22,20 @@ struct BoundingBox {
 	double radius;
 };
 
+//two bodies whose bounding boxes overlap
+typedef struct broadphasePair {
+	Rigidbody* A;
+	Rigidbody* B;
+}BroadphasePair;
+
+//result of PhysicsEngine::Raycast()
+typedef struct raycastHit {
+	Rigidbody* body;
+	vector2 point;
+	vector2 normal;		//normal of the side of the body that was hit
+	double distance;	//from the origin of the ray
+}RaycastHit;
+
 struct Collision {
 	Rigidbody* collider;
 	vector2 contact;
@@ -44,6 +60,7 @@ struct ResultCollision {
 	double impulse;
 	bool frameCollision;
 	bool firstCollision;
+	int sleepingIsland;		//the collider sleeps in this island: the collision is kept without callbacks. -1 if awake
 };
 
 struct CollisionStruct {
@@ -106,17 +123,47 @@ struct FMesh {
 
 		return Projection{ min, max };
 	}
-	std::shared_ptr<std::vector <vector2>> getAxes(void) {
-		std::vector <vector2>* a = new std::vector <vector2>;
-		auto& axis = *a;
+};
 
-		for (int a = 0; a < v.size(); a++) {
-			int b = (a + 1) % v.size();		//second vertex of the side
-			//calculate the axis of projection which is the normal of the side
-			vector2 axisOfProj = { -(v[a].y - v[b].y), v[a].x - v[b].x };
-			axis.push_back(axisOfProj.normalize());
-		}
-		return std::shared_ptr<std::vector <vector2>>(a);
+//vertexes of a polygon as structure of arrays, for the kernels of physics_simd.h. Up to 32 vertexes live inside the struct
+struct VertexArray {
+	SmallVector <physics_real, 32> x;
+	SmallVector <physics_real, 32> y;
+	int size() const {
+		return x.size();
+	}
+	void resize(int count) {
+		x.resize(count);
+		y.resize(count);
+	}
+	vector2 get(int i) const {
+		return { (double)x[i], (double)y[i] };
+	}
+	void set(int i, vector2 v) {
+		x[i] = (physics_real)v.x;
+		y[i] = (physics_real)v.y;
+	}
+};
+
+//polygon of a body used by the narrowphase, relative to an origin chosen for the pair of bodies.
+//The memory is reused by the next polygon
+struct ContactMesh {
+	VertexArray v;
+	vector2 centerOfMass;
+	void translate(vector2 v2) {
+		SimdTranslateVertexes(v.x.data(), v.y.data(), v.size(), v2.x, v2.y, v.x.data(), v.y.data());
+		centerOfMass = { centerOfMass.x + v2.x, centerOfMass.y + v2.y };
+	}
+	Projection project(vector2 axis) {
+		Projection p;
+		SimdProjectMinMax(v.x.data(), v.y.data(), v.size(), axis.x, axis.y, p.min, p.max);
+		return p;
+	}
+	//normalized normal of the side that starts from vertex a
+	vector2 axis(int a) {
+		int b = (a + 1) % v.size();		//second vertex of the side
+		vector2 axisOfProj = { -(v.y[a] - v.y[b]), v.x[a] - v.x[b] };
+		return axisOfProj.normalize();
 	}
 };
 
@@ -4,6 +4,51 @@
 #define NVIDIA_GRAPHICS_CARD
 //#define AMD_GRAPHICS_CARD
 
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+//physical core and the logical cpus (SMT siblings) that share it
+typedef struct cpuCore {
+    int package;                //socket
+    int cacheDomain;            //cores with the same cacheDomain share the last level cache
+    std::vector <int> cpus;     //logical cpus usable by the process, ids as used by PinCurrentThread()
+}CpuCore;
+
+typedef struct cpuTopology {
+    std::vector <CpuCore> cores;    //sorted by package, cache domain and first cpu
+    int logicalCount;
+    int packages;
+    int cacheDomains;
+}CpuTopology;
+
 unsigned int GetCoresCount();
 
+//read the cores the process can run on. Returns false if the topology is not available:
+//topology then has one core for every logical cpu the process can run on, all in the same package
+bool GetCpuTopology(CpuTopology& topology);
+//restrict the calling thread to the logical cpus
+bool PinCurrentThread(const std::vector <int>& cpus);
+
+//block the thread while *address == value. Can return early, so the caller must check the value again
+void WaitOnValue(std::atomic <uint32_t>* address, uint32_t value);
+//wake the threads blocked in WaitOnValue() on the address
+void WakeOnValue(std::atomic <uint32_t>* address, bool all);
+
+//true if the cpu and the operating system support the AVX2 and FMA instructions
+bool CpuSupportsAvx2();
+
+//hint to the cpu that the thread is in a spin loop
+inline void CpuRelax() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 #endif	//platform_h
@@ -0,0 +1,94 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+//Frame profiler. The markers record the duration of a scope in a ring buffer owned by the thread,
+//so recording never takes a lock. The oldest events are overwritten when a buffer is full.
+//Recording is off by default and can be toggled at runtime. The events can be exported in the Chrome trace_event
+//format (open it with chrome://tracing or https://ui.perfetto.dev).
+//The markers are compiled only when FIREFLY_PROFILER is defined (cmake option FIREFLY_PROFILER, off by default)
+class Profiler {
+	struct Event {
+		std::atomic <const char*> name;		//must be a string literal
+		std::atomic <int64_t> start;		//nanoseconds from the start of the profiler
+		std::atomic <int64_t> end;
+	};
+
+	struct ThreadBuffer {
+		Event events[16384];
+		alignas(64) std::atomic <uint64_t> head;		//number of events written
+		std::atomic <uint64_t> clearMark;			//events before it were cleared
+		int id;
+		char name[32];
+	};
+public:
+	static Profiler& getInstance() {
+		static Profiler instance;
+		return instance;
+	}
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	void SetEnabled(bool enable);
+	bool IsEnabled() {
+		return _enabled.load(std::memory_order_relaxed);
+	}
+	void SetThreadName(const char* name);
+	void Clear();
+	bool ExportChromeTrace(const std::string& path);
+
+	int64_t Now();
+	void Record(const char* name, int64_t start, int64_t end);
+
+private:
+	Profiler();
+	~Profiler();
+
+	ThreadBuffer* GetThreadBuffer();
+
+	static const int MAX_THREADS = 128;
+	static const int BUFFER_SIZE = 16384;
+	static thread_local ThreadBuffer* _threadBuffer;
+
+	std::atomic <bool> _enabled;
+	ThreadBuffer* _buffers[MAX_THREADS];
+	std::atomic <int> _bufferCount;
+	std::mutex register_mutex;
+	int64_t _startTime;
+};
+
+//records the time from its construction to its destruction
+class ProfileScope {
+public:
+	ProfileScope(const char* name) {
+		_name = name;
+		_start = Profiler::getInstance().IsEnabled() ? Profiler::getInstance().Now() : -1;
+	}
+	~ProfileScope() {
+		if (_start >= 0) {
+			Profiler::getInstance().Record(_name, _start, Profiler::getInstance().Now());
+		}
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+	const char* _name;
+	int64_t _start;
+};
+
+#ifdef FIREFLY_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) Profiler::getInstance().SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_THREAD_NAME(name)
+#endif
+
+#endif
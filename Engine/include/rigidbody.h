@@ -11,16 +11,19 @@
 
 
 class GameObject;
+class StaticWorld;
 
 class Rigidbody {
 
 public:
 	Rigidbody(GameObject *parent, std::vector <vector2>& vertexes);
+	Rigidbody(GameObject *parent, StaticWorld* world);
 	~Rigidbody();
 	void AddForce(vector2 forceVector);
 	void AddExplosionForce(vector2 position, double force);
 	void SetBoundingBox(BoundingBoxType type);
 	bool GetBoundingBox(BoundingBox &b);
+	void GetAABB(AABB& box);
 	GameObject* getParentObject();
 	void getMesh(FMesh &vertexes);
 	double getMOI();
@@ -30,17 +33,34 @@ public:
 	void SetStatic(bool isStatic);
 	bool IsStatic();
 	bool IsMovable();
+	void WakeUp();
+	bool IsSleeping();
 
 	//internal call. Don't use them
 	void _updateTransform();
+	const VertexArray& _getLocalVertexes();
+	void _getContactMesh(ContactMesh& mesh, vector2 origin);
+	vector2 _getCenter();
+	bool _isCircle();
+	double _getRadius();
+	StaticWorld* _getStaticWorld();
 	void _startCollisionFrame(double timeElapsed, vector2 gravity);
 	void _endCollisionFrame();
 	void _updatePhysics(double timeElapsed, double sleepVelocity);
-	void _resolveCollisions(double timeElapsed);
 	void _resolveDrag(double timeElapsed);
-	void _applyForces(double timeElapsed);
 	void _setCollisions(Rigidbody* body, vector2 contactPoint, vector2 collisionNormal,
 		vector2 velocity, double impulse, vector2 updatedPosition);
+	void _addCollisionImpulse(Rigidbody* body, double impulse);
+	bool _shouldWake();
+	void _sleep(int island, std::vector <Rigidbody*>& touching);
+	void _wake();
+	int _getIsland();
+	void _setIslandIndex(int index);
+	int _getIslandIndex();
+	void _setSleepingCollider(Rigidbody* body, int island);
+	void _clearSleepingColliders(int island);
+	void _removeColliders(const std::vector <Rigidbody*>& removed);
+	double _getSleepTime();
 	
 	Double mass;
 	Double staticFriction;
@@ -51,28 +71,45 @@ public:
 	UInt constraints;
 	Bool useGravity;
 	Bool isTrigger;
+	Bool isBullet;		//fast body: its motion is swept, so it doesn't pass through the thin bodies
 	Bool detectCollisions;
 	UInt groupMask;
 private:
 	
+	void _init(GameObject* parent, std::vector <vector2>& vertexes);
 	void _findMeshArea();
+	void _updateLocalBox();
+	void _updateWorldBox();
 	
 	GameObject* parentObject;
 	//vector2 frameVelocity;
 	//double frameAngularVelocity;
 	BoundingBox* boundingBox;
-	FMesh _mesh;
+	StaticWorld* _staticWorld;		//static collision geometry of the level, nullptr for the other bodies
+	VertexArray _baseVertexes;		//vertexes at scale 1 and rotation _baseRot
+	VertexArray _vertexes;		//vertexes at the scale and rotation of the last transform update
 	FMesh _world_mesh;
 	vector2 centerOfMass;
+	AABB _localBox;		//box of _mesh
+	AABB _aabb;		//box in world coordinates at the last transform update
 	vector2 meshScale;
 	vector2 frameForce;
+	vector2 _pendingForce;		//added by AddForce(), used from the next physics frame
+	vector2 _sleepPosition;
+	double _sleepRotation;
+	double _sleepTime;		//time spent below the sleep velocity
+	int _island;		//sleeping island of the body, -1 when awake
+	int _islandIndex;		//position in the awake bodies of the physics frame
+	std::atomic <bool> _sleeping;
+	std::atomic <bool> _wakeRequest;
 	double meshRot;
+	double _baseRot;
 	double area, density;
 	double momentOfInertia;
 	bool isStatic;
 	bool transformChanged;
 	bool _meshUpdated;
-	std::mutex _meshMutex, _collisionMutex, _moiMutex;
+	std::mutex _meshMutex, _collisionMutex, _moiMutex, _forceMutex;
 	std::vector <ResultCollision> _prevCollision;
 };
 
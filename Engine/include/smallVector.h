@@ -0,0 +1,86 @@
+#ifndef SMALL_VECTOR_H
+#define SMALL_VECTOR_H
+
+#include <type_traits>
+#include <string.h>
+
+//Vector of trivially copyable items that keeps the first N items inside the object and goes to the heap only after.
+//clear() keeps the memory, so a vector reused for items of the same size doesn't allocate again.
+//Used as scratch memory of the hot loops (see the narrowphase of the physics engine)
+template <typename T, int N>
+class SmallVector {
+	static_assert(std::is_trivially_copyable<T>::value, "SmallVector items are copied with memcpy");
+public:
+	SmallVector() : _data(_fixed), _size(0), _capacity(N) {}
+	SmallVector(const SmallVector&) = delete;
+	SmallVector& operator=(const SmallVector&) = delete;
+
+	~SmallVector() {
+		if (_data != _fixed) {
+			delete[] _data;
+		}
+	}
+
+	void push_back(const T& item) {
+		if (_size == _capacity) {
+			reserve(_capacity * 2);
+		}
+		_data[_size++] = item;
+	}
+
+	//the items after the old size are not initialized
+	void resize(int size) {
+		reserve(size);
+		_size = size;
+	}
+
+	void reserve(int capacity) {
+		if (capacity <= _capacity) {
+			return;
+		}
+		T* data = new T[capacity];
+		memcpy(data, _data, sizeof(T) * _size);
+		if (_data != _fixed) {
+			delete[] _data;
+		}
+		_data = data;
+		_capacity = capacity;
+	}
+
+	void clear() {
+		_size = 0;
+	}
+
+	int size() const {
+		return _size;
+	}
+	bool empty() const {
+		return _size == 0;
+	}
+	T& operator[](int index) {
+		return _data[index];
+	}
+	const T& operator[](int index) const {
+		return _data[index];
+	}
+	T* data() {
+		return _data;
+	}
+	const T* data() const {
+		return _data;
+	}
+	T* begin() {
+		return _data;
+	}
+	T* end() {
+		return _data + _size;
+	}
+
+private:
+	T _fixed[N];
+	T* _data;
+	int _size;
+	int _capacity;
+};
+
+#endif
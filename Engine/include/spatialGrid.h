@@ -0,0 +1,62 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include "structures.h"
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+class GameObject;
+
+//flags of the objects stored in the grid
+#define GRID_LIGHT_OBJECT 0x1
+
+//Uniform grid of square zones used to find the objects near a point (e.g. the camera).
+//A zone is identified by 16 bits for the x coordinate and 16 bits for the y coordinate.
+//Objects are stored in the zone that contains their center. Objects bigger than a zone are kept in a separate list
+//that is checked by every query. An object changes zone only when its center crosses the zone border.
+//Objects are identified by the slot index of their handle.
+//The grid is not thread safe: the game engine protects it with the lock of the object registry
+class SpatialGrid {
+	struct Entry {
+		GameObject* obj;
+		vector2 position;
+		double radius;
+		uint32_t zone;			//zone the object is stored in
+		uint32_t zoneIndex;		//index inside the zone (or the oversized list)
+		uint8_t flags;
+		bool inGrid;
+		bool oversized;
+	};
+public:
+	SpatialGrid(double zoneSize);
+
+	uint32_t PosToZone(vector2 pos);
+	static int ZoneDistance(uint32_t zone1, uint32_t zone2);
+	double GetZoneSize();
+
+	void Insert(uint32_t id, GameObject* obj, vector2 position, double radius, uint8_t flags);
+	void Remove(uint32_t id);
+	bool Update(uint32_t id, vector2 position, double radius);
+	void Move(uint32_t id);
+	void Clear();
+
+	void Query(AABB rect, std::vector <GameObject*>& out, uint8_t flags = 0);
+	uint8_t GetFlags(uint32_t id);
+	size_t Size();
+private:
+	void AddToZone(uint32_t id);
+	void RemoveFromZone(uint32_t id);
+	bool IsOversized(double radius);
+	int ZoneCoord(double coord);
+	bool Overlaps(Entry& e, AABB& rect);
+
+	double _zoneSize;
+	std::vector <Entry> _entries;
+	std::unordered_map <uint32_t, std::vector <uint32_t>> _zones;
+	std::vector <uint32_t> _oversized;
+	size_t _count;
+};
+
+#endif
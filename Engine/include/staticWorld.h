@@ -0,0 +1,196 @@
+#ifndef STATIC_WORLD_H
+#define STATIC_WORLD_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "structures.h"
+#include "physics_structs.h"
+
+//Static collision geometry of a level, baked once when the scene is loaded: convex polygons, edges (chains of segments)
+//and the solid tiles of a grid merged in rectangles. After Build() the shapes are in an immutable bounding volume hierarchy
+//and never change: their vertexes are stored once in world coordinates, they are never moved or transformed again.
+//The world is given to the physics engine as a single static rigidbody (see GameObject::AttachStaticWorld()):
+//the broadphase pairs every body with it once and the narrowphase finds the shapes near the body in the tree,
+//instead of pairing the bodies with thousands of static bodies.
+//The edges have no inside and collide on both sides; a body that goes more than half through one comes out of the other side.
+//The queries only read the tree and can run on many threads at the same time
+class StaticWorld {
+public:
+	struct Shape {
+		AABB box;
+		vector2 center;		//the vertexes are relative to it
+		int first;		//first vertex in the vertex arrays
+		int count;		//2 for an edge
+	};
+
+	StaticWorld();
+
+	void AddPolygon(const std::vector <vector2>& vertexes);
+	void AddEdge(vector2 a, vector2 b);
+	void AddChain(const std::vector <vector2>& points, bool loop);
+	void AddTiles(const std::vector <uint8_t>& tiles, int columns, int rows, vector2 origin, double tileSize);
+	void Build();
+
+	bool IsBuilt() const;
+	int GetShapeCount() const;
+	int GetHeight() const;
+	AABB GetBounds() const;
+	const Shape& GetShape(int shape) const;
+	void GetVertexes(int shape, VertexArray& v) const;
+	void GetContactMesh(int shape, ContactMesh& mesh, vector2 origin) const;
+
+	//callback(int shape) for every shape whose box overlaps box. The visit stops when the callback returns false
+	template <typename Callback>
+	void Query(const AABB& box, Callback& callback) const {
+		if (_nodes.size() == 0) {
+			return;
+		}
+		int stack[MAX_DEPTH];
+		int count = 0;
+		stack[count++] = 0;
+		while (count > 0) {
+			const TreeNode& node = _nodes[stack[--count]];
+			if (!node.box.overlaps(box)) {
+				continue;
+			}
+			if (node.count > 0) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					if (_shapes[i].box.overlaps(box) && !callback(i)) {
+						return;
+					}
+				}
+			}
+			else {
+				stack[count++] = node.second;
+				stack[count++] = node.first;
+			}
+		}
+	}
+
+	//callback(int shape, double maxFraction) for every shape whose box is crossed by the segment p1 + d * t, t up to maxFraction.
+	//The callback returns the new maxFraction, like in DynamicTree::RayCast()
+	template <typename Callback>
+	void RayCast(vector2 p1, vector2 d, double maxFraction, Callback& callback) const {
+		if (_nodes.size() == 0 || (d.x == 0 && d.y == 0)) {
+			return;
+		}
+		int stack[MAX_DEPTH];
+		int count = 0;
+		stack[count++] = 0;
+		while (count > 0) {
+			const TreeNode& node = _nodes[stack[--count]];
+			if (!segmentOverlaps(node.box, p1, d, maxFraction)) {
+				continue;
+			}
+			if (node.count == 0) {
+				stack[count++] = node.second;
+				stack[count++] = node.first;
+				continue;
+			}
+			for (int i = node.first; i < node.first + node.count; i++) {
+				if (!segmentOverlaps(_shapes[i].box, p1, d, maxFraction)) {
+					continue;
+				}
+				double fraction = callback(i, maxFraction);
+				if (fraction <= 0) {
+					return;
+				}
+				maxFraction = std::min(maxFraction, fraction);
+			}
+		}
+	}
+
+	//callback(int shape, double maxDistance) for the shapes whose box is closer than maxDistance to point,
+	//the closest nodes first. The callback returns the new maxDistance
+	template <typename Callback>
+	void QueryNearest(vector2 point, double maxDistance, Callback& callback) const {
+		if (_nodes.size() == 0) {
+			return;
+		}
+		int stack[MAX_DEPTH];
+		int count = 0;
+		stack[count++] = 0;
+		while (count > 0) {
+			const TreeNode& node = _nodes[stack[--count]];
+			if (boxDistance(node.box, point) > maxDistance) {
+				continue;
+			}
+			if (node.count > 0) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					if (boxDistance(_shapes[i].box, point) <= maxDistance) {
+						maxDistance = std::min(maxDistance, callback(i, maxDistance));
+					}
+				}
+				continue;
+			}
+			//visit the closer child first, so the far one is likely pruned
+			if (boxDistance(_nodes[node.first].box, point) < boxDistance(_nodes[node.second].box, point)) {
+				stack[count++] = node.second;
+				stack[count++] = node.first;
+			}
+			else {
+				stack[count++] = node.first;
+				stack[count++] = node.second;
+			}
+		}
+	}
+
+private:
+	//the nodes are stored depth first: the first child of an inner node is the next node
+	struct TreeNode {
+		AABB box;
+		int first;		//first shape of a leaf, first child of an inner node
+		int second;		//second child of an inner node
+		int count;		//shapes of a leaf, 0 for an inner node
+	};
+
+	void addShape(const vector2* vertexes, int count);
+	int buildNode(int first, int count, int depth);
+
+	static const int LEAF_SHAPES = 4;
+	static const int MAX_DEPTH = 64;		//the median split keeps the tree balanced: far more than needed
+
+	static AABB combine(const AABB& a, const AABB& b) {
+		return { { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y) }, { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y) } };
+	}
+	static double boxDistance(const AABB& box, vector2 p) {
+		double dx = std::max(0.0, std::max(box.min.x - p.x, p.x - box.max.x));
+		double dy = std::max(0.0, std::max(box.min.y - p.y, p.y - box.max.y));
+		return sqrt(dx * dx + dy * dy);
+	}
+	//slab test of the segment p1 + d * t, t in [0, maxFraction], against the box
+	static bool segmentOverlaps(const AABB& box, vector2 p1, vector2 d, double maxFraction) {
+		double lower = 0, upper = maxFraction;
+		double p[2] = { p1.x, p1.y };
+		double dir[2] = { d.x, d.y };
+		double min[2] = { box.min.x, box.min.y };
+		double max[2] = { box.max.x, box.max.y };
+		for (int axis = 0; axis < 2; axis++) {
+			if (dir[axis] == 0) {
+				if (p[axis] < min[axis] || p[axis] > max[axis]) {
+					return false;
+				}
+				continue;
+			}
+			double t1 = (min[axis] - p[axis]) / dir[axis];
+			double t2 = (max[axis] - p[axis]) / dir[axis];
+			lower = std::max(lower, std::min(t1, t2));
+			upper = std::min(upper, std::max(t1, t2));
+			if (lower > upper) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector <Shape> _shapes;		//in the order of the leaves after Build()
+	std::vector <physics_real> _x, _y;		//vertexes of all the shapes
+	std::vector <TreeNode> _nodes;
+	AABB _bounds;
+	int _height;
+	bool _built;
+};
+
+#endif
@@ -60,6 +60,15 @@ typedef struct vector2 {
 	};
 };*/
 
+//axis aligned rectangle
+struct AABB {
+	vector2 min;
+	vector2 max;
+	bool overlaps(const AABB& b) const {		//touching rectangles overlap
+		return min.x <= b.max.x && b.min.x <= max.x && min.y <= b.max.y && b.min.y <= max.y;
+	}
+};
+
 struct TransformStruct {
 	vector2 position;
 	vector2 scale;
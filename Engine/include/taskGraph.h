@@ -0,0 +1,90 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+class MultithreadManager;
+
+//timing of a task in a frame. Times are in seconds from the start of the frame
+typedef struct taskTiming {
+	const char* name;
+	double start;
+	double duration;
+}TaskTiming;
+
+//duration of the tasks with the same name accumulated over many runs. Times are in seconds
+typedef struct taskStats {
+	const char* name;
+	unsigned long long runs;
+	double totalTime;
+	double maxTime;
+}TaskStats;
+
+//Graph of the jobs of a frame. A task starts as soon as all the tasks it depends on are completed,
+//so independent phases overlap instead of waiting for each other.
+//A task runs fn(start, end, args) over the range [0, count), split in chunks between the game thread and the helpers.
+//The chunks get smaller as the task gets near the end, so an expensive object at the end doesn't leave the others waiting.
+//Tasks marked as game thread only are run by the thread that calls Run() (scene callbacks, requests, gui).
+//The graph is built again every frame: Clear() keeps the allocated tasks for reuse.
+//A task can start a parallel loop with RunNested(): the loop becomes a new task of the running graph (see parallel.h)
+class TaskGraph {
+	typedef void (*TaskFunction)(int start_index, int end_index, void* args);
+
+	struct Task {
+		const char* name;
+		TaskFunction fn;
+		void* args;
+		int count;
+		bool gameThreadOnly;
+		bool waited;		//a thread is waiting for the task in RunNested()
+		std::vector <int> successors;
+		std::vector <int> predecessors;
+
+		int dependencies;		//tasks not completed yet this task depends on
+		int next;			//first item not taken yet
+		int itemsLeft;		//items not completed yet
+		std::chrono::high_resolution_clock::time_point startTime;
+		std::chrono::high_resolution_clock::time_point endTime;
+		bool started;
+	};
+public:
+	TaskGraph();
+	~TaskGraph();
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	void Clear();
+	int AddTask(const char* name, TaskFunction fn, void* args, int count, bool gameThreadOnly = false);
+	void AddDependency(int task, int dependsOn);
+	void SetTaskCount(int task, int count);
+
+	void Run(MultithreadManager* helpers, int helperCount);
+	static bool RunNested(const char* name, TaskFunction fn, void* args, int count);
+	void GetCriticalPath(std::vector <TaskTiming>& path, std::chrono::high_resolution_clock::time_point frameStart);
+	void AddTaskStats(std::vector <TaskStats>& stats);
+
+private:
+	static void helper_routine(int worker, int unused, void* args);
+	void WorkerLoop(bool gameThread, int worker);
+	void MakeReady(int task);
+	void CompleteTask(int task);
+
+	//allocated tasks. Only the first _taskCount are in use. RunNested() adds tasks while the graph runs:
+	//during Run() the vector is read only with the lock
+	std::vector <Task*> _tasks;
+	int _taskCount;
+	int _workers;
+	int _remaining;		//tasks not completed yet
+	MultithreadManager* _helpers;
+
+	std::vector <int> _ready;			//tasks with chunks left that any thread can run
+	std::vector <int> _readyGameThread;	//tasks that only the game thread can run
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::chrono::high_resolution_clock::time_point _runStart;
+};
+
+#endif
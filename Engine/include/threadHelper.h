@@ -3,35 +3,22 @@
 
 #include <thread>
 #include <vector>
-#include <mutex>
-#include <condition_variable>
+#include <stdint.h>
 
 class MultithreadManager;
 
 class ThreadHelper {
 public:
-	ThreadHelper(MultithreadManager*, int helperID);
-	void startWork(int begin, int end, void(*function)(int start_index, int end_index, void* args), void* args);
-	bool workDone();
+	ThreadHelper(MultithreadManager*, int helperID, uint32_t generation, int cpu = -1);
 	void killThread();
 
 private:
 	std::thread thr;
 	void workThread();
-	void (*jobFunction)(int start_index, int end_index, void *args);
-
-	std::mutex thrMutex;
-	std::condition_variable workCv;
-	bool _waitVariable;
-
-	int startIndex;
-	int endIndex;
-	void* arguments;
-	bool _workDone;
-	bool _killThread;
-	bool _threadIsAlive;
 
+	uint32_t _generation;		//last job of the pool seen by the thread
 	int helperID;
+	int _cpu;		//logical cpu the thread is pinned to, -1 for any
 
 	MultithreadManager* boss;
 };
@@ -0,0 +1,116 @@
+#include "allocationCounter.h"
+
+#include <new>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#ifdef FIREFLY_ALLOCATION_COUNTER
+
+static thread_local uint64_t _threadAllocations = 0;
+
+static void* alignedAlloc(std::size_t size, std::size_t alignment) {
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+static void alignedFree(void* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void* operator new(std::size_t size) {
+	_threadAllocations++;
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	_threadAllocations++;
+	return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	free(p);
+}
+
+//types aligned to more than the default (alignas(64) counters of the threads)
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	_threadAllocations++;
+	void* p = alignedAlloc(size == 0 ? 1 : size, (std::size_t)alignment);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+	alignedFree(p);
+}
+
+bool AllocationCounter::IsEnabled() {
+	return true;
+}
+
+//allocations made by the calling thread since it started
+uint64_t AllocationCounter::GetThreadAllocations() {
+	return _threadAllocations;
+}
+
+#else
+
+bool AllocationCounter::IsEnabled() {
+	return false;
+}
+
+uint64_t AllocationCounter::GetThreadAllocations() {
+	return 0;
+}
+
+#endif
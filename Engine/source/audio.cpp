@@ -15,16 +15,19 @@
 namespace fs = std::filesystem;
 
 AudioEngine::AudioEngine() {
-	
+	_headless = false;
 }
 
 AudioEngine::~AudioEngine() {
+	if (_headless)
+		return;
 	Mix_CloseAudio();
 	Mix_Quit();
 }
 
-void AudioEngine::Init(AudioOptions& options) {
+void AudioEngine::Init(AudioOptions& options, bool headless) {
 	_channelsToAllocate = 0;
+	_headless = headless;
 
 	_defaultMusicVolume = options.defaultMusicVol;
 	_defaultTrackVolume = options.defaultTrackVol;
@@ -39,6 +42,20 @@ void AudioEngine::Init(AudioOptions& options) {
 	_channelMaster = new EntityName[_channelsToAllocate];
 	memset(_channelMaster, 0, sizeof(EntityName)*_channelsToAllocate);
 
+	_musicVolume = _defaultMusicVolume;
+	_audioGroupChRange = new std::pair <uint16_t, uint16_t>[_audioGroupChannels.size()];
+	_audioGroupVolume = new std::atomic<int>[_audioGroupChannels.size()];
+	int current_ch = 0;
+	for (int i = 0; i < _audioGroupChannels.size(); i++) {
+		_audioGroupChRange[i] = (std::pair<uint16_t, uint16_t>(current_ch, current_ch + _audioGroupChannels[i] - 1));
+		current_ch += _audioGroupChannels[i];
+		_audioGroupVolume[i] = _defaultTrackVolume;
+	}
+
+	if (_headless) {		//no audio device and no sound files
+		return;
+	}
+
 	Mix_Init(MIX_INIT_MP3);
 
 	if (Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT, 2, 1024) == -1)		//22050 / 44100
@@ -46,17 +63,10 @@ void AudioEngine::Init(AudioOptions& options) {
 
 	Mix_AllocateChannels(_channelsToAllocate);
 	Mix_VolumeMusic(_defaultMusicVolume);
-	_musicVolume = _defaultMusicVolume;
 
-	_audioGroupChRange = new std::pair <uint16_t, uint16_t>[_audioGroupChannels.size()];
-	_audioGroupVolume = new std::atomic<int>[_audioGroupChannels.size()];
 	//set groups channels
-	int current_ch = 0;
 	for (int i = 0; i < _audioGroupChannels.size(); i++) {
-		_audioGroupChRange[i] = (std::pair<uint16_t, uint16_t>(current_ch, current_ch + _audioGroupChannels[i] - 1));
-		Mix_GroupChannels(current_ch, current_ch + _audioGroupChannels[i] - 1, i);
-		current_ch += _audioGroupChannels[i];
-		_audioGroupVolume[i] = _defaultTrackVolume;
+		Mix_GroupChannels(_audioGroupChRange[i].first, _audioGroupChRange[i].second, i);
 	}
 
 	for (int i = 0; i < _channelsToAllocate; i++) {
@@ -137,6 +147,14 @@ void AudioEngine::loadSoundFileInFolder(std::string directory) {
 void AudioEngine::PollRequests() {
 	std::lock_guard <std::mutex> guard(request_mutex);
 
+	if (_headless) {		//drop the requests
+		for (auto it = _requests.begin(); it != _requests.end(); it++) {
+			delete *it;
+		}
+		_requests.clear();
+		return;
+	}
+
 	playing_music = Mix_PlayingMusic();
 
 	//add the rescheduled requests
@@ -296,7 +314,7 @@ void AudioEngine::PlayTrack(EntityName trackName,
 	uint16_t audioGroup, double maxDistance = 0, vector2 source_position = {0, 0},
 	bool spatial_sound = false, EntityName audioSrcName = 0) {
 	
-	if (trackName == 0 || audioGroup >= _audioGroupChannels.size())
+	if (trackName == 0 || audioGroup >= _audioGroupChannels.size() || _headless)
 		return;
 
 	AudioPlayData *data = new AudioPlayData();
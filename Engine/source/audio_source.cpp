@@ -16,6 +16,7 @@ AudioSource::AudioSource(EntityName audioSrcName, std::string trackName, uint16_
 	GameEngine::getInstance().RegisterGameObject(this, audioSrcName);
 	_playTimer = 0;
 	_updateTimer = 0;
+	_audible = true;
 }
 
 AudioSource::~AudioSource() {
@@ -89,8 +90,13 @@ void AudioSource::update(double timeElapsed) {
 			_status = AudioStatus::AUDIO_STATUS_FINISHED;
 			_playTimer = 0;
 		}
-		if(_spatial_sound)
-			AudioEngine::getInstance().updateAudioSource(getObjectName(), _channel, transform.position, _maxDistance, _audioGroup);
+		if (_spatial_sound) {
+			//skip the sources far from the camera. One last update is sent to mute the source when it gets out of range
+			bool audible = GameEngine::getInstance().IsNearCamera(transform.position, _maxDistance);
+			if (audible || _audible)
+				AudioEngine::getInstance().updateAudioSource(getObjectName(), _channel, transform.position, _maxDistance, _audioGroup);
+			_audible = audible;
+		}
 		_updateTimer = 0;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "broadphase.h"
+#include "rigidbody.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+SweepAndPrune::SweepAndPrune() {
+	_rebuild = false;
+}
+
+//the body gets its endpoints in the next Update()
+void SweepAndPrune::AddBody(Rigidbody* body) {
+	if (_proxyOf.count(body) > 0) {
+		return;
+	}
+	uint32_t id;
+	if (_freeProxies.size() > 0) {
+		id = _freeProxies.back();
+		_freeProxies.pop_back();
+	}
+	else {
+		id = _proxies.size();
+		_proxies.push_back({});
+	}
+	_proxies[id].body = body;
+	_proxies[id].activeIndex = -1;
+	_proxyOf[body] = id;
+	_pendingProxies.push_back(id);
+}
+
+//the body is never dereferenced again, it could be already deleted. Its pairs are dropped without being reported
+void SweepAndPrune::RemoveBody(Rigidbody* body) {
+	auto it = _proxyOf.find(body);
+	if (it == _proxyOf.end()) {
+		return;
+	}
+	_proxies[it->second].body = nullptr;
+	_removedProxies.push_back(it->second);
+	_proxyOf.erase(it);
+}
+
+//rebuild the lists in the next Update(). Used when a body changes between static and non static
+void SweepAndPrune::Invalidate() {
+	_rebuild = true;
+}
+
+//update the boxes of the bodies and the overlapping pairs. The boxes of the sleeping bodies don't change
+void SweepAndPrune::Update() {
+	purgeRemoved();
+	for (int i = 0; i < _proxies.size(); i++) {
+		if (_proxies[i].body == nullptr) {
+			continue;
+		}
+		if (!_proxies[i].body->IsSleeping()) {
+			_proxies[i].body->GetAABB(_proxies[i].box);
+		}
+		_proxies[i].isStatic = _proxies[i].body->IsStatic();
+	}
+
+	_addedPairs.clear();
+	_removedPairs.clear();
+	insertPending();
+	if (_rebuild) {
+		rebuild();
+		_rebuild = false;
+		return;
+	}
+	sortAxis(0);
+	sortAxis(1);
+}
+
+//all the pairs of bodies whose boxes overlap. The first body is never static
+const std::vector <BroadphasePair>& SweepAndPrune::GetPairs() {
+	return _pairs;
+}
+
+//pairs that started overlapping in the last Update()
+const std::vector <BroadphasePair>& SweepAndPrune::GetAddedPairs() {
+	return _addedPairs;
+}
+
+//pairs that stopped overlapping in the last Update(). Pairs of removed bodies are not reported
+const std::vector <BroadphasePair>& SweepAndPrune::GetRemovedPairs() {
+	return _removedPairs;
+}
+
+int SweepAndPrune::GetProxyCount() {
+	return _proxyOf.size();
+}
+
+//drop the endpoints and the pairs of the removed bodies, then free their proxies
+void SweepAndPrune::purgeRemoved() {
+	if (_removedProxies.size() == 0) {
+		return;
+	}
+	std::vector <bool> removed(_proxies.size(), false);
+	for (int i = 0; i < _removedProxies.size(); i++) {
+		removed[_removedProxies[i]] = true;
+	}
+
+	int j = 0;
+	for (int i = 0; i < _pairs.size(); i++) {
+		uint32_t a = _pairKeys[i] >> 32;
+		uint32_t b = _pairKeys[i] & 0xffffffff;
+		if (removed[a] || removed[b]) {
+			_pairIndex.erase(_pairKeys[i]);
+			continue;
+		}
+		if (j != i) {
+			_pairs[j] = _pairs[i];
+			_pairKeys[j] = _pairKeys[i];
+			_pairIndex[_pairKeys[j]] = j;
+		}
+		j++;
+	}
+	_pairs.resize(j);
+	_pairKeys.resize(j);
+
+	for (int axis = 0; axis < 2; axis++) {
+		std::vector <Endpoint>& list = _endpoints[axis];
+		j = 0;
+		for (int i = 0; i < list.size(); i++) {
+			if (!removed[list[i].data >> 1]) {
+				list[j++] = list[i];
+			}
+		}
+		list.resize(j);
+	}
+
+	j = 0;
+	for (int i = 0; i < _pendingProxies.size(); i++) {
+		if (!removed[_pendingProxies[i]]) {
+			_pendingProxies[j++] = _pendingProxies[i];
+		}
+	}
+	_pendingProxies.resize(j);
+
+	_freeProxies.insert(_freeProxies.end(), _removedProxies.begin(), _removedProxies.end());
+	_removedProxies.clear();
+}
+
+//append the endpoints of the new bodies: the sort moves them to their place and finds their pairs.
+//Too many new bodies at once are cheaper with a rebuild
+void SweepAndPrune::insertPending() {
+	if (_pendingProxies.size() == 0) {
+		return;
+	}
+	int alive = _proxyOf.size();
+	if (_pendingProxies.size() > std::max(16, alive / 4)) {
+		_rebuild = true;
+	}
+	if (!_rebuild) {
+		for (int i = 0; i < _pendingProxies.size(); i++) {
+			uint32_t id = _pendingProxies[i];
+			for (int axis = 0; axis < 2; axis++) {
+				_endpoints[axis].push_back({ endpointValue(_proxies[id].box, axis, false), id << 1 });
+				_endpoints[axis].push_back({ endpointValue(_proxies[id].box, axis, true), (id << 1) | 1 });
+			}
+		}
+	}
+	_pendingProxies.clear();
+}
+
+//insertion sort of the endpoints along the axis, starting from the order of the last frame.
+//Every swap of a min and a max can change the overlap of the two boxes
+void SweepAndPrune::sortAxis(int axis) {
+	std::vector <Endpoint>& list = _endpoints[axis];
+	for (int i = 0; i < list.size(); i++) {
+		list[i].value = endpointValue(_proxies[list[i].data >> 1].box, axis, list[i].data & 1);
+	}
+
+	for (int i = 1; i < list.size(); i++) {
+		Endpoint e = list[i];
+		int j = i - 1;
+		while (j >= 0 && endpointLess(e, list[j])) {
+			const Endpoint& f = list[j];
+			uint32_t a = e.data >> 1;
+			uint32_t b = f.data >> 1;
+			bool eMax = e.data & 1;
+			bool fMax = f.data & 1;
+			if (!eMax && fMax) {		//the min of a passes the max of b: they can overlap
+				if (_proxies[a].box.overlaps(_proxies[b].box) && canCollide(a, b)) {
+					addPair(a, b);
+				}
+			}
+			else if (eMax && !fMax && canCollide(a, b)) {		//the max of a passes the min of b: they are apart on this axis
+				removePair(a, b);
+			}
+			list[j + 1] = f;
+			j--;
+		}
+		list[j + 1] = e;
+	}
+}
+
+//full sort of both axes and sweep along x to find the pairs from scratch. The difference with the old pairs is reported
+void SweepAndPrune::rebuild() {
+	for (int axis = 0; axis < 2; axis++) {
+		std::vector <Endpoint>& list = _endpoints[axis];
+		list.clear();
+		for (uint32_t id = 0; id < _proxies.size(); id++) {
+			if (_proxies[id].body != nullptr) {
+				list.push_back({ endpointValue(_proxies[id].box, axis, false), id << 1 });
+				list.push_back({ endpointValue(_proxies[id].box, axis, true), (id << 1) | 1 });
+			}
+		}
+		std::sort(list.begin(), list.end(), endpointLess);
+	}
+
+	std::unordered_set <uint64_t> newKeys;
+	std::vector <uint32_t> active;		//boxes that contain the current x
+	std::vector <Endpoint>& list = _endpoints[0];
+	for (int i = 0; i < list.size(); i++) {
+		uint32_t id = list[i].data >> 1;
+		if (list[i].data & 1) {
+			int index = _proxies[id].activeIndex;
+			active[index] = active.back();
+			_proxies[active[index]].activeIndex = index;
+			active.pop_back();
+			continue;
+		}
+		for (int k = 0; k < active.size(); k++) {
+			if (_proxies[id].box.overlaps(_proxies[active[k]].box) && canCollide(id, active[k])) {
+				newKeys.insert(pairKey(id, active[k]));
+			}
+		}
+		_proxies[id].activeIndex = active.size();
+		active.push_back(id);
+	}
+
+	std::vector <uint64_t> oldKeys = _pairKeys;
+	for (int i = 0; i < oldKeys.size(); i++) {
+		if (newKeys.count(oldKeys[i]) == 0) {
+			removePair(oldKeys[i] >> 32, oldKeys[i] & 0xffffffff);
+		}
+	}
+	//the pairs that still overlap keep their place, but one of their bodies can have become static since they were added
+	for (int i = 0; i < _pairs.size(); i++) {
+		_pairs[i] = orientedPair(_pairKeys[i] >> 32, _pairKeys[i] & 0xffffffff);
+	}
+	for (auto it = newKeys.begin(); it != newKeys.end(); it++) {
+		addPair(*it >> 32, *it & 0xffffffff);
+	}
+}
+
+//the pair of the two bodies with the static one second
+BroadphasePair SweepAndPrune::orientedPair(uint32_t a, uint32_t b) {
+	BroadphasePair pair = { _proxies[a].body, _proxies[b].body };
+	if (_proxies[a].isStatic) {
+		std::swap(pair.A, pair.B);
+	}
+	return pair;
+}
+
+void SweepAndPrune::addPair(uint32_t a, uint32_t b) {
+	uint64_t key = pairKey(a, b);
+	if (!_pairIndex.emplace(key, (int)_pairs.size()).second) {
+		return;
+	}
+	BroadphasePair pair = orientedPair(a, b);
+	_pairs.push_back(pair);
+	_pairKeys.push_back(key);
+	_addedPairs.push_back(pair);
+}
+
+void SweepAndPrune::removePair(uint32_t a, uint32_t b) {
+	auto it = _pairIndex.find(pairKey(a, b));
+	if (it == _pairIndex.end()) {
+		return;
+	}
+	int index = it->second;
+	_pairIndex.erase(it);
+	_removedPairs.push_back(_pairs[index]);
+	if (index != _pairs.size() - 1) {
+		_pairs[index] = _pairs.back();
+		_pairKeys[index] = _pairKeys.back();
+		_pairIndex[_pairKeys[index]] = index;
+	}
+	_pairs.pop_back();
+	_pairKeys.pop_back();
+}
+
+//two static bodies never collide
+bool SweepAndPrune::canCollide(uint32_t a, uint32_t b) {
+	return a != b && !(_proxies[a].isStatic && _proxies[b].isStatic);
+}
@@ -0,0 +1,309 @@
+#include "contactSolver.h"
+#include "rigidbody.h"
+#include "gameObject.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "platform.h"
+
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+//approach speed under which the bodies don't bounce: the resting bodies stay on the ground instead of jumping
+static const double RESTITUTION_VELOCITY = 0.5;
+//overlap of the bodies that is not corrected
+static const double LINEAR_SLOP = 0.005;
+
+ContactSolver::ContactSolver() {
+	_iterations = 8;
+	_colorCount = 0;
+	_colorStart[0] = 0;
+	_widestColor = 1;
+	_nextBlock = 0;
+	_doneBlocks = 0;
+}
+
+//times every contact is solved in a frame. More iterations make the stacks of bodies steadier
+void ContactSolver::SetIterations(int iterations) {
+	_iterations = std::max(1, iterations);
+}
+
+int ContactSolver::GetIterations() {
+	return _iterations;
+}
+
+//colours of the contacts of the last frame, the contacts without colour included
+int ContactSolver::GetColorCount() {
+	return _colorCount;
+}
+
+//solve the contacts between the bodies and write the new velocities. The bodies are the awake non static bodies
+//of the frame: the solver body of a body is its island index (see Rigidbody::_getIslandIndex()).
+//The forces of the frame are applied to the velocities before solving. The impulse of every contact is written back
+void ContactSolver::Solve(std::vector <CollisionStruct>& contacts, const std::vector <Rigidbody*>& bodies, double timeElapsed) {
+	PROFILE_SCOPE("ContactSolver");
+	loadBodies(bodies, timeElapsed);
+	prepareContacts(contacts, bodies);
+	colorContacts();
+	buildBlocks();
+
+	//all the iterations run in a single parallel loop: every thread that joins it takes the blocks in order
+	_nextBlock = 0;
+	_doneBlocks = 0;
+	if (_widestColor > 1) {
+		parallel_run(_widestColor, solveRoutine, this);
+	}
+	else {
+		solveBlocks();
+	}
+
+	for (int i = 0; i < _contacts.size(); i++) {
+		contacts[_contacts[i].contact].impulse = _contacts[i].normalImpulse;
+	}
+	storeBodies(bodies);
+}
+
+void ContactSolver::loadBodies(const std::vector <Rigidbody*>& bodies, double timeElapsed) {
+	_bodies.resize(bodies.size());
+	parallel_for(0, bodies.size(), GRAIN, [&](int i) {
+		Rigidbody* body = bodies[i];
+		SolverBody& s = _bodies[i];
+		double mass = body->mass;
+		vector2 v = body->velocity;
+		vector2 force = body->getForce();
+		s.v = { v.x + force.x * timeElapsed / mass, v.y + force.y * timeElapsed / mass };
+		s.w = body->angularVelocity * (MATH_PI / 180.0);
+		s.invMass = mass == INFINITY ? 0 : 1 / mass;
+		s.invI = (body->constraints & RBContraints::ROT) ? 0 : 1 / body->getMOI();
+		s.correction = { 0, 0 };
+	});
+}
+
+//solver body of the body, -1 if it is not one of the bodies of the frame (static or sleeping): it is not moved by the contact.
+//The island index is checked against the body list, a stale index never reaches the solver bodies
+int ContactSolver::solverBody(Rigidbody* body, const std::vector <Rigidbody*>& bodies) {
+	if (body->IsStatic()) {
+		return -1;
+	}
+	int index = body->_getIslandIndex();
+	if (index < 0 || index >= bodies.size() || bodies[index] != body) {
+		return -1;
+	}
+	return index;
+}
+
+//masses of the contacts along the normal and the tangent and the bounce speed
+void ContactSolver::prepareContacts(const std::vector <CollisionStruct>& contacts, const std::vector <Rigidbody*>& bodies) {
+	_unsorted.resize(contacts.size());
+	parallel_for(0, contacts.size(), GRAIN, [&](int i) {
+		const CollisionStruct& contact = contacts[i];
+		SolverContact& c = _unsorted[i];
+		c.a = solverBody(contact.A, bodies);
+		c.b = solverBody(contact.B, bodies);
+		c.contact = i;
+		c.normal = contact.collisionNormal;
+		vector2 centerA = contact.A->_getCenter();
+		vector2 centerB = contact.B->_getCenter();
+		c.ra = { contact.contactPoint.x - centerA.x, contact.contactPoint.y - centerA.y };
+		c.rb = { contact.contactPoint.x - centerB.x, contact.contactPoint.y - centerB.y };
+
+		SolverBody a = {}, b = {};
+		if (c.a >= 0) {
+			a = _bodies[c.a];
+		}
+		if (c.b >= 0) {
+			b = _bodies[c.b];
+		}
+		vector2 tangent = { -c.normal.y, c.normal.x };
+		double rnA = c.ra.cross(c.normal), rnB = c.rb.cross(c.normal);
+		double rtA = c.ra.cross(tangent), rtB = c.rb.cross(tangent);
+		double k = a.invMass + b.invMass + a.invI * rnA * rnA + b.invI * rnB * rnB;
+		c.normalMass = k > 0 ? 1 / k : 0;
+		k = a.invMass + b.invMass + a.invI * rtA * rtA + b.invI * rtB * rtB;
+		c.tangentMass = k > 0 ? 1 / k : 0;
+
+		double sA = contact.A->staticFriction, sB = contact.B->staticFriction;
+		c.friction = sqrt(sA * sA + sB * sB);
+
+		//relative velocity of the contact point along the normal, negative if the bodies approach
+		vector2 va = { a.v.x - a.w * c.ra.y, a.v.y + a.w * c.ra.x };
+		vector2 vb = { b.v.x - b.w * c.rb.y, b.v.y + b.w * c.rb.x };
+		double vn = (va.x - vb.x) * c.normal.x + (va.y - vb.y) * c.normal.y;
+		double e = contact.A->elasticity * contact.B->elasticity;
+		c.bias = vn < -RESTITUTION_VELOCITY ? -e * vn : 0;
+		c.normalImpulse = 0;
+		c.tangentImpulse = 0;
+	});
+
+	//the position corrections of the narrowphase are added up for every body
+	for (int i = 0; i < contacts.size(); i++) {
+		if (_unsorted[i].a >= 0) {
+			addCorrection(_bodies[_unsorted[i].a], contacts[i].postPosA);
+		}
+		if (_unsorted[i].b >= 0) {
+			addCorrection(_bodies[_unsorted[i].b], contacts[i].postPosB);
+		}
+	}
+}
+
+//the bodies are left overlapping by the slop, so the contact is found again in the next frame
+//and the resting bodies don't fall and hit the ground in turns
+void ContactSolver::addCorrection(SolverBody& body, vector2 correction) {
+	double length = correction.magnitude();
+	if (length <= LINEAR_SLOP) {
+		return;
+	}
+	double k = (length - LINEAR_SLOP) / length;
+	body.correction = { body.correction.x + correction.x * k, body.correction.y + correction.y * k };
+}
+
+//give every contact the first colour not used yet by its bodies, then sort the contacts by colour
+void ContactSolver::colorContacts() {
+	const int OVERFLOW_COLOR = MAX_COLORS - 1;
+	_bodyColors.assign(_bodies.size(), 0);
+	_color.resize(_unsorted.size());
+	int count[MAX_COLORS] = {};
+	for (int i = 0; i < _unsorted.size(); i++) {
+		int a = _unsorted[i].a;
+		int b = _unsorted[i].b;
+		uint32_t used = (a >= 0 ? _bodyColors[a] : 0) | (b >= 0 ? _bodyColors[b] : 0);
+		int color = 0;
+		while (color < OVERFLOW_COLOR && (used & (1u << color))) {
+			color++;
+		}
+		if (color < OVERFLOW_COLOR) {
+			if (a >= 0) {
+				_bodyColors[a] |= 1u << color;
+			}
+			if (b >= 0) {
+				_bodyColors[b] |= 1u << color;
+			}
+		}
+		_color[i] = color;
+		count[color]++;
+	}
+
+	_colorStart[0] = 0;
+	_colorCount = 0;
+	for (int color = 0; color < MAX_COLORS; color++) {
+		_colorStart[color + 1] = _colorStart[color] + count[color];
+		_colorCount += count[color] > 0;
+	}
+	int next[MAX_COLORS];
+	std::copy(_colorStart, _colorStart + MAX_COLORS, next);
+	_contacts.resize(_unsorted.size());
+	for (int i = 0; i < _unsorted.size(); i++) {
+		_contacts[next[_color[i]]++] = _unsorted[i];
+	}
+}
+
+//blocks of the contacts of one iteration: the colours split in blocks of GRAIN contacts, a colour with fewer contacts
+//or the contacts without colour in a single block. A phase is a colour: its blocks can run at the same time
+void ContactSolver::buildBlocks() {
+	_blocks.clear();
+	_phaseStart.clear();
+	_widestColor = 1;
+	for (int color = 0; color < MAX_COLORS; color++) {
+		int start = _colorStart[color];
+		int end = _colorStart[color + 1];
+		if (start == end) {
+			continue;
+		}
+		_phaseStart.push_back(_blocks.size());
+		int grain = color == MAX_COLORS - 1 ? end - start : GRAIN;
+		for (int first = start; first < end; first += grain) {
+			_blocks.push_back({ first, std::min(end, first + grain) });
+		}
+		_widestColor = std::max <int>(_widestColor, _blocks.size() - _phaseStart.back());
+	}
+	_phaseStart.push_back(_blocks.size());
+}
+
+void ContactSolver::solveRoutine(int start_index, int end_index, void* args) {
+	((ContactSolver*)args)->solveBlocks();
+}
+
+//take the blocks of all the iterations in order until there are none left. Block n of the solve is block n % blocks
+//of iteration n / blocks, and runs when all the blocks of the colours before it are done. A thread waits only for blocks
+//already taken by running threads, so the loop ends with any number of threads, even one
+void ContactSolver::solveBlocks() {
+	int blocks = _blocks.size();
+	int total = blocks * _iterations;
+	int phase = 0;
+	int block;
+	while ((block = _nextBlock.fetch_add(1, std::memory_order_relaxed)) < total) {
+		int iteration = block / blocks;
+		int index = block % blocks;
+		phase = index < _phaseStart[phase] ? 0 : phase;
+		while (_phaseStart[phase + 1] <= index) {
+			phase++;
+		}
+		int ready = iteration * blocks + _phaseStart[phase];
+		int spins = 0;
+		while (_doneBlocks.load(std::memory_order_acquire) < ready) {
+			if (++spins < 64) {
+				CpuRelax();
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+		for (int i = _blocks[index].start; i < _blocks[index].end; i++) {
+			solveContact(_contacts[i]);
+		}
+		_doneBlocks.fetch_add(1, std::memory_order_release);
+	}
+}
+
+void ContactSolver::solveContact(SolverContact& c) {
+	SolverBody staticA = {}, staticB = {};
+	SolverBody& a = c.a >= 0 ? _bodies[c.a] : staticA;
+	SolverBody& b = c.b >= 0 ? _bodies[c.b] : staticB;
+
+	//normal impulse: the total impulse of the contact only pushes the bodies apart
+	vector2 va = { a.v.x - a.w * c.ra.y, a.v.y + a.w * c.ra.x };
+	vector2 vb = { b.v.x - b.w * c.rb.y, b.v.y + b.w * c.rb.x };
+	vector2 dv = { va.x - vb.x, va.y - vb.y };
+	double vn = dv.dot(c.normal);
+	double impulse = c.normalMass * (c.bias - vn);
+	double total = std::max(c.normalImpulse + impulse, 0.0);
+	impulse = total - c.normalImpulse;
+	c.normalImpulse = total;
+
+	vector2 p = { c.normal.x * impulse, c.normal.y * impulse };
+	a.v = { a.v.x + p.x * a.invMass, a.v.y + p.y * a.invMass };
+	a.w += a.invI * c.ra.cross(p);
+	b.v = { b.v.x - p.x * b.invMass, b.v.y - p.y * b.invMass };
+	b.w -= b.invI * c.rb.cross(p);
+
+	//friction impulse, no bigger than the friction coefficient times the normal impulse
+	vector2 tangent = { -c.normal.y, c.normal.x };
+	va = { a.v.x - a.w * c.ra.y, a.v.y + a.w * c.ra.x };
+	vb = { b.v.x - b.w * c.rb.y, b.v.y + b.w * c.rb.x };
+	dv = { va.x - vb.x, va.y - vb.y };
+	double vt = dv.dot(tangent);
+	impulse = -c.tangentMass * vt;
+	double maxFriction = c.friction * c.normalImpulse;
+	total = std::max(-maxFriction, std::min(c.tangentImpulse + impulse, maxFriction));
+	impulse = total - c.tangentImpulse;
+	c.tangentImpulse = total;
+
+	p = { tangent.x * impulse, tangent.y * impulse };
+	a.v = { a.v.x + p.x * a.invMass, a.v.y + p.y * a.invMass };
+	a.w += a.invI * c.ra.cross(p);
+	b.v = { b.v.x - p.x * b.invMass, b.v.y - p.y * b.invMass };
+	b.w -= b.invI * c.rb.cross(p);
+}
+
+//copy the velocities back to the bodies and apply the position corrections
+void ContactSolver::storeBodies(const std::vector <Rigidbody*>& bodies) {
+	parallel_for(0, bodies.size(), GRAIN, [&](int i) {
+		Rigidbody* body = bodies[i];
+		const SolverBody& s = _bodies[i];
+		body->velocity = s.v;
+		body->angularVelocity = s.w * (180.0 / MATH_PI);
+		if (s.correction.x != 0 || s.correction.y != 0) {
+			body->getParentObject()->transform.position += s.correction;
+		}
+	});
+}
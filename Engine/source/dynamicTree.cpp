@@ -0,0 +1,276 @@
+#include "dynamicTree.h"
+
+//margin: how much the box of a leaf is bigger than the box of its body on every side
+DynamicTree::DynamicTree(double margin) {
+	_root = NULL_NODE;
+	_freeList = NULL_NODE;
+	_proxyCount = 0;
+	_margin = margin;
+}
+
+//add a leaf for the body. Returns the id of the leaf
+int DynamicTree::CreateProxy(const AABB& box, Rigidbody* body) {
+	int proxy = allocateNode();
+	_nodes[proxy].box = { { box.min.x - _margin, box.min.y - _margin }, { box.max.x + _margin, box.max.y + _margin } };
+	_nodes[proxy].body = body;
+	_nodes[proxy].height = 0;
+	insertLeaf(proxy);
+	_proxyCount++;
+	return proxy;
+}
+
+void DynamicTree::DestroyProxy(int proxy) {
+	removeLeaf(proxy);
+	freeNode(proxy);
+	_proxyCount--;
+}
+
+//update the box of the body. The leaf is moved only if the body left the box of the leaf. Returns true if the leaf moved
+bool DynamicTree::MoveProxy(int proxy, const AABB& box) {
+	if (contains(_nodes[proxy].box, box)) {
+		return false;
+	}
+	removeLeaf(proxy);
+	_nodes[proxy].box = { { box.min.x - _margin, box.min.y - _margin }, { box.max.x + _margin, box.max.y + _margin } };
+	insertLeaf(proxy);
+	return true;
+}
+
+const AABB& DynamicTree::GetFatAABB(int proxy) const {
+	return _nodes[proxy].box;
+}
+
+int DynamicTree::GetHeight() const {
+	return _root == NULL_NODE ? 0 : _nodes[_root].height;
+}
+
+int DynamicTree::GetProxyCount() const {
+	return _proxyCount;
+}
+
+int DynamicTree::allocateNode() {
+	if (_freeList == NULL_NODE) {
+		_nodes.push_back({});
+		_nodes.back().height = -1;
+		_freeList = _nodes.size() - 1;
+		_nodes.back().parent = NULL_NODE;
+	}
+	int node = _freeList;
+	_freeList = _nodes[node].parent;
+	_nodes[node].parent = NULL_NODE;
+	_nodes[node].child1 = NULL_NODE;
+	_nodes[node].child2 = NULL_NODE;
+	_nodes[node].body = nullptr;
+	_nodes[node].height = 0;
+	return node;
+}
+
+void DynamicTree::freeNode(int node) {
+	_nodes[node].parent = _freeList;
+	_nodes[node].height = -1;
+	_nodes[node].body = nullptr;
+	_freeList = node;
+}
+
+//go down the tree choosing the child whose box grows the least, then pair the leaf with the node found
+void DynamicTree::insertLeaf(int leaf) {
+	if (_root == NULL_NODE) {
+		_root = leaf;
+		_nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	AABB leafBox = _nodes[leaf].box;
+	int index = _root;
+	while (_nodes[index].height > 0) {
+		int child1 = _nodes[index].child1;
+		int child2 = _nodes[index].child2;
+
+		double area = perimeter(_nodes[index].box);
+		double combinedArea = perimeter(combine(_nodes[index].box, leafBox));
+		double cost = 2.0 * combinedArea;		//cost of a new parent for this node and the leaf
+		double inheritanceCost = 2.0 * (combinedArea - area);		//the ancestors grow anyway
+
+		double cost1 = perimeter(combine(leafBox, _nodes[child1].box)) + inheritanceCost;
+		if (_nodes[child1].height > 0) {
+			cost1 -= perimeter(_nodes[child1].box);
+		}
+		double cost2 = perimeter(combine(leafBox, _nodes[child2].box)) + inheritanceCost;
+		if (_nodes[child2].height > 0) {
+			cost2 -= perimeter(_nodes[child2].box);
+		}
+
+		if (cost < cost1 && cost < cost2) {
+			break;
+		}
+		index = cost1 < cost2 ? child1 : child2;
+	}
+
+	int sibling = index;
+	int oldParent = _nodes[sibling].parent;
+	int newParent = allocateNode();
+	_nodes[newParent].parent = oldParent;
+	_nodes[newParent].box = combine(leafBox, _nodes[sibling].box);
+	_nodes[newParent].height = _nodes[sibling].height + 1;
+	_nodes[newParent].child1 = sibling;
+	_nodes[newParent].child2 = leaf;
+	_nodes[sibling].parent = newParent;
+	_nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE) {
+		_root = newParent;
+	}
+	else if (_nodes[oldParent].child1 == sibling) {
+		_nodes[oldParent].child1 = newParent;
+	}
+	else {
+		_nodes[oldParent].child2 = newParent;
+	}
+
+	fixUpwards(_nodes[leaf].parent);
+}
+
+//the sibling of the leaf takes the place of their parent
+void DynamicTree::removeLeaf(int leaf) {
+	if (leaf == _root) {
+		_root = NULL_NODE;
+		return;
+	}
+
+	int parent = _nodes[leaf].parent;
+	int grandParent = _nodes[parent].parent;
+	int sibling = _nodes[parent].child1 == leaf ? _nodes[parent].child2 : _nodes[parent].child1;
+
+	if (grandParent == NULL_NODE) {
+		_root = sibling;
+		_nodes[sibling].parent = NULL_NODE;
+		freeNode(parent);
+		return;
+	}
+
+	if (_nodes[grandParent].child1 == parent) {
+		_nodes[grandParent].child1 = sibling;
+	}
+	else {
+		_nodes[grandParent].child2 = sibling;
+	}
+	_nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	fixUpwards(grandParent);
+}
+
+//balance the ancestors of the node and update their boxes and heights
+void DynamicTree::fixUpwards(int index) {
+	while (index != NULL_NODE) {
+		index = balance(index);
+
+		int child1 = _nodes[index].child1;
+		int child2 = _nodes[index].child2;
+		_nodes[index].height = 1 + std::max(_nodes[child1].height, _nodes[child2].height);
+		_nodes[index].box = combine(_nodes[child1].box, _nodes[child2].box);
+
+		index = _nodes[index].parent;
+	}
+}
+
+//if the children of node A differ in height by more than 1, the taller child is rotated up.
+//Returns the node that took the place of A
+int DynamicTree::balance(int iA) {
+	TreeNode* A = &_nodes[iA];
+	if (A->height < 2) {
+		return iA;
+	}
+
+	int iB = A->child1;
+	int iC = A->child2;
+	TreeNode* B = &_nodes[iB];
+	TreeNode* C = &_nodes[iC];
+	int difference = C->height - B->height;
+
+	if (difference > 1) {		//rotate C up
+		int iF = C->child1;
+		int iG = C->child2;
+		TreeNode* F = &_nodes[iF];
+		TreeNode* G = &_nodes[iG];
+
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+		if (C->parent != NULL_NODE) {
+			if (_nodes[C->parent].child1 == iA) {
+				_nodes[C->parent].child1 = iC;
+			}
+			else {
+				_nodes[C->parent].child2 = iC;
+			}
+		}
+		else {
+			_root = iC;
+		}
+
+		if (F->height > G->height) {
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+			A->box = combine(B->box, G->box);
+			C->box = combine(A->box, F->box);
+			A->height = 1 + std::max(B->height, G->height);
+			C->height = 1 + std::max(A->height, F->height);
+		}
+		else {
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+			A->box = combine(B->box, F->box);
+			C->box = combine(A->box, G->box);
+			A->height = 1 + std::max(B->height, F->height);
+			C->height = 1 + std::max(A->height, G->height);
+		}
+		return iC;
+	}
+
+	if (difference < -1) {		//rotate B up
+		int iD = B->child1;
+		int iE = B->child2;
+		TreeNode* D = &_nodes[iD];
+		TreeNode* E = &_nodes[iE];
+
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+		if (B->parent != NULL_NODE) {
+			if (_nodes[B->parent].child1 == iA) {
+				_nodes[B->parent].child1 = iB;
+			}
+			else {
+				_nodes[B->parent].child2 = iB;
+			}
+		}
+		else {
+			_root = iB;
+		}
+
+		if (D->height > E->height) {
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+			A->box = combine(C->box, E->box);
+			B->box = combine(A->box, D->box);
+			A->height = 1 + std::max(C->height, E->height);
+			B->height = 1 + std::max(A->height, D->height);
+		}
+		else {
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+			A->box = combine(C->box, D->box);
+			B->box = combine(A->box, E->box);
+			A->height = 1 + std::max(C->height, D->height);
+			B->height = 1 + std::max(A->height, E->height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
@@ -0,0 +1,143 @@
+#include "epochManager.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+thread_local int EpochManager::_threadIndex = -1;
+
+EpochManager::EpochManager() {
+	_globalEpoch = 1;
+	for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+		_participants[i].epoch = 0;
+		_participants[i].used = false;
+	}
+}
+
+//the objects still retired at exit are not freed since the other engines could be already destroyed
+EpochManager::~EpochManager() {
+
+}
+
+//the calling thread becomes a participant and starts online. Returns false if there are no free slots
+bool EpochManager::RegisterThread() {
+	if (_threadIndex >= 0) {
+		return true;
+	}
+	for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+		bool expected = false;
+		if (_participants[i].used.compare_exchange_strong(expected, true)) {
+			_threadIndex = i;
+			Online();
+			return true;
+		}
+	}
+	return false;
+}
+
+void EpochManager::UnregisterThread() {
+	if (_threadIndex < 0) {
+		return;
+	}
+	Offline();
+	_participants[_threadIndex].used = false;
+	_threadIndex = -1;
+}
+
+//the calling thread holds no reference to shared objects
+void EpochManager::QuiescentPoint() {
+	if (_threadIndex < 0) {
+		return;
+	}
+	_participants[_threadIndex].epoch.store(_globalEpoch.load());
+	if (TryAdvance()) {		//the thread is quiescent so it can observe the new epoch right away
+		_participants[_threadIndex].epoch.store(_globalEpoch.load());
+	}
+}
+
+//the calling thread will not access shared objects until it calls Online()
+void EpochManager::Offline() {
+	if (_threadIndex < 0) {
+		return;
+	}
+	_participants[_threadIndex].epoch.store(0);
+}
+
+void EpochManager::Online() {
+	if (_threadIndex < 0) {
+		return;
+	}
+	_participants[_threadIndex].epoch.store(_globalEpoch.load());
+}
+
+//queue an object to be freed once no thread can hold a reference to it.
+//The object must already be unreachable (e.g. removed from the object registry)
+void EpochManager::Retire(void* ptr, void (*deleter)(void*)) {
+	if (ptr == nullptr) {
+		return;
+	}
+	std::lock_guard <std::mutex> guard(_retired_mutex);
+	_retired.push_back({ ptr, deleter, _globalEpoch.load() });
+}
+
+//free the retired objects that are safe to free. Must be called from a quiescent point of the calling thread.
+//Returns the number of freed objects
+size_t EpochManager::Collect() {
+	QuiescentPoint();
+	uint64_t safeEpoch = MinimumEpoch();
+
+	std::vector <RetiredObject> toFree;
+	{
+		std::lock_guard <std::mutex> guard(_retired_mutex);
+		while (_retired.size() > 0 && _retired.front().epoch < safeEpoch) {
+			toFree.push_back(_retired.front());
+			_retired.pop_front();
+		}
+	}
+
+	//deleters run without the lock since they can retire other objects
+	for (int i = 0; i < toFree.size(); i++) {
+		toFree[i].deleter(toFree[i].ptr);
+	}
+	return toFree.size();
+}
+
+uint64_t EpochManager::GetEpoch() {
+	return _globalEpoch.load();
+}
+
+size_t EpochManager::GetRetiredCount() {
+	std::lock_guard <std::mutex> guard(_retired_mutex);
+	return _retired.size();
+}
+
+//move to the next epoch if every online thread observed the current one
+bool EpochManager::TryAdvance() {
+	uint64_t epoch = _globalEpoch.load();
+	for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+		if (!_participants[i].used.load()) {
+			continue;
+		}
+		uint64_t e = _participants[i].epoch.load();
+		if (e != 0 && e != epoch) {
+			return false;
+		}
+	}
+	return _globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+//oldest epoch observed by an online thread. Objects retired before this epoch are unreachable
+uint64_t EpochManager::MinimumEpoch() {
+	uint64_t minEpoch = _globalEpoch.load();
+	for (int i = 0; i < MAX_PARTICIPANTS; i++) {
+		if (!_participants[i].used.load()) {
+			continue;
+		}
+		uint64_t e = _participants[i].epoch.load();
+		if (e != 0 && e < minEpoch) {
+			minEpoch = e;
+		}
+	}
+	return minEpoch;
+}
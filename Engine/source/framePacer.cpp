@@ -0,0 +1,143 @@
+#include "framePacer.h"
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <math.h>
+
+FramePacer::FramePacer(double targetFPS) {
+	_targetFPS = targetFPS;
+	_period = 1.0 / targetFPS;
+	_sleepMean = 0.0015;		//pessimistic until the first sleeps are measured
+	_sleepVariance = 0;
+	_frameTimesCount = 0;
+	_frameTimesHead = 0;
+	_lastFrameTime = 0;
+	_frames = 0;
+	_missedDeadlines = 0;
+	Start();
+}
+
+void FramePacer::SetTargetFPS(double fps) {
+	if (fps > 0) {
+		_targetFPS = fps;
+	}
+}
+
+double FramePacer::GetTargetFPS() {
+	return _targetFPS;
+}
+
+//start the first frame now
+void FramePacer::Start() {
+	_frameStart = Clock::now();
+	_deadline = _frameStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(_period));
+}
+
+//seconds left before the deadline of the current frame. Negative if the deadline is passed
+double FramePacer::TimeLeft() {
+	std::chrono::duration<double> left = _deadline - Clock::now();
+	return left.count();
+}
+
+//end the current frame and start the next one. If wait is true waits for the deadline of the frame.
+//Returns the duration of the frame, wait included
+double FramePacer::EndFrame(bool wait) {
+	Clock::time_point now = Clock::now();
+	bool missed = now > _deadline;
+	if (wait && !missed) {
+		WaitUntil(_deadline);
+		now = Clock::now();
+	}
+
+	std::chrono::duration<double> frameTime = now - _frameStart;
+	Record(frameTime.count(), missed);
+	_frameStart = now;
+
+	double period = 1.0 / _targetFPS;
+	auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period));
+	if (!wait || period != _period || _deadline + step < now) {
+		//not pacing, new rate or more than a frame late: don't try to catch up, start from now
+		_deadline = now + step;
+	}
+	else {
+		_deadline += step;
+	}
+	_period = period;
+
+	return frameTime.count();
+}
+
+//sleep in steps of 1ms while the deadline is far enough that a sleep can't overshoot it, then spin
+void FramePacer::WaitUntil(Clock::time_point deadline) {
+	const double alpha = 0.05;
+
+	while (true) {
+		Clock::time_point start = Clock::now();
+		std::chrono::duration<double> left = deadline - start;
+		double estimate = _sleepMean + sqrt(_sleepVariance);
+		if (left.count() <= estimate) {
+			break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::chrono::duration<double> slept = Clock::now() - start;
+
+		//moving average and variance of the sleep duration
+		double diff = slept.count() - _sleepMean;
+		_sleepMean += alpha * diff;
+		_sleepVariance = (1 - alpha) * (_sleepVariance + alpha * diff * diff);
+	}
+
+	while (Clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+void FramePacer::Record(double frameTime, bool missed) {
+	std::lock_guard <std::mutex> guard(stats_mutex);
+	_frameTimes[_frameTimesHead] = frameTime;
+	_frameTimesHead = (_frameTimesHead + 1) % STATS_WINDOW;
+	if (_frameTimesCount < STATS_WINDOW) {
+		_frameTimesCount++;
+	}
+	_lastFrameTime = frameTime;
+	_frames++;
+	if (missed) {
+		_missedDeadlines++;
+	}
+}
+
+//statistics of the last frames
+FrameStats FramePacer::GetStats() {
+	std::lock_guard <std::mutex> guard(stats_mutex);
+	FrameStats stats = {};
+	stats.lastFrameTime = _lastFrameTime;
+	stats.frames = _frames;
+	stats.missedDeadlines = _missedDeadlines;
+	if (_frameTimesCount == 0) {
+		return stats;
+	}
+
+	double sum = 0;
+	stats.minFrameTime = _frameTimes[0];
+	stats.maxFrameTime = _frameTimes[0];
+	for (int i = 0; i < _frameTimesCount; i++) {
+		sum += _frameTimes[i];
+		stats.minFrameTime = std::min(stats.minFrameTime, _frameTimes[i]);
+		stats.maxFrameTime = std::max(stats.maxFrameTime, _frameTimes[i]);
+	}
+	stats.averageFrameTime = sum / _frameTimesCount;
+
+	double variance = 0;
+	for (int i = 0; i < _frameTimesCount; i++) {
+		double d = _frameTimes[i] - stats.averageFrameTime;
+		variance += d * d;
+	}
+	stats.jitter = sqrt(variance / _frameTimesCount);
+	if (stats.averageFrameTime > 0) {
+		stats.averageFPS = 1.0 / stats.averageFrameTime;
+	}
+	return stats;
+}
@@ -14,6 +14,11 @@
 #include "scene.h"
 #include "game_options.h"
 #include "physics.h"
+#include "epochManager.h"
+#include "framePacer.h"
+#include "profiler.h"
+#include "parallel.h"
+#include "jobSystem.h"
 
 #include <chrono>
 #include <thread>
@@ -21,6 +26,8 @@
 #include <malloc.h>
 #include <shared_mutex>
 #include <vector>
+#include <unordered_set>
+#include <limits>
 #include <SDL.h>
 #include <SDL_image.h>
 #include <SDL_ttf.h>
@@ -29,67 +36,156 @@ typedef std::shared_mutex RWLock;
 typedef std::unique_lock< RWLock >  WriteLock;
 typedef std::shared_lock< RWLock >  ReadLock;
 
-GameEngine::GameEngine(){
+thread_local GameEngine::RequestBlock* GameEngine::_threadRequestBuffer = nullptr;
+thread_local int GameEngine::_threadBatchDepth = 0;
 
-	zone_size = 10.0;
+GameEngine::GameEngine() : _grid(10.0), _renderPacer(50), _gamePacer(400) {
+
+	zone_size = _grid.GetZoneSize();
+	_cameraZone = 0;
+	_cameraZoneValid = false;
 
 	renderFPS = 50;	//fixed frame rate
 	gameFPS = 400;
 	lockRenderFPS = true;
 	lockGameFPS = true;
+	_paceToDisplay = false;
 
 	gameSpeed = 1;
+	_fixedTimestep = false;
+	_tickRate = 60;
+	_maxTicksPerLoop = 5;
 	gameRunning = true;
+	_headless = false;
+	_frameLimit = 0;
 
 	_sceneReady = false;
 	_freeingScene = false;
 
+	_pendingHead = 0;
+	_submittedRequests = 0;
+	_completedRequests = 0;
+
 	currentScene = nullptr;
 	sync_state = true;		//unlock the draw thread in the first frame
 
 	_syncBarrier = new Barrier(2);
+	_helperManager = nullptr;
+	_pinThreads = false;
 	//int hardware_threads_count = std::thread::hardware_concurrency();
 	int hardware_count = GetCoresCount();
 	if (hardware_count == 0) {		//failed to get the core count
 		_helperCount = 1;
 	}
 	else {
-		_helperCount = hardware_count - 1;
+		_helperCount = hardware_count - 1;		//can be 0: the game thread runs all the work of the pool
 	}
 
 	generator = new std::mt19937_64(rd());
 	distribution = new std::uniform_int_distribution<long long unsigned>(1, 0xFFFFFFFFFFFFFFFF);
 }
 
+//the requests never handled are dropped. The lists of the bulk requests belong to the queue and are freed
 GameEngine::~GameEngine() {
-
+	_requests.Drain(_pendingRequests);
+	for (size_t i = _pendingHead; i < _pendingRequests.size(); i++) {
+		GameEngineRequestType type = _pendingRequests[i].requestType;
+		if (type == GameEngineRequestType::REGISTER_GAME_OBJECTS || type == GameEngineRequestType::DESTROY_GAME_OBJECTS) {
+			delete _pendingRequests[i].objects;
+		}
+	}
+	_pendingRequests.clear();
 }
 
 
-void GameEngine::GameEngine_Start(void (*GameInit)(), GraphicsOptions& g_options, AudioOptions& a_options) {
+//Start the engine. Returns only when e_options.frameCount frames have been run, otherwise the game runs until Quit()
+void GameEngine::GameEngine_Start(void (*GameInit)(), GraphicsOptions& g_options, AudioOptions& a_options, const EngineOptions& e_options) {
 	if (!GameInit)
 		return;
+	_headless = e_options.headless;
+	_frameLimit = e_options.frameCount;
 	Init_Engines(g_options, a_options);
 	GameInit();
 
-	_helperManager = new MultithreadManager(_helperCount);
+	_pinThreads = false;
+	if (e_options.pinThreads) {
+		CpuTopology topology;
+		_pinThreads = GetCpuTopology(topology) && planThreadPlacement(topology);		//no pinning on a guessed topology
+	}
+	if (_pinThreads) {
+		_helperCount = _helperCpus.size();
+		PinCurrentThread(_renderCpus);		//this thread becomes the render thread. Threads created after this inherit the cpu
+	}
+	_helperManager = new MultithreadManager(_helperCount, _helperCpus);
+	if (_helperCount > 1) {		//a single helper is kept for the frame jobs
+		_helperManager->SetIdleWork(background_job_routine, nullptr);		//the idle helpers run the background jobs
+		JobSystem::getInstance().SetPool(_helperManager);
+	}
 
 	std::thread t1(&GameEngine::gameThread, this);
-	t1.detach();
-	mainThread();
+	mainThread();		//returns when the game thread stops
+	t1.join();
+	JobSystem::getInstance().SetPool(nullptr);
+	JobSystem::getInstance().Clear();		//the jobs not started are dropped, the running ones end before the helpers stop
+	_helperManager->SetIdleWork(nullptr, nullptr);
+	_helperManager->destroy();
+}
+
+//choose the cpus of the threads of the engine. The render thread gets a physical core without other threads on its SMT siblings,
+//the game thread and the helpers share the other cores of the same package: on multi socket hosts the frame data stays in one
+//package instead of crossing the interconnect. The background jobs run on the helpers.
+//Returns false if there are not enough cores to reserve one
+bool GameEngine::planThreadPlacement(const CpuTopology& topology) {
+	std::vector <const CpuCore*> cores;		//cores of the package of the first core
+	for (int i = 0; i < topology.cores.size(); i++) {
+		if (topology.cores[i].package == topology.cores[0].package) {
+			cores.push_back(&topology.cores[i]);
+		}
+	}
+	if (cores.size() < 2) {		//single core package: use all the packages
+		cores.clear();
+		for (int i = 0; i < topology.cores.size(); i++) {
+			cores.push_back(&topology.cores[i]);
+		}
+	}
+	if (cores.size() < 2) {
+		return false;
+	}
+
+	//cpu 0 usually handles the interrupts: the render thread takes the last core
+	const CpuCore* renderCore = cores.back();
+	cores.pop_back();
+	_renderCpus.assign(1, renderCore->cpus[0]);
+	_gameCpus.assign(1, cores[0]->cpus[0]);
+
+	//one helper for every physical core first, then the SMT siblings
+	_helperCpus.clear();
+	for (int i = 1; i < cores.size(); i++) {
+		_helperCpus.push_back(cores[i]->cpus[0]);
+	}
+	for (int i = 0; i < cores.size(); i++) {
+		for (int j = 1; j < cores[i]->cpus.size(); j++) {
+			_helperCpus.push_back(cores[i]->cpus[j]);
+		}
+	}
+	return true;
 }
 
 void GameEngine::Init_Engines(GraphicsOptions& g_options, AudioOptions& a_options){
-	//init sdl
-	SDL_SetHint(SDL_HINT_RENDER_DRIVER, "opengles2");
-	SDL_Init(SDL_INIT_EVERYTHING);
-	IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG);
-	TTF_Init();
+	//init sdl. In headless mode there is no window, no renderer and no audio device
+	if (!_headless) {
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, "opengles2");
+		SDL_Init(SDL_INIT_EVERYTHING);
+		IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG);
+		TTF_Init();
+	}
 
 	//init other engines
-	GraphicsEngine::getInstance().Init(g_options);
-	AudioEngine::getInstance().Init(a_options);
-	InputEngine::getInstance().Init();
+	GraphicsEngine::getInstance().Init(g_options, _headless);
+	AudioEngine::getInstance().Init(a_options, _headless);
+	if (!_headless) {
+		InputEngine::getInstance().Init();
+	}
 }
 
 
@@ -210,66 +306,158 @@ EntityName GameEngine::GenerateRandomName(void) {
 	return (*distribution)(*generator);
 }
 
+//return the zone that contains the position. Zones are squares of zone_size units
 uint32_t GameEngine::posToZone(vector2 pos) {
-	uint32_t zone = 0;
-	uint16_t xzone = 0, yzone = 0;
-	xzone |= (int)(pos.x / 10);
-	yzone |= (int)(pos.y / 10);
-	zone = (xzone << 16) | (yzone & 0xffff);
-	return zone;
+	return _grid.PosToZone(pos);
 }
 
 //return the number of zones two zones are apart.
 //i.e. return 0 if they are the same zone, 1 if the zones are connected, 2 if they are two zones apart and so on
 int GameEngine::zoneDistance(uint32_t zone1, uint32_t zone2) {
-	int l1 = (int)(zone1 >> 16) - (int)(zone2 >> 16);
-	int l2 = (int)(zone1 & 0xffff) - (int)(zone2 & 0xffff);
-	int d = std::max(l1, l2);
-	return d;
+	return SpatialGrid::ZoneDistance(zone1, zone2);
+}
+
+//append to objects the registered objects that overlap the rectangle.
+//Positions are the ones of the last post update. Same rules of FindGameObject() apply to the returned pointers
+void GameEngine::QueryZone(AABB rect, std::vector <GameObject*>& objects) {
+	ReadLock r_lock(object_vector_mutex);
+	_grid.Query(rect, objects);
+}
+
+//fast conservative check based on zones: returns false only if the position is surely farther than distance from the camera
+bool GameEngine::IsNearCamera(vector2 pos, double distance) {
+	if (!_cameraZoneValid) {
+		return true;
+	}
+	int maxZones = (int)(distance / _grid.GetZoneSize()) + 1;
+	return SpatialGrid::ZoneDistance(_grid.PosToZone(pos), _cameraZone) <= maxZones;
+}
+
+//radius of the circle used to cull an object
+double GameEngine::cullRadius(GameObject* obj, uint8_t flags) {
+	vector2 scale = obj->transform.scale;
+	double radius = std::max(scale.x, scale.y) * 1.5 / 2.0;
+	if (flags & GRID_LIGHT_OBJECT) {
+		LightObjectData light = ((LightObject*)obj)->GetLightData();
+		if (light.type == LightType::GLOBAL_LIGHT) {
+			return std::numeric_limits<double>::infinity();
+		}
+		radius = std::max(radius, light.lightRadius);
+	}
+	return radius;
+}
+
+//requires the exclusive lock of the registry
+void GameEngine::InsertInGrid_Internal(GameObject* obj, ObjectHandle handle, uint8_t flags) {
+	_grid.Insert(handle.index, obj, obj->transform.position, cullRadius(obj, flags), flags);
 }
 
-//remove a object from the objects vector and add it to the garbage collection
+//store in the grid the positions of the post update and move the objects that changed zone.
+//The post update only records them: the scene queries of the other threads read the grid with the shared lock
+void GameEngine::UpdateGrid_Internal() {
+	if (_gridUpdates.size() == 0) {
+		return;
+	}
+	WriteLock w_lock(object_vector_mutex);
+	for (int i = 0; i < _gridUpdates.size(); i++) {
+		GridUpdate& update = _gridUpdates[i];
+		if (_grid.Update(update.id, update.position, update.radius)) {
+			_grid.Move(update.id);
+		}
+	}
+	_gridUpdates.clear();
+}
+
+//remove a object from the object registry and retire it
 //this function is called from PollRequests() and run on the update thread
-//it requires an exclusive mutex to protect the reading of the vector object
+//it requires an exclusive mutex to protect the reading of the registry
 void GameEngine::DestroyGameObject_Internal(EntityName name) {
 	if (name == 0) {
 		return;
 	}
 	WriteLock w_lock(object_vector_mutex);
 
-	auto [found, index] = FindObject_Internal(name);
+	GameObject* obj = _objects.Remove(name);
 	
-	if (found) {
-		GameObject* obj = _objects[index].obj;
-		PhysicsEngine::getInstance().RemoveRigidbody(obj->GetRigidbody());
+	if (obj != nullptr) {
+		std::vector <GameObject*> removed = { obj };
+		ReleaseObjects_Internal(removed);
+	}
+}
 
-		_garbageCollector.push_back(std::pair <GameObject*, int>(obj, 10));		//the object will be destroyed in 10 frames
-		_objects.erase(_objects.begin() + index);
+//remove many objects from the registry taking the lock only once
+void GameEngine::DestroyGameObjects_Internal(std::vector <GameObjectData>& objects) {
+	WriteLock w_lock(object_vector_mutex);
+
+	std::vector <GameObject*> removed;
+	removed.reserve(objects.size());
+	for (int i = 0; i < objects.size(); i++) {
+		GameObject* obj = _objects.Remove(objects[i].name);
+		if (obj != nullptr) {
+			removed.push_back(obj);
+		}
+	}
+	ReleaseObjects_Internal(removed);
+}
+
+//detach objects already removed from the registry from the grid, the light list and the physics engine
+//and retire them. They are freed once no thread can still reference them. Requires the exclusive lock of the registry
+void GameEngine::ReleaseObjects_Internal(std::vector <GameObject*>& objects) {
+	if (objects.size() == 0) {
+		return;
+	}
 
-		for (int i = 0; i < _lightObj.size(); i++) {		//delete the light object
-			if (obj == _lightObj[i].obj) {
-				_lightObj.erase(_lightObj.begin() + i);
+	std::vector <Rigidbody*> bodies;
+	for (int i = 0; i < objects.size(); i++) {
+		_grid.Remove(objects[i]->getObjectHandle().index);
+		objects[i]->_setObjectHandle({});
+		if (objects[i]->GetRigidbody() != nullptr) {
+			bodies.push_back(objects[i]->GetRigidbody());
+		}
+		EpochManager::getInstance().Retire(objects[i]);		//freed once no thread can still be using it
+	}
+	PhysicsEngine::getInstance().RemoveRigidbodies(bodies);
+
+	//the render thread must not see the lights anymore once they are retired
+	std::lock_guard <std::mutex> guard(visible_lights_mutex);
+	if (_visibleLights.size() > 0) {		//delete the light objects with a single pass
+		std::unordered_set <GameObject*> removed(objects.begin(), objects.end());
+		int j = 0;
+		for (int i = 0; i < _visibleLights.size(); i++) {
+			if (removed.count((GameObject*)_visibleLights[i]) == 0) {
+				_visibleLights[j++] = _visibleLights[i];
 			}
 		}
+		_visibleLights.resize(j);
 	}
 }
 
 //create a request to destroy a game object
-//requires a mutex to protect from concurrent request creation 
 void GameEngine::DestroyGameObject(EntityName name) {
 
 	if (name == 0) {
 		return;
 	}
-	std::lock_guard <std::mutex> guard(request_mutex);
-	
 	RequestData data;
 	data.objectData.name = name;
 	data.requestType = GameEngineRequestType::DESTROY_GAME_OBJECT;
-	_requests.push_back(data);
+	PushRequest(data);
+}
+
+//register many objects taking the lock only once
+void GameEngine::RegisterGameObjects_Internal(std::vector <GameObjectData>& objects) {
+	WriteLock w_lock(object_vector_mutex);
+
+	for (int i = 0; i < objects.size(); i++) {
+		ObjectHandle handle = _objects.Insert(objects[i].name, objects[i].obj);
+		if (handle.generation != 0) {		//name not already taken
+			objects[i].obj->_setObjectHandle(handle);
+			InsertInGrid_Internal(objects[i].obj, handle, 0);
+		}
+	}
 }
 
-//it requires an exclusive mutex to protect the reading of the vector object
+//it requires an exclusive mutex to protect the reading of the registry
 void GameEngine::RegisterGameObject_Internal(GameObject* obj, EntityName name) {
 	
 	if (name == 0) {
@@ -277,14 +465,12 @@ void GameEngine::RegisterGameObject_Internal(GameObject* obj, EntityName name) {
 	}
 	WriteLock w_lock(object_vector_mutex);
 
-	auto [found, index] = FindObject_Internal(name);
-	if (found) {
+	ObjectHandle handle = _objects.Insert(name, obj);
+	if (handle.generation == 0) {		//name already taken
 		return;
 	}
-	GameObjectData data;
-	data.name = name;
-	data.obj = obj;
-	_objects.insert(_objects.begin() + index, data);
+	obj->_setObjectHandle(handle);
+	InsertInGrid_Internal(obj, handle, 0);
 }
 
 void GameEngine::RegisterLightObject_Internal(GameObject* obj, EntityName name) {
@@ -293,20 +479,15 @@ void GameEngine::RegisterLightObject_Internal(GameObject* obj, EntityName name)
 	}
 	WriteLock w_lock(object_vector_mutex);
 
-	auto [found, index] = FindObject_Internal(name);
-	if (found) {
+	ObjectHandle handle = _objects.Insert(name, obj);
+	if (handle.generation == 0) {		//name already taken
 		return;
 	}
-	GameObjectData data;
-	data.name = name;
-	data.obj = obj;
-	_objects.insert(_objects.begin() + index, data);
-
-	_lightObj.push_back(data);		//insert light object
+	obj->_setObjectHandle(handle);
+	InsertInGrid_Internal(obj, handle, GRID_LIGHT_OBJECT);
 }
 
 //create a request to register a game object. Return the name the object was registered as
-//require a mutex to protect from concurrent request creation
 EntityName GameEngine::RegisterGameObject(GameObject* obj, EntityName name) {
 
 	if (obj == nullptr)
@@ -316,17 +497,61 @@ EntityName GameEngine::RegisterGameObject(GameObject* obj, EntityName name) {
 		name = GameEngine::getInstance().GenerateRandomName();
 	}
 
-	std::lock_guard <std::mutex> guard(request_mutex);
 	RequestData data;
 	data.objectData.name = name;
 	data.objectData.obj = obj;
 	data.requestType = GameEngineRequestType::REGISTER_GAME_OBJECT;
-	_requests.push_back(data);
+	PushRequest(data);
 
 	return name;
 
 }
 
+//create a single request to register count objects. The object constructors must not call RegisterObject().
+//A name equal to 0 is replaced with a random name; the names the objects were registered as are written back in names
+void GameEngine::RegisterGameObjects(GameObject* const* objects, EntityName* names, size_t count) {
+
+	std::vector <GameObjectData>* vect = new std::vector <GameObjectData>();
+	vect->reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		if (objects[i] == nullptr) {
+			names[i] = 0;
+			continue;
+		}
+		if (names[i] == 0) {
+			names[i] = GenerateRandomName();
+		}
+		objects[i]->_setObjectName(names[i]);
+		vect->push_back({ names[i], objects[i] });
+	}
+
+	RequestData data;
+	data.objects = vect;
+	data.requestType = GameEngineRequestType::REGISTER_GAME_OBJECTS;
+	PushRequest(data);
+}
+
+//create a single request to destroy count objects
+void GameEngine::DestroyGameObjects(const EntityName* names, size_t count) {
+
+	std::vector <GameObjectData>* vect = new std::vector <GameObjectData>();
+	vect->reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		if (names[i] != 0) {
+			vect->push_back({ names[i], nullptr });
+		}
+	}
+
+	RequestData data;
+	data.objects = vect;
+	data.requestType = GameEngineRequestType::DESTROY_GAME_OBJECTS;
+	PushRequest(data);
+}
+
+void GameEngine::DestroyGameObjects(const std::vector <EntityName>& names) {
+	DestroyGameObjects(names.data(), names.size());
+}
+
 EntityName GameEngine::RegisterLightObject(LightObject* obj, EntityName name) {
 	if (obj == nullptr)
 		return 0;
@@ -335,81 +560,76 @@ EntityName GameEngine::RegisterLightObject(LightObject* obj, EntityName name) {
 		name = GameEngine::getInstance().GenerateRandomName();
 	}
 
-	std::lock_guard <std::mutex> guard(request_mutex);
 	RequestData data;
 	data.objectData.name = name;
 	data.objectData.obj = (GameObject *)obj;
 	data.requestType = GameEngineRequestType::REGISTER_LIGHT_OBJECT;
-	_requests.push_back(data);
+	PushRequest(data);
 
 	return name;
 }
 
+//return the light objects near the camera in the last frame
 std::vector <LightObject*>* GameEngine::GetLightObjects() {
-	std::vector <LightObject*>* vect = new std::vector <LightObject*>();
-	std::vector <LightObject*>& ref = *vect;
-	for (int i = 0; i < _lightObj.size(); i++) {
-		ref.push_back((LightObject*)_lightObj[i].obj);
-	}
-	return vect;
+	std::lock_guard <std::mutex> guard(visible_lights_mutex);
+	return new std::vector <LightObject*>(_visibleLights);
 }
 
 //return a pointer to a gameObject. 
 //Never store the pointer returned by this function since the object can be destroyed by other threads.
+//Store the name or the handle of the object instead
 GameObject* GameEngine::FindGameObject(EntityName name) {
 
 	ReadLock r_lock(object_vector_mutex);
-	//std::lock_guard <std::mutex> guard(object_vector_mutex);
-	
-	auto [found, index] = FindObject_Internal(name);
-	if (found) {
-		return _objects[index].obj;
-	}
+	return _objects.Find(name);
+}
 
-	return nullptr;
+//return a pointer to the gameObject referenced by the handle or nullptr if the object
+//was destroyed. Same rules of FindGameObject(EntityName) apply to the returned pointer
+GameObject* GameEngine::FindGameObject(ObjectHandle handle) {
+
+	ReadLock r_lock(object_vector_mutex);
+	return _objects.Find(handle);
 }
 
-//called only from multithread safe functions so it doesn't need a mutex
-std::pair <bool, int> GameEngine::FindObject_Internal(EntityName name) {
-	int lower = 0;
-	int upper = _objects.size() - 1;
-	int mid = lower + (upper - lower + 1) / 2;
-	while (lower <= upper) {
+//return the handle of a registered object. The handle is invalid if the object is not (yet) registered
+ObjectHandle GameEngine::GetObjectHandle(EntityName name) {
 
-		if (name == _objects[mid].name)
-		{
-			return { true, mid };
-		}
-		if (name < _objects[mid].name)
-			upper = mid - 1;
-		else
-			lower = mid + 1;
+	ReadLock r_lock(object_vector_mutex);
+	return _objects.GetHandle(name);
+}
 
-		mid = lower + (upper - lower + 1) / 2;
-	}
+//return false as soon as the object referenced by the handle is destroyed
+bool GameEngine::IsObjectAlive(ObjectHandle handle) {
 
-	return { false, mid };
+	ReadLock r_lock(object_vector_mutex);
+	return _objects.IsValid(handle);
 }
 
-//create requests to destroy every game object. This is called from PollRequests()
-//that run in the update thread
+//destroy every game object in linear time. The objects are still retired, not deleted right away.
+//This is called from PollRequests() that run in the update thread
 void GameEngine::ClearGameObjects_Internal(void) {
 
-	ReadLock r_lock(object_vector_mutex);
-	for (int i = 0; i < _objects.size(); i++) {
-		DestroyGameObject(_objects[i].name);
+	WriteLock w_lock(object_vector_mutex);
+	std::vector <GameObjectData> objects;
+	_objects.Clear(objects);
+	_grid.Clear();
+
+	std::vector <GameObject*> removed;
+	removed.reserve(objects.size());
+	for (int i = 0; i < objects.size(); i++) {
+		removed.push_back(objects[i].obj);
 	}
+	ReleaseObjects_Internal(removed);
 }
 
 //this function create a request to clear all game objects from memory
 //this function is called from the logic thread when a new scene is loaded
-//require a mutex for concurrent request creation
 void GameEngine::ClearGameObjects(void) {
 
-	std::lock_guard <std::mutex> guard(request_mutex);
 	RequestData data;
 	data.requestType = GameEngineRequestType::DESTROY_ALL;
-	_requests.push_back(data);
+	PushRequest(data);
 }
 
 //create a scene object. Are required all 4 parameters
@@ -431,13 +651,12 @@ void GameEngine::CreateScene(Scene *scene) {
 void GameEngine::LoadScene(int sceneId) {
 
 	std::lock_guard <std::mutex> guard(scene_mutex);
-	std::lock_guard <std::mutex> guard1(request_mutex);
 	RequestData data;
 	for (int i = 0; i < scenes.size(); i++) {
 		if (scenes[i]->getID() == sceneId) {		//set scene to load
 			data.scene = scenes[i];
 			data.requestType = GameEngineRequestType::LOAD_SCENE;
-			_requests.push_back(data);
+			PushRequest(data);
 			_sceneReady = false;		//lock the logic thread
 			return;
 		}
@@ -485,7 +704,10 @@ void GameEngine::LoadScene_Internal() {
 		return;
 	}
 	
-	currentScene->onload();		//load next scene
+	{
+		RequestBatch batch;		//submit all the objects created by the scene at once
+		currentScene->onload();		//load next scene
+	}
 	currentScene->InitLoadingStateCalc();
 
 	_freeingScene = false;
@@ -493,35 +715,6 @@ void GameEngine::LoadScene_Internal() {
 
 }
 
-//sleeps for the time needed to have a FPS. Returns the time it have sleeped
-double GameEngine::limit_fps(double elapsedTime, double maxFPS) {
-	if (elapsedTime >= (1.0 / maxFPS)) {
-		return 0;
-	}
-	else {
-		std::this_thread::sleep_for(std::chrono::microseconds((long long)(((1.0 / maxFPS) - elapsedTime) * 1000000.0)));
-		return ((1.0 / maxFPS) - elapsedTime);
-	}
-}
-
-//destroy the objects in the garbage collection after few frames from insertion. 
-//the delay is needed to prevent the distruction of a object referenced somewhere in the game 
-//(expecially due to the FindGameObject() function)
-//there is no need to have a mutex in here since the only function that can add elements to the garbage collection
-//is DestroyGameObject_Internal which is also called from the update thread.
-void GameEngine::ThrowTheGarbage() {
-	
-	for (int i = 0; i < _garbageCollector.size(); i++) {
-		_garbageCollector[i].second--;
-		if (_garbageCollector[i].second < 0) {		//time to destroy the object
-			delete _garbageCollector[i].first;
-			_garbageCollector.erase(_garbageCollector.begin() + i);
-			--i;
-		}
-	}
-}
-
-
 vector2 GameEngine::MousePosition() {
 	return _mousePosition;
 }
@@ -537,56 +730,173 @@ void GameEngine::updateMouse() {
 	_mousePosition = GraphicsEngine::getInstance().screenToSpace(mouse.first, mouse.second);
 }
 
+//average fps of the last frames
 double GameEngine::GetRenderFPS() {
-	return renderCurrentFPS;
+	return _renderPacer.GetStats().averageFPS;
 }
 
 double GameEngine::GetGameFPS() {
-	return gameCurrentFPS;
+	return _gamePacer.GetStats().averageFPS;
+}
+
+FrameStats GameEngine::GetRenderFrameStats() {
+	return _renderPacer.GetStats();
+}
+
+FrameStats GameEngine::GetGameFrameStats() {
+	return _gamePacer.GetStats();
+}
+
+//pace the render thread to the refresh rate of the display instead of the render fps
+void GameEngine::PaceRenderToDisplay(bool enable) {
+	_paceToDisplay = enable;
+}
+
+//tasks that determined the duration of the last frame, in execution order
+std::vector <TaskTiming> GameEngine::GetFrameCriticalPath() {
+	std::lock_guard <std::mutex> guard(frame_stats_mutex);
+	return _criticalPath;
+}
+
+//time spent in every task of the frame graph (update, draw, physics phases...) since the start or the last reset
+std::vector <TaskStats> GameEngine::GetPhaseStats() {
+	std::lock_guard <std::mutex> guard(frame_stats_mutex);
+	return _phaseStats;
+}
+
+void GameEngine::ResetPhaseStats() {
+	std::lock_guard <std::mutex> guard(frame_stats_mutex);
+	_phaseStats.clear();
+}
+
+//run a parallel loop: inside a task of the frame the loop is added to the frame graph, otherwise it runs on the helpers pool
+//if it's free or on the calling thread
+void GameEngine::_ParallelRun(int count, void(*function)(int start_index, int end_index, void* args), void* args) {
+	if (TaskGraph::RunNested("parallel for", function, args, count)) {
+		return;
+	}
+	if (_helperManager != nullptr && _helperManager->tryRun(count, function, args)) {
+		return;
+	}
+	function(0, count, args);
+}
+
+void parallel_run(int count, void(*function)(int start_index, int end_index, void* args), void* args) {
+	GameEngine::getInstance()._ParallelRun(count, function, args);
+}
+
+//time spent working by the game thread (worker 0) and by every helper since the start or the last reset
+std::vector <WorkerStats> GameEngine::GetWorkerStats() {
+	std::vector <WorkerStats> stats;
+	std::lock_guard <std::mutex> guard(frame_stats_mutex);
+	if (_helperManager != nullptr) {
+		_helperManager->GetWorkerStats(stats);
+	}
+	return stats;
+}
+
+void GameEngine::ResetWorkerStats() {
+	std::lock_guard <std::mutex> guard(frame_stats_mutex);
+	if (_helperManager != nullptr) {
+		_helperManager->ResetWorkerStats();
+	}
+}
+
+//return the number of requests created and the number of requests already handled
+GameEngine::RequestCounters GameEngine::GetRequestCounters() {
+	RequestCounters c;
+	c.completed = _completedRequests.load();	//read the completed first so that completed <= submitted
+	c.submitted = _submittedRequests.load();
+	return c;
+}
+
+//return the number of requests created but not handled yet, including the ones still buffered in a RequestBatch
+unsigned long GameEngine::GetPendingRequests() {
+	RequestCounters c = GetRequestCounters();
+	return c.submitted - c.completed;
 }
 
 unsigned long GameEngine::GetTaskQueueLen() {
-	return _requests.size();
+	return GetPendingRequests();
 }
 
 void GameEngine::SetGameFPS(double fps){
 	gameFPS = fps;
 }
 
+//In fixed timestep mode the simulation (animations, updates and physics) advances by steps of 1/tickRate seconds.
+//Each game loop runs the steps accumulated since the previous loop, up to maxTicksPerLoop (the rest is dropped
+//when the machine can't keep up) and the render thread interpolates between the last two steps.
+//The game loop is limited to tickRate instead of the game fps
+void GameEngine::SetFixedTimestep(bool enable, double tickRate, int maxTicksPerLoop) {
+	if (tickRate <= 0 || maxTicksPerLoop <= 0) {
+		return;
+	}
+	_tickRate = tickRate;
+	_maxTicksPerLoop = maxTicksPerLoop;
+	_fixedTimestep = enable;
+}
+
+bool GameEngine::IsFixedTimestep() {
+	return _fixedTimestep;
+}
+
+bool GameEngine::IsHeadless() {
+	return _headless;
+}
+
 //all the calls to sdl libraries must be done from this thread
 void GameEngine::mainThread() {
-	double elapsedTime = 0;
-
-	while (true) {
+	EpochManager::getInstance().RegisterThread();
+	PROFILE_THREAD_NAME("render");
+	_renderPacer.Start();
+
+	while (gameRunning) {
+		EpochManager::getInstance().QuiescentPoint();		//the render thread holds no game object here
+
+		double targetFPS = this->renderFPS;
+		if (_paceToDisplay && !_headless) {
+			int refreshRate = GraphicsEngine::getInstance().GetDisplayRefreshRate();
+			if (refreshRate > 0) {
+				targetFPS = refreshRate;
+			}
+		}
+		_renderPacer.SetTargetFPS(targetFPS);
 
-		auto startTime = std::chrono::high_resolution_clock::now();
-		InputEngine::getInstance().beginNewFrame();
+		if (!_headless) {
+			InputEngine::getInstance().beginNewFrame();
+		}
 
 		//_syncBarrier->wait();	//syncs with the game thread
 
-		AudioEngine::getInstance().PollRequests();
+		{
+			PROFILE_SCOPE("audio requests");
+			AudioEngine::getInstance().PollRequests();
+		}
 
 		if (InputEngine::getInstance().GetLastEvent() == InputEvent::QUIT_APP) {
 			_lastGameEvent = GameEvent::GAME_QUIT;
 		}
 
 		GraphicsEngine::getInstance().SwapScreenBuffersGraphics();
-		GraphicsEngine::getInstance().Flip();
-
-		auto endTime = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double> elapsed = endTime - startTime;
-		elapsedTime = elapsed.count();	//elapsed time in seconds
+		{
+			PROFILE_SCOPE("Flip");
+			GraphicsEngine::getInstance().Flip();
+		}
 
-		GraphicsEngine::getInstance().CompleteLightBaking();	//finish light baking
-		GraphicsEngine::getInstance().PollRequests((1.0/renderFPS) - elapsedTime);	//handle graphics requests
+		{
+			PROFILE_SCOPE("CompleteLightBaking");
+			GraphicsEngine::getInstance().CompleteLightBaking();	//finish light baking
+		}
+		{
+			PROFILE_SCOPE("graphics requests");
+			GraphicsEngine::getInstance().PollRequests(_renderPacer.TimeLeft());	//handle graphics requests
+		}
 
-		endTime = std::chrono::high_resolution_clock::now();
-		elapsed = endTime - startTime;
-		elapsedTime = elapsed.count();	//elapsed time in seconds
-		
-		if (this->lockRenderFPS) elapsedTime += this->limit_fps(elapsedTime, this->renderFPS);		//limits the fps
-		renderCurrentFPS = 1.0 / elapsedTime;
+		PROFILE_SCOPE("render pacing");
+		_renderPacer.EndFrame(this->lockRenderFPS);		//limits the fps
 	}
+	EpochManager::getInstance().UnregisterThread();
 }
 
 void GameEngine::animation_helper_routine(int start_index, int end_index, void* args) {
@@ -595,6 +905,9 @@ void GameEngine::animation_helper_routine(int start_index, int end_index, void*
 	double elapsedTime = data->elapsedTime;
 	
 	for (int i = start_index; i < end_index; i++) {
+		if (data->saveTransform) {
+			vect[i].obj->_savePrevTransform();
+		}
 		vect[i].obj->MainAnimationUpdate(elapsedTime);
 	}
 }
@@ -613,6 +926,7 @@ void GameEngine::update_helper_routine(int start_index, int end_index, void* arg
 	UpdateHelperData* data = (UpdateHelperData*)args;
 	std::vector <GameObjectData>& vect = *data->objects;
 	double elapsedTime = data->elapsedTime;
+	RequestBatch batch;		//objects spawned or destroyed during the update are submitted together
 
 	for (int i = start_index; i < end_index; i++) {
 		vect[i].obj->mainUpdate(elapsedTime);
@@ -624,150 +938,410 @@ void GameEngine::post_update_helper_routine(int start_index, int end_index, void
 	std::vector <GameObjectData>& vect = *data->objects;
 	double elapsedTime = data->elapsedTime;
 
+	GameEngine& engine = GameEngine::getInstance();
+	SpatialGrid& grid = engine._grid;
+	std::vector <GridUpdate> updates;
+
 	for (int i = start_index; i < end_index; i++) {
 		vect[i].obj->mainPostUpdate(elapsedTime);
 	}
+
+	//the grid is written by the grid task after the post update: the chunks only record the new positions,
+	//so they never block each other or the scene queries. The flags don't change while the frame runs
+	updates.reserve(end_index - start_index);
+	for (int i = start_index; i < end_index; i++) {
+		GameObject* obj = vect[i].obj;
+		uint32_t id = obj->getObjectHandle().index;
+		updates.push_back({ id, obj->transform.position, cullRadius(obj, grid.GetFlags(id)) });
+	}
+
+	std::lock_guard <std::mutex> guard(engine.grid_updates_mutex);
+	engine._gridUpdates.insert(engine._gridUpdates.end(), updates.begin(), updates.end());
 }
 
 void GameEngine::draw_helper_routine(int start_index, int end_index, void* args) {
 	DrawHelperData* data = (DrawHelperData*)args;
-	std::vector <GameObjectData>& vect = *data->objects;
+	std::vector <GameObject*>& vect = *data->objects;
 	double maxRenderDistance = data->maxRenderRadius;
 	vector2 camPos = data->cameraPos;
 
 	for (int i = start_index; i < end_index; i++) {
-		double maxScale = std::max(vect[i].obj->transform.scale.x(), vect[i].obj->transform.scale.y()) * 1.5 / 2.0;
-		vector2 objPos = vect[i].obj->transform.position;
+		double maxScale = std::max(vect[i]->transform.scale.x(), vect[i]->transform.scale.y()) * 1.5 / 2.0;
+		vector2 objPos = vect[i]->transform.position;
 		double distance = sqrt((camPos.x - objPos.x) * (camPos.x - objPos.x) + (camPos.y - objPos.y) * (camPos.y - objPos.y));
-		if (distance - maxScale <= maxRenderDistance)
-			vect[i].obj->mainDraw();
+		if (distance - maxScale > maxRenderDistance)
+			continue;
+		if (data->interpolate) {
+			GraphicsEngine::getInstance()._setBlitDelta(vect[i]->_getTransformDelta());
+		}
+		vect[i]->mainDraw();
+	}
+	if (data->interpolate) {
+		GraphicsEngine::getInstance()._setBlitDelta({});
 	}
 }
 
 void GameEngine::physics_helper_routine(int start_index, int end_index, void* args) {
 
 	PhysicsHelperData* d = (PhysicsHelperData*)args;
-	PhysicsEngine::getInstance().UpdatePhysics(d->timeElapsed, start_index, d->threads);
+	for (int i = start_index; i < end_index; i++) {
+		PhysicsEngine::getInstance().UpdatePhysics(d->timeElapsed, i);
+	}
+
+}
+
+//scene callback, or loading of the next scene. Runs on the game thread
+void GameEngine::scene_task_routine(int start_index, int end_index, void* args) {
+	FrameTaskData* data = (FrameTaskData*)args;
+	GameEngine& engine = GameEngine::getInstance();
+
+	if (engine._sceneReady) {
+		RequestBatch batch;
+		engine.currentScene->scene_callback(engine._lastGameEvent, data->update.elapsedTime);	//scene callback routine
+	}
+	else {
+		if (engine._freeingScene) {		//is in the process of freeing the previous scene
+			//if all objects in the prevous scene were destroyed
+			if (engine.GetPendingRequests() == 0) {
+				engine.LoadScene_Internal();
+			}
+
+		}
+		if (engine._lastGameEvent == GameEvent::GAME_QUIT) {
+			engine.Quit();
+		}
+	}
+}
+
+//split the objects for the post update. The objects that can't move a rigidbody are post updated
+//while the physics is already running
+void GameEngine::partition_task_routine(int start_index, int end_index, void* args) {
+	FrameTaskData* data = (FrameTaskData*)args;
+	GameEngine& engine = GameEngine::getInstance();
+	std::vector <GameObjectData>& objects = *data->update.objects;
+
+	engine._physicsObjects.clear();
+	engine._otherObjects.clear();
+	for (int i = 0; i < objects.size(); i++) {
+		GameObject* obj = objects[i].obj;
+		if (obj->GetRigidbody() != nullptr || obj->_hasConstraintParent()) {
+			engine._physicsObjects.push_back(objects[i]);
+		}
+		else {
+			engine._otherObjects.push_back(objects[i]);
+		}
+	}
+	engine._frameGraph.SetTaskCount(data->postUpdatePhysicsTask, engine._physicsObjects.size());
+	engine._frameGraph.SetTaskCount(data->postUpdateTask, engine._otherObjects.size());
+}
+
+void GameEngine::grid_task_routine(int start_index, int end_index, void* args) {
+	GameEngine::getInstance().UpdateGrid_Internal();
+}
+
+void GameEngine::gui_task_routine(int start_index, int end_index, void* args) {
+	GUIEngine::getInstance().beginNewFrame();	//handle gui events
+}
+
+//find the objects near the camera and set the size of the draw task
+void GameEngine::draw_prepare_task_routine(int start_index, int end_index, void* args) {
+	FrameTaskData* data = (FrameTaskData*)args;
+	GameEngine& engine = GameEngine::getInstance();
+
+	//save the current state of the camera for rendering to avoid gliches when a object is parented to the camera
+	data->camera = engine.FindGameObject(DecodeName("MainCamera"));
+	if (data->camera == nullptr) {
+		GraphicsEngine::getInstance().updateRenderCamera(false, { 0, 0 }, { 0, 0 }, 0);
+		engine._frameGraph.SetTaskCount(data->drawTask, 0);
+		return;
+	}
+
+	vector2 camScale = data->camera->transform.scale;
+	vector2 camPos = data->camera->transform.position;
+	DrawHelperData& d_data = data->draw;
+	d_data.objects = &engine._drawList;
+	d_data.maxRenderRadius = sqrt(camScale.x * camScale.x / 4.0 + camScale.y * camScale.y / 4.0);
+	d_data.cameraPos = camPos;
+	engine._cameraZone = engine._grid.PosToZone(camPos);
+	engine._cameraZoneValid = true;
+
+	//only the zones around the camera are visited. No lock: the grid task that writes the grid is done,
+	//and the requests that insert and remove objects run after the draw
+	AABB view = { { camPos.x - d_data.maxRenderRadius, camPos.y - d_data.maxRenderRadius },
+		{ camPos.x + d_data.maxRenderRadius, camPos.y + d_data.maxRenderRadius } };
+	engine._drawList.clear();
+	engine._grid.Query(view, engine._drawList);
+
+	std::vector <GameObject*> lights;
+	engine._grid.Query(view, lights, GRID_LIGHT_OBJECT);
+	{
+		std::lock_guard <std::mutex> guard(engine.visible_lights_mutex);
+		engine._visibleLights.clear();
+		for (int i = 0; i < lights.size(); i++) {
+			engine._visibleLights.push_back((LightObject*)lights[i]);
+		}
+	}
 
+	engine._frameGraph.SetTaskCount(data->drawTask, engine._drawList.size());
+}
+
+//hand the frame to the render thread
+void GameEngine::draw_finish_task_routine(int start_index, int end_index, void* args) {
+	FrameTaskData* data = (FrameTaskData*)args;
+	GameObject* camera = data->camera;
+	if (camera == nullptr) {
+		return;
+	}
+
+	TransformStruct camDelta = {};
+	if (data->draw.interpolate) {
+		camDelta = camera->_getTransformDelta();
+	}
+	GraphicsEngine::getInstance().updateRenderCamera(true, camera->transform.position, camera->transform.scale, camera->transform.rotation, camDelta);
+
+	GraphicsEngine::getInstance().SwapScreenBuffersPhysics();	//swap buffers
+}
+
+void GameEngine::physics_frame_task_routine(int start_index, int end_index, void* args) {
+	FrameTaskData* data = (FrameTaskData*)args;
+	PhysicsEngine::getInstance().NewPhysicsFrame(data->physics.timeElapsed, data->physics.threads);
+	GameEngine::getInstance()._frameGraph.SetTaskCount(data->narrowphaseTask, PhysicsEngine::getInstance().GetNarrowphaseChunks());
+}
+
+void GameEngine::physics_tree_task_routine(int start_index, int end_index, void* args) {
+	PhysicsEngine::getInstance().UpdateQueryTree();
+}
+
+void GameEngine::physics_resolve_task_routine(int start_index, int end_index, void* args) {
+	FrameTaskData* data = (FrameTaskData*)args;
+	PhysicsEngine::getInstance().ResolvePhysics(data->physics.timeElapsed);
+}
+
+//handle the requests in the time left in the frame. Runs on the game thread
+void GameEngine::requests_task_routine(int start_index, int end_index, void* args) {
+	GameEngine::getInstance().PollRequests(GameEngine::getInstance()._gamePacer.TimeLeft());		//handle game engine requests
+}
+
+//idle work of the helpers pool: one background job at a time, so the helper is soon back for the frame jobs
+bool GameEngine::background_job_routine(void* args) {
+	return JobSystem::getInstance().RunNextJob();
+}
+
+//add to the frame graph the update of the game objects and the physics step. Returns the id of the last task
+//that changes the game objects: the draw can't start before it.
+//The post update of the objects without a rigidbody overlaps the physics, the gui events overlap the post update and the draw
+int GameEngine::addUpdateTasks(FrameTaskData& data, double elapsedTime, bool saveTransform) {
+	std::vector <GameObjectData>& objects = _objects.GetObjects();
+	data.update = { &objects, elapsedTime, saveTransform };
+	data.physicsObjects = { &_physicsObjects, elapsedTime, saveTransform };
+	data.otherObjects = { &_otherObjects, elapsedTime, saveTransform };
+	data.physics = { elapsedTime, _helperCount + 1 };
+
+	int count = objects.size();
+	int animation = _frameGraph.AddTask("animation", animation_helper_routine, &data.update, count);
+	int scene = _frameGraph.AddTask("scene", scene_task_routine, &data, 1, true);
+	int preUpdate = _frameGraph.AddTask("pre update", pre_update_helper_routine, &data.update, count);	//translation update for rigid bodies
+	int tree = _frameGraph.AddTask("physics tree", physics_tree_task_routine, &data, 1);		//the bodies moved by the pre update, for the scene queries
+	int update = _frameGraph.AddTask("update", update_helper_routine, &data.update, count);
+	int partition = _frameGraph.AddTask("split objects", partition_task_routine, &data, 1);
+	data.postUpdatePhysicsTask = _frameGraph.AddTask("post update physics", post_update_helper_routine, &data.physicsObjects, 0);	//parenting and stuff
+	data.postUpdateTask = _frameGraph.AddTask("post update", post_update_helper_routine, &data.otherObjects, 0);
+	int grid = _frameGraph.AddTask("grid", grid_task_routine, &data, 1);
+	int gui = _frameGraph.AddTask("gui", gui_task_routine, &data, 1, true);
+	int physicsFrame = _frameGraph.AddTask("physics frame", physics_frame_task_routine, &data, 1);
+	data.narrowphaseTask = _frameGraph.AddTask("narrowphase", physics_helper_routine, &data.physics, 0);		//chunks of pairs with the same cost
+	data.resolveTask = _frameGraph.AddTask("physics resolve", physics_resolve_task_routine, &data, 1);
+
+	_frameGraph.AddDependency(preUpdate, animation);
+	_frameGraph.AddDependency(preUpdate, scene);
+	_frameGraph.AddDependency(tree, preUpdate);
+	_frameGraph.AddDependency(update, tree);
+	_frameGraph.AddDependency(partition, update);
+	_frameGraph.AddDependency(gui, update);
+	_frameGraph.AddDependency(data.postUpdatePhysicsTask, partition);
+	_frameGraph.AddDependency(data.postUpdateTask, partition);
+	_frameGraph.AddDependency(grid, data.postUpdatePhysicsTask);
+	_frameGraph.AddDependency(grid, data.postUpdateTask);
+	_frameGraph.AddDependency(physicsFrame, data.postUpdatePhysicsTask);
+	_frameGraph.AddDependency(data.narrowphaseTask, physicsFrame);
+	_frameGraph.AddDependency(data.resolveTask, data.narrowphaseTask);
+	_frameGraph.AddDependency(data.resolveTask, grid);		//the post update of the children reads the bodies moved by the resolve
+	return grid;
+}
+
+//add to the frame graph the draw of the objects near the camera, starting after the task "after" (-1 for none).
+//Returns the id of the task that hands the frame to the render thread
+int GameEngine::addDrawTasks(FrameTaskData& data, bool interpolate, int after) {
+	data.camera = nullptr;
+	data.draw.interpolate = interpolate;
+
+	int prepare = _frameGraph.AddTask("draw prepare", draw_prepare_task_routine, &data, 1);
+	data.drawTask = _frameGraph.AddTask("draw", draw_helper_routine, &data.draw, 0);
+	int finish = _frameGraph.AddTask("draw finish", draw_finish_task_routine, &data, 1);
+
+	if (after != -1) {
+		_frameGraph.AddDependency(prepare, after);
+	}
+	_frameGraph.AddDependency(data.drawTask, prepare);
+	_frameGraph.AddDependency(finish, data.drawTask);
+	return finish;
+}
+
+//run the graph built and record its critical path
+void GameEngine::runFrameGraph(FrameTaskData& data) {
+	_frameGraph.Run(_helperManager, _helperCount);
+	_frameGraph.GetCriticalPath(_frameCriticalPath, data.frameStart);
+	{
+		std::lock_guard <std::mutex> guard(frame_stats_mutex);
+		_frameGraph.AddTaskStats(_phaseStats);
+	}
+	_frameGraph.Clear();
 }
 
 //game thread. From this thread are called all method of the game objects related to the game logic.
-//Also it handles the garbage collector of the game engine and calls the 
+//Also it frees the destroyed objects (see EpochManager) and calls the 
 //function that handle all game engine requests.
+//Every frame is run as a graph of tasks (see TaskGraph) so that independent phases overlap
 void GameEngine::gameThread() {
 	double elapsedTime = 0;
+	double accumulator = 0;		//simulation time not consumed yet in fixed timestep mode
+	if (_pinThreads) {
+		PinCurrentThread(_gameCpus);
+	}
+	EpochManager::getInstance().RegisterThread();
+	PROFILE_THREAD_NAME("game");
+	FrameTaskData data;
+	unsigned long frames = 0;
+	_gamePacer.Start();
 
-	while (true) {
+	while (gameRunning) {
 		auto startTime = std::chrono::high_resolution_clock::now();
 		elapsedTime *= this->gameSpeed;	//modify game speed
 
 		//_syncBarrier->wait();		//syncs with the render thread
 
-		ThrowTheGarbage();
+		{
+			PROFILE_SCOPE("collect");
+			EpochManager::getInstance().Collect();		//quiescent point: free the objects destroyed in the previous frames
+		}
 		updateMouse();
 
-		UpdateHelperData data; data.objects = &_objects; data.elapsedTime = elapsedTime;
-		_helperManager->startWork(_objects.size(), animation_helper_routine, &data);
+		bool fixedTimestep = _fixedTimestep;
+		double loopFPS = this->gameFPS;
+		_frameCriticalPath.clear();
+		data.frameStart = startTime;
+
+		if (fixedTimestep) {
+			double step = 1.0 / _tickRate;
+			int maxTicks = _maxTicksPerLoop;
+			GraphicsEngine::getInstance().SetInterpolationStep(step);
+			loopFPS = _tickRate;
+			_gamePacer.SetTargetFPS(loopFPS);
+
+			accumulator += elapsedTime;
+			int ticks = 0;
+			while (accumulator >= step && ticks < maxTicks) {
+				PROFILE_SCOPE("tick");
+				addUpdateTasks(data, step, true);		//a tick must be completed before the next one starts
+				runFrameGraph(data);
+				accumulator -= step;
+				ticks++;
+			}
+			if (accumulator >= step) {		//too slow to keep up: drop the time left behind
+				accumulator = fmod(accumulator, step);
+			}
 
-		if (_sceneReady) {
-			currentScene->scene_callback(_lastGameEvent, elapsedTime);	//scene callback routine
+			int requests = _frameGraph.AddTask("requests", requests_task_routine, &data, 1, true);
+			if (ticks > 0) {
+				_frameGraph.AddDependency(requests, addDrawTasks(data, true, -1));
+			}
+			runFrameGraph(data);
 		}
 		else {
-			if (_freeingScene) {		//is in the process of freeing the previous scene
-				//if all objects in the prevous scene were destroyed
-				if (_requests.size() == 0) {
-					LoadScene_Internal();
-				}
+			GraphicsEngine::getInstance().SetInterpolationStep(0);
+			_gamePacer.SetTargetFPS(loopFPS);
+			accumulator = 0;
+
+			//the narrowphase overlaps the draw and the requests overlap the physics resolve
+			int updated = addUpdateTasks(data, elapsedTime, false);
+			int drawn = addDrawTasks(data, false, updated);
+			_frameGraph.AddDependency(data.resolveTask, drawn);		//the resolve moves the objects being drawn
+			int requests = _frameGraph.AddTask("requests", requests_task_routine, &data, 1, true);
+			_frameGraph.AddDependency(requests, drawn);
+			runFrameGraph(data);
+		}
+		PhysicsEngine::getInstance().ApplyBodyChanges();		//rigidbodies added or removed by the requests
+		PhysicsEngine::getInstance().UpdateQueryTree();		//drop the removed bodies from the scene queries before they are freed
 
+		{
+			PROFILE_SCOPE("background jobs");
+			if (_helperCount < 2) {		//no helper to run the background jobs: use the time left in the frame, at least one job per frame
+				while (JobSystem::getInstance().RunNextJob() && _gamePacer.TimeLeft() > 0);
 			}
-			if (_lastGameEvent == GameEvent::GAME_QUIT) {
-				GameEngine::getInstance().Quit();
-			}
+			JobSystem::getInstance().DeliverCompletions();
 		}
 
-		_helperManager->Wait();	//wait until the end of animation update
-
-		_helperManager->startWork(_objects.size(), pre_update_helper_routine, &data);	//start object pre update (translation update for rigid bodies)
-		_helperManager->Wait();
-
-		_helperManager->startWork(_objects.size(), update_helper_routine, &data);	//start object update
-		_helperManager->Wait();
-
-		_helperManager->startWork(_objects.size(), post_update_helper_routine, &data);	//start post update (parenting and stuff)
-		GUIEngine::getInstance().beginNewFrame();	//handle gui events
-		_helperManager->Wait();
-
-		//save the current state of the camera for rendering to avoid gliches when a object is parented to the camera
-		GameObject* camera = this->FindGameObject(DecodeName("MainCamera"));
-		if (camera == nullptr) {
-			GraphicsEngine::getInstance().updateRenderCamera(false, { 0, 0 }, { 0, 0 }, 0);
+		{
+			std::lock_guard <std::mutex> guard(frame_stats_mutex);
+			_criticalPath.swap(_frameCriticalPath);
 		}
-		else {
-			vector2 camScale = camera->transform.scale;
-			vector2 camPos = camera->transform.position;
-			DrawHelperData d_data;
-			d_data.objects = &_objects;
-			d_data.maxRenderRadius = sqrt(camScale.x * camScale.x / 4.0 + camScale.y * camScale.y / 4.0);
-			d_data.cameraPos = camera->transform.position;
-
-			_helperManager->startWork(_objects.size(), draw_helper_routine, &d_data);		//start draw
-			_helperManager->Wait();
 
-			GraphicsEngine::getInstance().updateRenderCamera(true, camPos, camScale, camera->transform.rotation);
-
-			GraphicsEngine::getInstance().SwapScreenBuffersPhysics();	//swap buffers
+		PROFILE_SCOPE("game pacing");
+		elapsedTime = _gamePacer.EndFrame(this->lockGameFPS);		//limits the fps
 
+		if (_frameLimit > 0 && ++frames >= _frameLimit) {
+			gameRunning = false;		//the render thread stops too and GameEngine_Start returns
 		}
+	}
+	EpochManager::getInstance().UnregisterThread();
 
-		//update physics
-		PhysicsHelperData p_data = { elapsedTime, _helperCount };
-		PhysicsEngine::getInstance().NewPhysicsFrame(elapsedTime);
-		_helperManager->startWork(_helperCount, physics_helper_routine, &p_data);
-		_helperManager->Wait();
-		PhysicsEngine::getInstance().ResolvePhysics(elapsedTime);
-
-
-		auto endTime = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double> elapsed = endTime - startTime;
-		elapsedTime = elapsed.count();	//elapsed time in seconds
+}
 
-		PollRequests((1.0/gameFPS) - elapsedTime);		//handle game engine requests
+//queue a request for the game thread. Requests are buffered if the calling thread has an open RequestBatch
+void GameEngine::PushRequest(const RequestData& request) {
+	_submittedRequests++;
+	if (_threadRequestBuffer != nullptr) {
+		_threadRequestBuffer->items.push_back(request);
+		return;
+	}
+	_requests.Push(request);
+}
 
-		endTime = std::chrono::high_resolution_clock::now();
-		elapsed = endTime - startTime;
-		elapsedTime = elapsed.count();	//elapsed time in seconds
-		
-		if (this->lockGameFPS) elapsedTime += this->limit_fps(elapsedTime, this->gameFPS);		//limits the fps
-		gameCurrentFPS = 1.0 / elapsedTime;
+GameEngine::RequestBatch::RequestBatch() {
+	if (_threadBatchDepth++ == 0) {
+		_threadRequestBuffer = GameEngine::getInstance()._requests.NewBlock();
 	}
+}
 
+GameEngine::RequestBatch::~RequestBatch() {
+	if (--_threadBatchDepth == 0) {
+		RequestBlock* block = _threadRequestBuffer;
+		_threadRequestBuffer = nullptr;
+		GameEngine::getInstance()._requests.PushBlock(block);		//submit all the requests at once
+	}
 }
 
+//handles the requests for a maximum amount of time. The requests that don't fit
+//in the time budget are kept for the next frame. Runs on the game thread
 void GameEngine::PollRequests(double timeLeft) {
+	PROFILE_SCOPE("PollRequests");
 	
 	int block = 0;
 	auto startTime = std::chrono::high_resolution_clock::now();
 
-	request_mutex.lock();
+	_requests.Drain(_pendingRequests);
 	if (timeLeft <= 0) {
 		timeLeft = 0.001;		//bonus of 1ms to handle some requests when it's busy
 	}
 		
-	while (timeLeft > 0 && _requests.size() > 0) {
-		RequestData request = _requests[0];
-		_requests.erase(_requests.begin());
+	while (timeLeft > 0 && _pendingHead < _pendingRequests.size()) {
+		RequestData request = _pendingRequests[_pendingHead++];
 		
 		switch (request.requestType) {
 		case GameEngineRequestType::LOAD_SCENE:
 		{
-			//have to unlock the mutex every time since LoadScene_Internal locks request_mutex
-			request_mutex.unlock();
 			Scene* scene = request.scene;
 			ChangeScene_Internal(scene);
-			//std::thread t(&GameEngine::LoadScene_Internal, this, scene);
-			//t.detach();
-			//LoadScene_Internal(request.sceneData);
-			request_mutex.lock();
 			break;
 		}
 
@@ -787,29 +1361,44 @@ void GameEngine::PollRequests(double timeLeft) {
 			break;
 		}
 
+		case GameEngineRequestType::REGISTER_GAME_OBJECTS:
+		{
+			RegisterGameObjects_Internal(*request.objects);
+			delete request.objects;
+			break;
+		}
+		case GameEngineRequestType::DESTROY_GAME_OBJECTS:
+		{
+			DestroyGameObjects_Internal(*request.objects);
+			delete request.objects;
+			break;
+		}
+
 		case GameEngineRequestType::DESTROY_ALL:
 		{
-			//have to unlock the mutex every time since ClearGameObjects_Internal locks request_mutex
-			request_mutex.unlock();		//have to unlock the mutex every time 
 			ClearGameObjects_Internal();
-			request_mutex.lock();
 			break;
 		}
 		};
+		_completedRequests++;
 
 		block++;
 		if (block > 10) {		//check the clock every few requests
-			request_mutex.unlock();		//leave some time for other threads
-			request_mutex.lock();
 			auto endTime = std::chrono::high_resolution_clock::now();
 			std::chrono::duration<double> elapsed = endTime - startTime;
 			double elapsedTime = elapsed.count();	//elapsed time in seconds
 			timeLeft -= elapsedTime;
+			startTime = endTime;
 			block = 0;
 		}
 	}
 
-	request_mutex.unlock();
-
+	if (_pendingHead == _pendingRequests.size()) {
+		_pendingRequests.clear();
+		_pendingHead = 0;
+	}
+	else if (_pendingHead > _pendingRequests.size() / 2) {		//drop the handled requests without shifting every frame
+		_pendingRequests.erase(_pendingRequests.begin(), _pendingRequests.begin() + _pendingHead);
+		_pendingHead = 0;
+	}
 }
-
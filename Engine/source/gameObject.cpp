@@ -21,12 +21,14 @@ GameObject::GameObject(){
 	animated = false;
 	_texture = nullptr;
 	rigidbody = nullptr;
+	_objectHandle = ObjectHandle{};
 	group = 0x1;
 	_layer = 0;
 
 	transform.position = {0, 0};
 	transform.scale = { 1, 1 };
 	transform.rotation = 0;
+	_prevTransform = transform;
 }
 
 
@@ -73,6 +75,37 @@ EntityName GameObject::getObjectName() {
 	return _objectName;
 }
 
+//return the handle of the object. The handle is invalid until the game engine processed the registration
+//and becomes invalid again once the object is destroyed
+ObjectHandle GameObject::getObjectHandle() {
+	return _objectHandle;
+}
+
+void GameObject::_setObjectHandle(ObjectHandle handle) {
+	_objectHandle = handle;
+}
+
+void GameObject::_setObjectName(EntityName name) {
+	_objectName = name;
+}
+
+//save the transform at the start of a fixed simulation step
+void GameObject::_savePrevTransform() {
+	_prevTransform = transform;
+}
+
+//movement since the start of the last fixed simulation step
+TransformStruct GameObject::_getTransformDelta() {
+	TransformStruct current = transform;
+	TransformStruct delta;
+	delta.position = { current.position.x - _prevTransform.position.x, current.position.y - _prevTransform.position.y };
+	delta.scale = { current.scale.x - _prevTransform.scale.x, current.scale.y - _prevTransform.scale.y };
+	delta.rotation = fmod(current.rotation - _prevTransform.rotation, 360.0);
+	if (delta.rotation > 180.0) delta.rotation -= 360.0;		//turn the shortest way
+	if (delta.rotation < -180.0) delta.rotation += 360.0;
+	return delta;
+}
+
 void GameObject::SetActive(bool new_active) {
 	this->active = new_active;
 	GameObject* child;
@@ -351,6 +384,11 @@ void GameObject::mainPostUpdate(double timeElapsed) {
 	}
 }
 
+//internal call. The post update of an object with a constraint parent can move its parents
+bool GameObject::_hasConstraintParent() {
+	return _constraintParent.parent != 0;
+}
+
 void GameObject::updateConstraintParenting() {
 	if (_constraintParent.parent == 0)
 		return;
@@ -423,6 +461,11 @@ void GameObject::AttachRigidbody(std::vector <vector2>& vertexes) {
 	rigidbody = new Rigidbody(this, vertexes);
 }
 
+//the object becomes the static collision geometry of the level. The rigidbody takes the world and builds it if needed
+void GameObject::AttachStaticWorld(StaticWorld* world) {
+	rigidbody = new Rigidbody(this, world);
+}
+
 Rigidbody* GameObject::GetRigidbody() {
 	return rigidbody;
 }
@@ -5,6 +5,9 @@
 #include "camera.h"
 #include "lightObject.h"
 #include "game_options.h"
+#include "profiler.h"
+#include "platform.h"
+#include "jobSystem.h"
 
 #include <SDL.h>
 #include <SDL_image.h>
@@ -15,6 +18,7 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <chrono>
 
 namespace fs = std::filesystem;
 
@@ -22,14 +26,21 @@ namespace fs = std::filesystem;
 #define MAX_LAYER 50
 
 GraphicsEngine::GraphicsEngine() {
-	
+	_interpolationStep = 0;
+	_window = nullptr;
+	_renderer = nullptr;
 }
 
+thread_local TransformStruct GraphicsEngine::_blitDelta = {};
+
+//headless there is no window
 GraphicsEngine::~GraphicsEngine() {
-	SDL_DestroyWindow(this->_window);
+	if (this->_window != nullptr) {
+		SDL_DestroyWindow(this->_window);
+	}
 }
 
-void GraphicsEngine::Init(GraphicsOptions &options){
+void GraphicsEngine::Init(GraphicsOptions &options, bool headless){
 	_updateQueue = _TextureQueues[0];
 	_waitingQueue = _TextureQueues[1];
 	_renderQueue = _TextureQueues[2];
@@ -38,11 +49,23 @@ void GraphicsEngine::Init(GraphicsOptions &options){
 	_renderCamera = &_CameraTransforms[2];
 	_renderCamera->present = false;
 	_updateCamera->present = false;
+	_newFrame = false;
 	_lightingOverlay = nullptr;
 	enableRenderDepth = false;
 
 	enableSceneLighting = false;
 	max_lighting_layer = 10;
+	_headless = headless;
+
+	if (_headless) {		//no display: keep a virtual screen for the coordinate conversions
+		this->windowWidth = (options.width > 0) ? options.width : 1920;
+		this->windowHeight = (options.height > 0) ? options.height : 1080;
+		this->_windowMode = (int)WindowMode::MODE_WINDOW;
+		_window = nullptr;
+		_renderer = nullptr;
+		SetActiveLayers(options.activeLayers);
+		return;
+	}
 	
 	ResolveWindowMode((int)options.mode, options.width, options.height);		//set the dimension of the screen
 
@@ -164,6 +187,16 @@ int GraphicsEngine::GetWindowMode() {
 	return this->_windowMode;
 }
 
+//refresh rate of the display that shows the window, 0 if unknown. Must be called from the main thread
+int GraphicsEngine::GetDisplayRefreshRate() {
+	SDL_DisplayMode mode;
+	int display = SDL_GetWindowDisplayIndex(this->_window);
+	if (display < 0 || SDL_GetCurrentDisplayMode(display, &mode) != 0) {
+		return 0;
+	}
+	return mode.refresh_rate;
+}
+
 //this function could return slight a wrong queue size
 unsigned long GraphicsEngine::GetTaskQueueLen() {
 	return _requests.size();
@@ -177,6 +210,15 @@ void GraphicsEngine::PollRequests(double tick_tock_motherfucker) {
 	auto startTime = std::chrono::high_resolution_clock::now();
 
 	request_mutex.lock();
+	if (_headless) {
+		for (int i = 0; i < _requests.size(); i++) {
+			DiscardRequest_Internal(_requests[i]);
+		}
+		_requests.clear();
+		request_mutex.unlock();
+		return;
+	}
+
 	while (tick_tock_motherfucker > 0 && _requests.size() > 0) {
 		
 		std::pair <GraphicRequestType, void*> request = _requests[0];
@@ -301,6 +343,43 @@ void GraphicsEngine::PollRequests(double tick_tock_motherfucker) {
 	request_mutex.unlock();
 }
 
+//free the data of a request without executing it (headless mode)
+void GraphicsEngine::DiscardRequest_Internal(std::pair <GraphicRequestType, void*>& request) {
+	switch (request.first) {
+	case GraphicRequestType::SET_WINDOW_TITLE:
+	case GraphicRequestType::RESIZE_WINDOW:
+		delete (WindowUpdate*)request.second;
+		break;
+	case GraphicRequestType::SET_LIGHTING_QUALITY:
+		delete (LightingQuality*)request.second;
+		break;
+	case GraphicRequestType::CREATE_LIGHT_TEXTURE:
+		delete (LightObjectData*)request.second;
+		break;
+	case GraphicRequestType::CREATE_TEXTURE:
+		delete (TextureCreation*)request.second;
+		break;
+	case GraphicRequestType::CREATE_FONT_ATLAS:
+		delete (FontStruct*)request.second;
+		break;
+	case GraphicRequestType::CREATE_FONT_CHAR:
+		delete (fontCharCreation*)request.second;
+		break;
+	case GraphicRequestType::LOAD_FROM_FILE:
+		delete (LoadFileStruct*)request.second;
+		break;
+	case GraphicRequestType::DESTROY_TEXTURE:
+		delete (TextureToDestroy*)request.second;
+		break;
+	case GraphicRequestType::FREE_TEXTURE_GROUP:
+		delete (DestroyTextureGroup*)request.second;
+		break;
+	case GraphicRequestType::KILL_LIGHT_BAKING:
+	case GraphicRequestType::FREE_ALL:
+		break;
+	}
+}
+
 //add a texture to the stack
 //is called only from PollRequests which rns on the main thread
 void GraphicsEngine::PushTexture(TextureData* texture) {
@@ -730,7 +809,7 @@ void GraphicsEngine::CompleteLightBaking() {
 	}
 }
 
-//starts the new thread that draw the surface of the light texture
+//starts the background job that draws the surface of the light texture
 void GraphicsEngine::BakeLightTexture_Internal(LightObjectData& lightData) {
 
 	if (lightData.type == LightType::POINT_LIGHT) {
@@ -748,10 +827,12 @@ void GraphicsEngine::BakeLightTexture_Internal(LightObjectData& lightData) {
 		task->surface = surface;
 		task->abort = false;
 		
-		SDL_LockSurface(surface);	//lock the surface before starting the new thread
+		SDL_LockSurface(surface);	//lock the surface before starting the job
 		_lightBakingTasks.push_back(task);
-		auto thr = std::thread([this, task]() {DrawLightSurface(task, _lightingOverlaySize.x, _lightingOverlaySize.x, PointLightFilter); });
-		thr.detach();
+		int size = _lightingOverlaySize.x;
+		task->job = JobSystem::getInstance().Submit([this, task, size]() {
+			DrawLightSurface(task, size, size, PointLightFilter);
+		}, JobPriority::LOW);
 	}
 	else if(lightData.type == LightType::GLOBAL_LIGHT) {
 		lightData.color.a = 255.0 * (1.0 - pow(1.7, -lightData.power));
@@ -771,6 +852,7 @@ void GraphicsEngine::BakeLightTexture_Internal(LightObjectData& lightData) {
 		task->lightObject = lightData;
 		task->surface = surface;
 		task->abort = false;
+		task->job.id = 0;
 
 		SDL_LockSurface(surface);
 		_lightBakingTasks.push_back(task);
@@ -817,7 +899,10 @@ void GraphicsEngine::KillLightBaking() {
 void GraphicsEngine::KillLightBaking_Internal() {
 	for (auto it = _lightBakingTasks.begin(); it != _lightBakingTasks.end(); it++) {
 		(*it)->abort = true;
-		while (!(*it)->done);	//waits the thread to finish
+		if (JobSystem::getInstance().Cancel((*it)->job)) {		//the job didn't start
+			(*it)->done = true;
+		}
+		while (!(*it)->done);	//waits the job to finish
 		SDL_UnlockSurface((*it)->surface);
 		SDL_FreeSurface((*it)->surface);
 	}
@@ -909,7 +994,7 @@ void GraphicsEngine::LoadFromDir(std::string directory, EntityName groupName) {
 
 //save the state of a texture that needs to be printed on screen
 void GraphicsEngine::BlitSurface(EntityName textureName, int screenLayer, vector2 pos, vector2 scale, double rot, TextureFlip flip) {
-	if (textureName == 0)
+	if (textureName == 0 || _headless)
 		return;
 	
 	if (screenLayer >= 100)
@@ -922,6 +1007,7 @@ void GraphicsEngine::BlitSurface(EntityName textureName, int screenLayer, vector
 	obj.scale = scale;
 	obj.screenLayer = screenLayer;
 	obj.textureName = textureName;
+	obj.delta = _blitDelta;
 
 	std::lock_guard<std::mutex> guard(update_queue_mutex);
 	this->_updateQueue[screenLayer].push_back(obj);
@@ -929,6 +1015,8 @@ void GraphicsEngine::BlitSurface(EntityName textureName, int screenLayer, vector
 }
 
 void GraphicsEngine::BlitTextSurface(EntityName fontAtlas, std::string text, int layer, vector2 pos, vector2 scale, double rot, TextureFlip flip, int cursorPos) {
+	if (_headless)
+		return;
 	//update_queue_mutex.lock();
 
 	if (_fontsRef.find(fontAtlas) == _fontsRef.end()) {
@@ -1003,11 +1091,23 @@ vector2 GraphicsEngine::screenToSpace(int x_coord, int y_coord) {
 	return spacePos;
 }
 
-void GraphicsEngine::updateRenderCamera(bool present, vector2 pos, vector2 scale, double rotation) {
+void GraphicsEngine::updateRenderCamera(bool present, vector2 pos, vector2 scale, double rotation, TransformStruct delta) {
 	_updateCamera->present = present;
 	_updateCamera->pos = pos;
 	_updateCamera->rot = rotation;
 	_updateCamera->scale = scale;
+	_updateCamera->delta = delta;
+}
+
+//when step is greater than 0 the frames are drawn interpolating between the last two simulation steps
+//that last step seconds each. It adds one simulation step of latency
+void GraphicsEngine::SetInterpolationStep(double step) {
+	_interpolationStep = step;
+}
+
+//the textures blitted by the calling thread moved by delta since the previous simulation step
+void GraphicsEngine::_setBlitDelta(TransformStruct delta) {
+	_blitDelta = delta;
 }
 
 //swap the screen buffers. It's called from the main thread
@@ -1036,12 +1136,16 @@ void GraphicsEngine::updateRenderCamera(bool present, vector2 pos, vector2 scale
 void GraphicsEngine::SwapScreenBuffersPhysics() {
 	std::lock_guard <std::mutex> swap_buffer_guard(swap_buffer_mutex);
 
+	std::chrono::duration<double> now = std::chrono::steady_clock::now().time_since_epoch();
+	_updateCamera->publishTime = now.count();
+
 	std::vector <textureObject>* temp = _waitingQueue;
 	_waitingQueue = _updateQueue;
 	_updateQueue = temp;
 	CameraTransform* ctemp = _waitingCamera;
 	_waitingCamera = _updateCamera;
 	_updateCamera = ctemp;
+	_newFrame = true;
 
 	for (int i = 0; i < _activeLayers; i++) {	//clear the ex render buffer
 		_updateQueue[i].clear();
@@ -1051,6 +1155,10 @@ void GraphicsEngine::SwapScreenBuffersPhysics() {
 
 void GraphicsEngine::SwapScreenBuffersGraphics() {
 	std::lock_guard <std::mutex> swap_buffer_guard(swap_buffer_mutex);
+	if (!_newFrame) {		//keep rendering the last frame instead of going back to an older one
+		return;
+	}
+	_newFrame = false;
 
 	std::vector <textureObject>* temp = _waitingQueue;
 	_waitingQueue = _renderQueue;
@@ -1065,6 +1173,8 @@ void GraphicsEngine::SwapScreenBuffersGraphics() {
 //draws all the textures on the window
 //It's called from the main thread
 void GraphicsEngine::Flip() {
+	if (_headless)
+		return;
 
 	//Very last protection to avoid swapping the buffers while the main thread is rendering
 	//This mutex should avoid crashing when the main thread renders much quicker that the draw thread
@@ -1082,9 +1192,24 @@ void GraphicsEngine::Flip() {
 		SDL_RenderPresent(this->_renderer);
 		return;
 	}
+	//fraction of the movement of the last simulation step that is still to be shown
+	double back = 0;
+	double step = _interpolationStep;
+	if (step > 0) {
+		std::chrono::duration<double> now = std::chrono::steady_clock::now().time_since_epoch();
+		double alpha = (now.count() - _renderCamera->publishTime) / step;
+		back = 1.0 - std::clamp(alpha, 0.0, 1.0);
+	}
+
 	vector2 cameraWindow = _renderCamera->scale;
 	vector2 cameraPos = _renderCamera->pos;
 	double sdl2_cameraRotation = _renderCamera->rot;		//camera rotation angle
+	if (back > 0) {
+		TransformStruct& d = _renderCamera->delta;
+		cameraWindow = { cameraWindow.x - d.scale.x * back, cameraWindow.y - d.scale.y * back };
+		cameraPos = { cameraPos.x - d.position.x * back, cameraPos.y - d.position.y * back };
+		sdl2_cameraRotation -= d.rotation * back;
+	}
 
 	vector2 cameraToScreenScale = { (double)this->windowWidth / cameraWindow.x, (double)this->windowHeight / cameraWindow.y};
 	spaceToScreenScale = cameraToScreenScale;
@@ -1103,6 +1228,15 @@ void GraphicsEngine::Flip() {
 		if(enableRenderDepth) std::sort(this->_renderQueue[j].begin(), this->_renderQueue[j].end(), compareY);
 		for (int i = 0; i < this->_renderQueue[j].size(); i++) {
 			texture = &this->_renderQueue[j][i];
+			TextureObj interpolated;
+			if (back > 0) {
+				interpolated = *texture;
+				TransformStruct& d = texture->delta;
+				interpolated.pos = { texture->pos.x - d.position.x * back, texture->pos.y - d.position.y * back };
+				interpolated.scale = { texture->scale.x - d.scale.x * back, texture->scale.y - d.scale.y * back };
+				interpolated.rot = texture->rot - d.rotation * back;
+				texture = &interpolated;
+			}
 
 			double camera_obj_dist = sqrt((texture->pos.x - cameraPos.x) * (texture->pos.x - cameraPos.x)
 			+ (cameraPos.y - texture->pos.y) * (cameraPos.y - texture->pos.y));
@@ -1136,6 +1270,7 @@ void GraphicsEngine::Flip() {
 }
 
 void GraphicsEngine::DrawLighting(vector2 cameraPos, vector2 cameraScale, double cameraRot) {
+	PROFILE_SCOPE("DrawLighting");
 
 	std::vector <LightObject*>* lights = GameEngine::getInstance().GetLightObjects();
 	std::vector < LightObject*>& ref = *lights;
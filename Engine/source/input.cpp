@@ -81,6 +81,7 @@ InputEvent InputEngine::GetLastEvent() {
 	if ((SDL_EventType)_lastEvent.load() == SDL_QUIT) {
 		return InputEvent::QUIT_APP;
 	}
+	return InputEvent::NO_EVENT;
 }
 
 
@@ -0,0 +1,193 @@
+#include "jobSystem.h"
+#include "multithreadManager.h"
+#include "profiler.h"
+
+JobSystem::JobSystem() {
+	_nextId = 1;
+	_pool = nullptr;
+}
+
+JobSystem::~JobSystem() {
+}
+
+//queue a job. onComplete is called on the game thread after the job ran. Can be called by any thread
+JobHandle JobSystem::Submit(std::function<void()> job, JobPriority priority, std::function<void()> onComplete) {
+	JobHandle handle = { 0 };
+	if (!job) {
+		return handle;
+	}
+	{
+		std::lock_guard <std::mutex> guard(jobs_mutex);
+		Job j;
+		j.id = _nextId++;
+		j.function = std::move(job);
+		j.onComplete = std::move(onComplete);
+		handle.id = j.id;
+		_states[j.id] = JobState::QUEUED;
+		_queues[(int)priority].push_back(std::move(j));
+	}
+
+	MultithreadManager* pool = _pool.load(std::memory_order_acquire);
+	if (pool != nullptr) {
+		pool->NotifyIdleWork();
+	}
+	return handle;
+}
+
+//remove a job that didn't start yet. Returns false if the job is already running or completed
+bool JobSystem::Cancel(JobHandle handle) {
+	std::lock_guard <std::mutex> guard(jobs_mutex);
+	auto state = _states.find(handle.id);
+	if (state == _states.end() || state->second != JobState::QUEUED) {
+		return false;
+	}
+	for (int p = 0; p < PRIORITIES; p++) {
+		for (auto it = _queues[p].begin(); it != _queues[p].end(); it++) {
+			if (it->id == handle.id) {
+				_queues[p].erase(it);
+				_states.erase(state);
+				_jobDone.notify_all();
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+//true if the job ran (its callback may still be waiting for the game thread) or was cancelled
+bool JobSystem::IsDone(JobHandle handle) {
+	std::lock_guard <std::mutex> guard(jobs_mutex);
+	if (handle.id == 0 || handle.id >= _nextId) {
+		return false;
+	}
+	auto state = _states.find(handle.id);
+	return state == _states.end() || state->second == JobState::COMPLETED;
+}
+
+//wait for the end of the job. A job that didn't start yet runs on the calling thread.
+//The callback is still called by the game thread
+void JobSystem::Wait(JobHandle handle) {
+	Job job;
+	bool found = false;
+	{
+		std::unique_lock <std::mutex> lock(jobs_mutex);
+		auto state = _states.find(handle.id);
+		if (state == _states.end()) {
+			return;
+		}
+		if (state->second == JobState::QUEUED) {
+			for (int p = 0; p < PRIORITIES && !found; p++) {
+				for (auto it = _queues[p].begin(); it != _queues[p].end(); it++) {
+					if (it->id == handle.id) {
+						job = std::move(*it);
+						_queues[p].erase(it);
+						state->second = JobState::RUNNING;
+						found = true;
+						break;
+					}
+				}
+			}
+		}
+		if (!found) {
+			_jobDone.wait(lock, [this, handle] {
+				auto state = _states.find(handle.id);
+				return state == _states.end() || state->second == JobState::COMPLETED;
+			});
+			return;
+		}
+	}
+
+	job.function();
+	completeJob(job);
+}
+
+//jobs queued or running
+int JobSystem::GetPendingJobs() {
+	std::lock_guard <std::mutex> guard(jobs_mutex);
+	int pending = 0;
+	for (auto it = _states.begin(); it != _states.end(); it++) {
+		if (it->second != JobState::COMPLETED) {
+			pending++;
+		}
+	}
+	return pending;
+}
+
+//run the queued job with the highest priority. Returns false if there was no job.
+//Called by the idle helpers, or by the game thread when there are no helpers
+bool JobSystem::RunNextJob() {
+	Job job;
+	if (!takeJob(job)) {
+		return false;
+	}
+	{
+		PROFILE_SCOPE("background job");
+		job.function();
+	}
+	completeJob(job);
+	return true;
+}
+
+//call the callbacks of the completed jobs. Runs on the game thread
+void JobSystem::DeliverCompletions() {
+	std::vector <Job> completed;
+	{
+		std::lock_guard <std::mutex> guard(jobs_mutex);
+		if (_completed.empty()) {
+			return;
+		}
+		completed.swap(_completed);
+		for (int i = 0; i < completed.size(); i++) {
+			_states.erase(completed[i].id);
+		}
+	}
+	for (int i = 0; i < completed.size(); i++) {
+		completed[i].onComplete();
+	}
+}
+
+//the pool whose helpers are woken up by Submit(). nullptr when the pool is stopping
+void JobSystem::SetPool(MultithreadManager* pool) {
+	_pool.store(pool, std::memory_order_release);
+}
+
+//drop the queued jobs and the callbacks not called yet. The running jobs are not waited for
+void JobSystem::Clear() {
+	std::lock_guard <std::mutex> guard(jobs_mutex);
+	for (int p = 0; p < PRIORITIES; p++) {
+		for (int i = 0; i < _queues[p].size(); i++) {
+			_states.erase(_queues[p][i].id);
+		}
+		_queues[p].clear();
+	}
+	for (int i = 0; i < _completed.size(); i++) {
+		_states.erase(_completed[i].id);
+	}
+	_completed.clear();
+	_jobDone.notify_all();
+}
+
+bool JobSystem::takeJob(Job& job) {
+	std::lock_guard <std::mutex> guard(jobs_mutex);
+	for (int p = 0; p < PRIORITIES; p++) {
+		if (!_queues[p].empty()) {
+			job = std::move(_queues[p].front());
+			_queues[p].pop_front();
+			_states[job.id] = JobState::RUNNING;
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::completeJob(Job& job) {
+	std::lock_guard <std::mutex> guard(jobs_mutex);
+	if (job.onComplete) {
+		_states[job.id] = JobState::COMPLETED;
+		_completed.push_back(std::move(job));
+	}
+	else {
+		_states.erase(job.id);
+	}
+	_jobDone.notify_all();
+}
@@ -1,60 +1,399 @@
-
 #include "multithreadManager.h"
 #include "threadHelper.h"
+#include "platform.h"
+#include "epochManager.h"
+#include "profiler.h"
 #include <mutex>
-#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+static thread_local MultithreadManager* currentPool = nullptr;		//pool of the helper running on this thread
 
+//helperCpus: logical cpu of every helper. Empty to let the helpers run on any cpu
+MultithreadManager::MultithreadManager(int threadsCount, const std::vector <int>& helperCpus) {
 
-MultithreadManager::MultithreadManager(int threadsCount) {
+	this->threadCount = std::max(0, threadsCount);		//0 helpers: the calling thread runs all the work in Wait()
+    this->_jobState = 0;
+    this->_waiterParked = 0;
+    this->_generation = 0;
+    this->_parked = 0;
+    this->_stop = false;
+    this->_busy = false;
+    //spinning only pays when every worker has its own hardware thread, otherwise it takes the cpu from the thread it waits for
+    this->_spinTime = (this->threadCount + 1 <= (int)std::thread::hardware_concurrency()) ? 30 : 0;
+    this->_function = nullptr;
+    this->_args = nullptr;
+    this->_workPending = false;
+    this->_onHelpers = false;
+    this->_idleWork = nullptr;
+    this->_idleArgs = nullptr;
+    this->_idleWorkers = 0;
+    this->_maxIdleWorkers = 0;
+    this->_workers = this->threadCount + 1;
 
-	this->threadCount = threadsCount;
-    this->_activeTasks = 0;
+    this->_queues = new WorkQueue[this->_workers];
+    this->_counters = new WorkerCounters[this->_workers];
+    for (int i = 0; i < this->_workers; i++) {
+        this->_queues[i].begin = 0;
+        this->_queues[i].end = 0;
+    }
+    ResetWorkerStats();
 
-    for (int i = 0; i < threadsCount; i++) {
-        threads.push_back(new ThreadHelper(this, i));
+    for (int i = 0; i < this->threadCount; i++) {
+        threads.push_back(new ThreadHelper(this, i, 0, i < helperCpus.size() ? helperCpus[i] : -1));
     }
 }
 
-//setup all the threads for the work and waits for them to finish
+MultithreadManager::~MultithreadManager() {
+    delete[] this->_queues;
+    delete[] this->_counters;
+}
+
+//split the work between the queues of the workers and wake up the helpers. Call Wait() to help and wait for the end of the work
 void MultithreadManager::startWork(int count, void(*function)(int start_index, int end_index, void* args), void* args) {
 
+    acquire();
+    dispatch(count, function, args);
+}
+
+//requires the pool to be acquired
+void MultithreadManager::dispatch(int count, void(*function)(int start_index, int end_index, void* args), void* args) {
+
     if (count > 0) {
-        this->_activeTasks = this->threadCount;
-        //split the work between all the threads
-        int countPerThread = count / this->threadCount;
-        for (int i = 0; i < this->threadCount - 1; i++) {
-            this->threads[i]->startWork(i * countPerThread, i * countPerThread + countPerThread, function, args);
+        this->_function = function;
+        this->_args = args;
+        this->_workPending = true;
+        this->_onHelpers = false;
+        for (int i = 0; i < this->_workers; i++) {
+            std::lock_guard<std::mutex> guard(this->_queues[i].lock);
+            this->_queues[i].begin = (int)((long long)count * i / this->_workers);
+            this->_queues[i].end = (int)((long long)count * (i + 1) / this->_workers);
         }
-        //the last thread receive all the remaining elements. This is needed in case count is not divisible by the thread number
-        this->threads[this->threadCount-1]->startWork((this->threadCount - 1) * countPerThread, count, function, args);
 
-        // Wait for all the thread to finish working before returning
-        /*std::unique_lock<std::mutex> lk(this->taskMutex);
-        taskCv.wait(lk, [this] {return this->_activeTasks == 0;});*/
+        openJob();
     }
 }
 
-// Wait for all the thread to finish working before returning
+//run function(worker, 0, args) once on every helper. Worker ids go from 1 to the helpers count, 0 is the calling thread
+void MultithreadManager::startOnHelpers(void(*function)(int worker, int unused, void* args), void* args) {
+
+    acquire();
+    if (this->threadCount > 0) {
+        this->_function = function;
+        this->_args = args;
+        this->_workPending = false;
+        this->_onHelpers = true;
+
+        openJob();
+    }
+}
+
+//let the helpers join the job, then publish it
+void MultithreadManager::openJob() {
+    this->_jobState.store(JOB_OPEN, std::memory_order_seq_cst);
+    wakeHelpers();
+}
+
+//called by a helper that saw a new generation. Fails if the job was closed by Wait() (or there is no job):
+//the helper doesn't run the work of a job that is already completed
+bool MultithreadManager::joinJob() {
+    uint32_t state = this->_jobState.load(std::memory_order_acquire);
+    while (state & JOB_OPEN) {
+        if (this->_jobState.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//the helper completed its part of the job. The last one to leave a closed job releases the thread in Wait()
+void MultithreadManager::leaveJob() {
+    if (this->_jobState.fetch_sub(1, std::memory_order_seq_cst) == 1) {
+        if (this->_waiterParked.load(std::memory_order_seq_cst) != 0) {
+            WakeOnValue(&this->_jobState, false);
+        }
+    }
+}
+
+//publish the job to the helpers. Only the parked helpers need a syscall, the spinning ones see the new generation
+void MultithreadManager::wakeHelpers() {
+    this->_generation.fetch_add(1, std::memory_order_seq_cst);
+    if (this->_parked.load(std::memory_order_seq_cst) > 0) {
+        WakeOnValue(&this->_generation, true);
+    }
+}
+
+// run chunks of the work on the calling thread, then wait for the helpers that joined the job before returning.
+//The helpers that didn't join yet (busy with the idle work or not woken up) don't take part to the job anymore
 void MultithreadManager::Wait() {
-    
-    std::unique_lock<std::mutex> lk(this->taskMutex);
-    taskCv.wait(lk, [this] {return this->_activeTasks == 0;});
 
+    if (this->_workPending) {
+        runWorker(0);
+        this->_workPending = false;
+    }
+    this->_jobState.fetch_and(~JOB_OPEN, std::memory_order_seq_cst);
+
+    std::chrono::microseconds spinTime(this->_spinTime.load(std::memory_order_relaxed));
+    if (this->_jobState.load(std::memory_order_acquire) != 0 && spinTime.count() > 0) {
+        auto spinStart = std::chrono::steady_clock::now();
+        int spins = 0;
+        while (this->_jobState.load(std::memory_order_acquire) != 0) {
+            CpuRelax();
+            if ((++spins & 63) == 0 && std::chrono::steady_clock::now() - spinStart >= spinTime) {
+                break;
+            }
+        }
+    }
+
+    uint32_t left;
+    while ((left = this->_jobState.load(std::memory_order_acquire)) != 0) {
+        this->_waiterParked.store(1, std::memory_order_seq_cst);
+        left = this->_jobState.load(std::memory_order_seq_cst);
+        if (left != 0) {
+            WaitOnValue(&this->_jobState, left);
+        }
+        this->_waiterParked.store(0, std::memory_order_relaxed);
+    }
+    this->_busy.store(false, std::memory_order_release);
+}
+
+//run the work and wait for it, if the pool is not running the work of another call.
+//Returns false without running anything if the pool is busy or if the caller is one of its helpers:
+//a background job that took the pool would keep the next job of the frame waiting in acquire()
+bool MultithreadManager::tryRun(int count, void(*function)(int start_index, int end_index, void* args), void* args) {
+    if (currentPool == this) {
+        return false;
+    }
+    bool expected = false;
+    if (!this->_busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        return false;
+    }
+    dispatch(count, function, args);
+    Wait();
+    return true;
 }
 
-//update the active tasks count. When it reaches 0 the lock in startWork() is released
-void MultithreadManager::updateActiveTasks() {
+//the pool runs one work at a time: wait for the end of the work started by another thread
+void MultithreadManager::acquire() {
+    while (this->_busy.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+//body of the helper threads: join the jobs of the pool, run the idle work when there is no job, sleep when there is nothing to do.
+//generation is the last job seen by the helper
+void MultithreadManager::helperLoop(int worker, uint32_t generation) {
+    currentPool = this;
+    while (true) {
+        uint32_t current = this->_generation.load(std::memory_order_acquire);
+        if (current == generation) {
+            if (!runIdleWork(worker, generation)) {
+                waitForGeneration(generation);
+            }
+            continue;
+        }
+        generation = current;
+        if (this->_stop.load(std::memory_order_acquire)) {
+            return;
+        }
+        if (joinJob()) {
+            EpochManager::getInstance().Online();
+            {
+                PROFILE_SCOPE("helper job");
+                runWorker(worker);
+            }
+            EpochManager::getInstance().Offline();
+            leaveJob();
+        }
+    }
+}
+
+//run one piece of the idle work if there is no job newer than generation and there are not too many helpers on it already.
+//Returns false if nothing was run
+bool MultithreadManager::runIdleWork(int worker, uint32_t generation) {
+    bool (*function)(void* args) = this->_idleWork.load(std::memory_order_acquire);
+    if (function == nullptr) {
+        return false;
+    }
+    if (this->_idleWorkers.fetch_add(1, std::memory_order_acq_rel) >= this->_maxIdleWorkers.load(std::memory_order_relaxed) ||
+        this->_generation.load(std::memory_order_acquire) != generation) {		//a job was published: the frame comes first
+        this->_idleWorkers.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    EpochManager::getInstance().Online();
+    bool ran;
     {
-        std::lock_guard<std::mutex> lk(this->taskMutex);
-        this->_activeTasks--;
+        PROFILE_SCOPE("helper idle work");
+        ran = function(this->_idleArgs.load(std::memory_order_acquire));
+    }
+    EpochManager::getInstance().Offline();
+    this->_idleWorkers.fetch_sub(1, std::memory_order_release);
+    if (ran) {
+        std::chrono::nanoseconds busy = std::chrono::steady_clock::now() - start;
+        this->_counters[worker].backgroundTime.fetch_add(busy.count(), std::memory_order_relaxed);
+    }
+    return ran;
+}
+
+//spin for a short time, then sleep until the generation changes
+void MultithreadManager::waitForGeneration(uint32_t generation) {
+    std::chrono::microseconds spinTime(this->_spinTime.load(std::memory_order_relaxed));
+    if (spinTime.count() > 0) {
+        auto spinStart = std::chrono::steady_clock::now();
+        int spins = 0;
+        while (this->_generation.load(std::memory_order_acquire) == generation) {
+            CpuRelax();
+            if ((++spins & 63) == 0 && std::chrono::steady_clock::now() - spinStart >= spinTime) {
+                break;
+            }
+        }
+    }
+
+    while (this->_generation.load(std::memory_order_acquire) == generation) {		//park until the next job
+        this->_parked.fetch_add(1, std::memory_order_seq_cst);
+        if (this->_generation.load(std::memory_order_seq_cst) == generation) {
+            WaitOnValue(&this->_generation, generation);
+        }
+        this->_parked.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+//run chunks of the current work until there is nothing left to take in the queues. worker 0 is the calling thread
+void MultithreadManager::runWorker(int worker) {
+    if (this->_onHelpers) {
+        this->_function(worker, 0, this->_args);
+        return;
+    }
+
+    int start, end;
+    while (takeChunk(worker, start, end) || (steal(worker) && takeChunk(worker, start, end))) {
+        auto chunkStart = std::chrono::steady_clock::now();
+        this->_function(start, end, this->_args);
+        AddWorkerTime(worker, std::chrono::steady_clock::now() - chunkStart, end - start);
+    }
+}
+
+//account a chunk of work run by the worker
+void MultithreadManager::AddWorkerTime(int worker, std::chrono::nanoseconds busy, int items) {
+    WorkerCounters& counters = this->_counters[worker];
+    counters.busyTime.fetch_add(busy.count(), std::memory_order_relaxed);
+    counters.items.fetch_add(items, std::memory_order_relaxed);
+    counters.chunks.fetch_add(1, std::memory_order_relaxed);
+}
+
+//pop a chunk from the front of the queue of the worker. The chunks get smaller as the queue gets shorter,
+//so there is always something left to steal for the workers that run out of work
+bool MultithreadManager::takeChunk(int worker, int& start, int& end) {
+    WorkQueue& queue = this->_queues[worker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    int left = queue.end - queue.begin;
+    if (left <= 0) {
+        return false;
+    }
+    int chunk = std::max(1, left / 4);
+    start = queue.begin;
+    end = start + chunk;
+    queue.begin = end;
+    return true;
+}
+
+//move the back half of the queue of another worker into the (empty) queue of this worker
+bool MultithreadManager::steal(int worker) {
+    for (int i = 1; i < this->_workers; i++) {
+        int victim = (worker + i) % this->_workers;
+        int begin, end;
+        {
+            WorkQueue& queue = this->_queues[victim];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            int left = queue.end - queue.begin;
+            if (left <= 0) {
+                continue;
+            }
+            end = queue.end;
+            begin = queue.end - (left + 1) / 2;
+            queue.end = begin;
+        }
+        {
+            WorkQueue& queue = this->_queues[worker];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.begin = begin;
+            queue.end = end;
+        }
+        this->_counters[worker].steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+//how long the helpers and the waiting thread spin before sleeping. 0 always sleeps
+void MultithreadManager::SetSpinTime(std::chrono::microseconds time) {
+    this->_spinTime.store(time.count(), std::memory_order_relaxed);
+}
+
+//function(args) is called by the idle helpers until it returns false, by at most maxWorkers helpers at the same time
+//(-1: all the helpers but one, so a helper is always ready for the frame jobs: none with a single helper).
+//Call NotifyIdleWork() when there is new work.
+//nullptr removes the idle work, the pieces already running are not waited for
+void MultithreadManager::SetIdleWork(bool(*function)(void* args), void* args, int maxWorkers) {
+    if (maxWorkers < 0) {
+        maxWorkers = std::max(0, this->threadCount - 1);
     }
-    taskCv.notify_one();
+    this->_maxIdleWorkers.store(maxWorkers, std::memory_order_relaxed);
+    this->_idleArgs.store(args, std::memory_order_release);
+    this->_idleWork.store(function, std::memory_order_release);
+    NotifyIdleWork();
 }
 
+//wake up a sleeping helper to run the idle work
+void MultithreadManager::NotifyIdleWork() {
+    this->_generation.fetch_add(1, std::memory_order_seq_cst);
+    if (this->_parked.load(std::memory_order_seq_cst) > 0) {
+        WakeOnValue(&this->_generation, false);
+    }
+}
+
+//number of threads that run the work: the helpers and the thread that calls Wait()
+int MultithreadManager::GetWorkerCount() {
+    return this->_workers;
+}
+
+void MultithreadManager::GetWorkerStats(std::vector <WorkerStats>& stats) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - this->_statsStart;
+    stats.clear();
+    for (int i = 0; i < this->_workers; i++) {
+        WorkerStats s;
+        s.busyTime = this->_counters[i].busyTime.load(std::memory_order_relaxed) / 1e9;
+        s.utilisation = elapsed.count() > 0 ? s.busyTime / elapsed.count() : 0;
+        s.items = this->_counters[i].items.load(std::memory_order_relaxed);
+        s.chunks = this->_counters[i].chunks.load(std::memory_order_relaxed);
+        s.steals = this->_counters[i].steals.load(std::memory_order_relaxed);
+        s.backgroundTime = this->_counters[i].backgroundTime.load(std::memory_order_relaxed) / 1e9;
+        stats.push_back(s);
+    }
+}
+
+void MultithreadManager::ResetWorkerStats() {
+    for (int i = 0; i < this->_workers; i++) {
+        this->_counters[i].busyTime.store(0, std::memory_order_relaxed);
+        this->_counters[i].items.store(0, std::memory_order_relaxed);
+        this->_counters[i].chunks.store(0, std::memory_order_relaxed);
+        this->_counters[i].steals.store(0, std::memory_order_relaxed);
+        this->_counters[i].backgroundTime.store(0, std::memory_order_relaxed);
+    }
+    this->_statsStart = std::chrono::steady_clock::now();
+}
 
 void MultithreadManager::destroy() {
+    this->_stop.store(true, std::memory_order_release);
+    this->_generation.fetch_add(1, std::memory_order_seq_cst);
+    WakeOnValue(&this->_generation, true);
     for (int i = 0; i < this->threadCount; i++) {
         this->threads[i]->killThread();
         delete this->threads[i];
     }
-}
\ No newline at end of file
+    this->threads.clear();
+    this->threadCount = 0;		//the next works run on the calling thread
+}
@@ -0,0 +1,145 @@
+#include "objectRegistry.h"
+#include "gameObject.h"
+
+#include <vector>
+#include <unordered_map>
+
+ObjectRegistry::ObjectRegistry() {
+	_slots.reserve(1024);
+	_dense.reserve(1024);
+	_denseToSlot.reserve(1024);
+	_nameToSlot.reserve(1024);
+}
+
+//register a object with the given name. Returns an invalid handle if the name is already taken
+ObjectHandle ObjectRegistry::Insert(EntityName name, GameObject* obj) {
+	if (name == 0 || obj == nullptr) {
+		return {};
+	}
+
+	auto [it, inserted] = _nameToSlot.emplace(name, 0);
+	if (!inserted) {		//name already registered
+		return {};
+	}
+
+	uint32_t slotIndex;
+	if (_freeSlots.size() > 0) {
+		slotIndex = _freeSlots.back();
+		_freeSlots.pop_back();
+	}
+	else {
+		slotIndex = _slots.size();
+		_slots.push_back({ nullptr, 0, 0, 0 });
+	}
+	it->second = slotIndex;
+
+	Slot& slot = _slots[slotIndex];
+	slot.obj = obj;
+	slot.name = name;
+	slot.denseIndex = _dense.size();
+	if (slot.generation == 0) {		//first use of the slot
+		slot.generation = 1;
+	}
+
+	_dense.push_back({ name, obj });
+	_denseToSlot.push_back(slotIndex);
+
+	return { slotIndex, slot.generation };
+}
+
+//remove a object from the registry. Returns the removed object or nullptr if the name was not found
+GameObject* ObjectRegistry::Remove(EntityName name) {
+	auto it = _nameToSlot.find(name);
+	if (it == _nameToSlot.end()) {
+		return nullptr;
+	}
+
+	uint32_t slotIndex = it->second;
+	_nameToSlot.erase(it);
+
+	GameObject* obj = _slots[slotIndex].obj;
+	FreeSlot(slotIndex);
+	return obj;
+}
+
+//remove every object in linear time. The removed objects are appended to removed
+//and every handle issued so far becomes stale
+void ObjectRegistry::Clear(std::vector <GameObjectData>& removed) {
+	removed.insert(removed.end(), _dense.begin(), _dense.end());
+
+	for (int i = 0; i < _denseToSlot.size(); i++) {
+		Slot& slot = _slots[_denseToSlot[i]];
+		slot.obj = nullptr;
+		slot.name = 0;
+		slot.generation++;
+		if (slot.generation == 0) {
+			slot.generation = 1;
+		}
+		_freeSlots.push_back(_denseToSlot[i]);
+	}
+	_dense.clear();
+	_denseToSlot.clear();
+	_nameToSlot.clear();
+}
+
+GameObject* ObjectRegistry::Find(EntityName name) {
+	auto it = _nameToSlot.find(name);
+	if (it == _nameToSlot.end()) {
+		return nullptr;
+	}
+	return _slots[it->second].obj;
+}
+
+//return the object pointed by the handle or nullptr if the object was destroyed
+GameObject* ObjectRegistry::Find(ObjectHandle handle) {
+	if (!IsValid(handle)) {
+		return nullptr;
+	}
+	return _slots[handle.index].obj;
+}
+
+ObjectHandle ObjectRegistry::GetHandle(EntityName name) {
+	auto it = _nameToSlot.find(name);
+	if (it == _nameToSlot.end()) {
+		return {};
+	}
+	return { it->second, _slots[it->second].generation };
+}
+
+bool ObjectRegistry::IsValid(ObjectHandle handle) {
+	return handle.generation != 0 && handle.index < _slots.size()
+		&& _slots[handle.index].generation == handle.generation && _slots[handle.index].obj != nullptr;
+}
+
+//dense vector of the registered objects. The order changes every time an object is removed
+std::vector <GameObjectData>& ObjectRegistry::GetObjects() {
+	return _dense;
+}
+
+size_t ObjectRegistry::Size() {
+	return _dense.size();
+}
+
+//release a slot: the last dense element is moved in the hole and the generation is bumped
+//so every handle pointing to the slot becomes stale
+void ObjectRegistry::FreeSlot(uint32_t slotIndex) {
+	Slot& slot = _slots[slotIndex];
+	uint32_t hole = slot.denseIndex;
+	uint32_t last = _dense.size() - 1;
+
+	if (hole != last) {
+		_dense[hole] = _dense[last];
+		_denseToSlot[hole] = _denseToSlot[last];
+		_slots[_denseToSlot[hole]].denseIndex = hole;
+	}
+	_dense.pop_back();
+	_denseToSlot.pop_back();
+
+	slot.obj = nullptr;
+	slot.name = 0;
+	slot.generation++;
+	if (slot.generation == 0) {		//skip the invalid generation on wrap around
+		slot.generation = 1;
+	}
+	_freeSlots.push_back(slotIndex);
+}
@@ -4,210 +4,588 @@
 #include "gameObject.h"
 #include "transform.h"
 #include "structures.h"
+#include "profiler.h"
+#include "allocationCounter.h"
+#include "parallel.h"
+#include "staticWorld.h"
 
 #include <mutex>
 #include <memory>
 #include <vector>
+#include <unordered_set>
+#include <utility>
+#include <algorithm>
 
-PhysicsEngine::PhysicsEngine() {
+//scratch memory of the narrowphase of every thread. It grows to the biggest polygons met and is reused,
+//so the narrowphase doesn't allocate once the threads have seen the bodies of the scene
+thread_local PhysicsEngine::NarrowphaseScratch PhysicsEngine::_narrowphaseScratch;
+
+//approach speed under which the narrowphase looks for the contact points against the mtv instead of along the velocity
+static const double RESTING_VELOCITY = 0.5;
+//distance from the first contact point under which the other points are in the same contact
+static const double CONTACT_SLOP = 0.02;
+//contact points farther than this along the face are solved as two contacts
+static const double MANIFOLD_WIDTH = 0.05;
+//vertexes of the static world in the cost of a pair of the narrowphase
+static const double WORLD_PAIR_VERTEXES = 8;
+
+PhysicsEngine::PhysicsEngine() : _queryTree(0.1) {
 
 	_gravity = {};
 	_sleepVelocity = {};
+	_sleepTime = 0.5;
+	_sleepingCount = 0;
 	_firstStatic = 0;
+	_bodiesChanged = false;
+	_staticChanged = false;
+	_chunkStart.push_back(0);		//no chunks
+	_narrowphaseAllocations = 0;
+	_totalNarrowphaseAllocations = 0;
 }
 
 PhysicsEngine::~PhysicsEngine() {
 
 }
 
+//the body list is not changed right away since the physics could be running on other threads.
+//The changes are applied by ApplyBodyChanges()
 void PhysicsEngine::RegisterRigidbody(Rigidbody* body) {
 	std::lock_guard <std::mutex> guard(_update_mutex);
-	if (body->IsStatic()) {
-		_bodies.push_back(body);
+	if (!_registeredBodies.insert(body).second) {		//already registered
 		return;
 	}
-
-	_bodies.insert(_bodies.begin(), body);	//move the object at the start
-	++_firstStatic;
+	_addedBodies.push_back(body);
+	_bodiesChanged = true;
 }
 
 void PhysicsEngine::RemoveRigidbody(Rigidbody *body) {
 	std::lock_guard <std::mutex> guard(_update_mutex);
-	for (int i = 0; i < _bodies.size(); i++){
-		if (_bodies[i] == body) {
-			_bodies.erase(_bodies.begin() + i);
-			if (i < _firstStatic)
-				--_firstStatic;
-			return;
+	if (_registeredBodies.erase(body) > 0) {
+		_bodiesChanged = true;
+	}
+}
+
+//remove many bodies at once. They are dropped from the body list with a single pass
+void PhysicsEngine::RemoveRigidbodies(const std::vector <Rigidbody*>& bodies) {
+	std::lock_guard <std::mutex> guard(_update_mutex);
+	for (int i = 0; i < bodies.size(); i++) {
+		if (_registeredBodies.erase(bodies[i]) > 0) {
+			_bodiesChanged = true;
 		}
 	}
 }
 
+//the body switched between static and non static
 void PhysicsEngine::_updateStatic(Rigidbody* r) {
+	std::lock_guard <std::mutex> guard(_update_mutex);
+	_bodiesChanged = true;
+	_staticChanged = true;
+}
+
+//apply the pending additions, removals and static changes to the body list.
+//Must not be called while the physics is running. The removed bodies are never dereferenced
+//since they could be already deleted
+void PhysicsEngine::ApplyBodyChanges() {
+	std::lock_guard <std::mutex> guard(_update_mutex);
+	if (!_bodiesChanged) {
+		return;
+	}
+
+	//a deleted body and a new one can share the same address: keep only one entry
+	std::unordered_set <Rigidbody*> added;
+	for (int i = 0; i < _addedBodies.size(); i++) {
+		if (_registeredBodies.count(_addedBodies[i]) > 0) {
+			added.insert(_addedBodies[i]);
+		}
+	}
+
+	int j = 0;
+	std::vector <Rigidbody*> removedBodies;
 	for (int i = 0; i < _bodies.size(); i++) {
-		if (_bodies[i] == r) {
-			if (_bodies[i]->IsStatic()) {
-				if (i < _firstStatic) {		//is in the non static section
-					_bodies.push_back(_bodies[i]);	//move the object at the end
-					_bodies.erase(_bodies.begin() + i);
-					--_firstStatic;
-				}
+		if (_registeredBodies.count(_bodies[i]) == 0 || added.count(_bodies[i]) > 0) {
+			_broadphase.RemoveBody(_bodies[i]);
+			_treeChanges.push_back({ _bodies[i], false });
+			removedBodies.push_back(_bodies[i]);
+			continue;
+		}
+		_bodies[j++] = _bodies[i];
+	}
+	_bodies.resize(j);
+	bool removed = removedBodies.size() > 0;
+
+	//the removed objects are freed after this frame (see EpochManager): the bodies that touched them forget them now,
+	//so the next collision frame never reads a freed collider. Before the islands wake: their sleeping collisions
+	//go on without being checked again (see Rigidbody::_clearSleepingColliders())
+	if (removed) {
+		std::sort(removedBodies.begin(), removedBodies.end());
+		for (int i = 0; i < _bodies.size(); i++) {
+			_bodies[i]->_removeColliders(removedBodies);
+		}
+	}
+
+	//an island that lost a body or the ground under it wakes up, all of them if a body changed between static
+	//and non static. The removed bodies are dropped from the islands without being dereferenced
+	if (_sleepingCount > 0 && (removed || _staticChanged)) {
+		auto isRemoved = [&](Rigidbody* r) {return _registeredBodies.count(r) == 0 || added.count(r) > 0; };
+		for (int id = 0; id < _islands.size(); id++) {
+			std::vector <Rigidbody*>& bodies = _islands[id].bodies;
+			std::vector <Rigidbody*>& touching = _islands[id].touching;
+			if (bodies.size() == 0) {		//free island
+				continue;
 			}
-			else {
-				if (i >= _firstStatic) {		//is in the static section
-					_bodies.insert(_bodies.begin(), _bodies[i]);	//move the object at the start
-					_bodies.erase(_bodies.begin() + i);
-					++_firstStatic;
-				}
+			int sleeping = bodies.size();
+			bodies.erase(std::remove_if(bodies.begin(), bodies.end(), isRemoved), bodies.end());
+			_sleepingCount -= sleeping - bodies.size();
+			int touched = touching.size();
+			touching.erase(std::remove_if(touching.begin(), touching.end(), isRemoved), touching.end());
+			if (_staticChanged || bodies.size() < sleeping || touching.size() < touched) {
+				wakeIsland(id);
+			}
+		}
+	}
+	for (int i = 0; i < _addedBodies.size(); i++) {
+		if (added.erase(_addedBodies[i]) > 0) {
+			_bodies.push_back(_addedBodies[i]);
+			_broadphase.AddBody(_addedBodies[i]);
+			_treeChanges.push_back({ _addedBodies[i], true });
+		}
+	}
+	_addedBodies.clear();
+
+	//non static bodies first
+	auto firstStatic = std::stable_partition(_bodies.begin(), _bodies.end(), [](Rigidbody* r) {return !r->IsStatic(); });
+	_firstStatic = firstStatic - _bodies.begin();
+	if (_staticChanged) {
+		_broadphase.Invalidate();
+	}
+	_bodiesChanged = false;
+	_staticChanged = false;
+}
+
+//apply the body changes to the tree of the scene queries and move the leaves of the bodies that moved.
+//Runs after the pre update of the objects and at the end of the frame, never together with the scene queries
+void PhysicsEngine::UpdateQueryTree() {
+	PROFILE_SCOPE("UpdateQueryTree");
+	std::vector <std::pair <Rigidbody*, bool>> changes;
+	{
+		std::lock_guard <std::mutex> guard(_update_mutex);
+		changes.swap(_treeChanges);
+	}
+	for (int i = 0; i < changes.size(); i++) {
+		Rigidbody* body = changes[i].first;
+		if (changes[i].second) {
+			if (_treeProxies.count(body) == 0) {
+				AABB box;
+				body->GetAABB(box);
+				_treeProxies[body] = _queryTree.CreateProxy(box, body);
+			}
+		}
+		else {
+			auto it = _treeProxies.find(body);		//the body could be already deleted: it is not dereferenced
+			if (it != _treeProxies.end()) {
+				_queryTree.DestroyProxy(it->second);
+				_treeProxies.erase(it);
 			}
-			return;
 		}
 	}
+
+	for (auto it = _treeProxies.begin(); it != _treeProxies.end(); it++) {
+		AABB box;
+		it->first->GetAABB(box);
+		_queryTree.MoveProxy(it->second, box);
+	}
 }
 
+//first body hit by the ray from origin along direction, within maxDistance. A ray that starts inside a body doesn't hit it
+bool PhysicsEngine::Raycast(vector2 origin, vector2 direction, double maxDistance, RaycastHit& hit, unsigned long groupMask) {
+	double length = direction.magnitude();
+	if (length == 0 || maxDistance <= 0) {
+		return false;
+	}
+	vector2 d = { direction.x / length * maxDistance, direction.y / length * maxDistance };
+	vector2 p2 = { origin.x + d.x, origin.y + d.y };
+	bool found = false;
+	auto callback = [&](Rigidbody* body, double maxFraction) {
+		double fraction;
+		vector2 normal;
+		if (!queryFilter(body, groupMask) || !rayPolygon(body, origin, d, maxFraction, fraction, normal)) {
+			return maxFraction;
+		}
+		found = true;
+		hit.body = body;
+		hit.point = { origin.x + d.x * fraction, origin.y + d.y * fraction };
+		hit.normal = normal;
+		hit.distance = fraction * maxDistance;
+		return fraction;
+	};
+	_queryTree.RayCast(origin, p2, callback);
+	return found;
+}
+
+//append the bodies that overlap the circle
+void PhysicsEngine::OverlapCircle(vector2 center, double radius, std::vector <Rigidbody*>& bodies, unsigned long groupMask) {
+	AABB box = { { center.x - radius, center.y - radius }, { center.x + radius, center.y + radius } };
+	auto callback = [&](Rigidbody* body) {
+		if (queryFilter(body, groupMask) && circlePolygon(body, center, radius)) {
+			bodies.push_back(body);
+		}
+		return true;
+	};
+	_queryTree.Query(box, callback);
+}
+
+//append the bodies that overlap the convex polygon. The vertexes are in world coordinates
+void PhysicsEngine::OverlapPolygon(const std::vector <vector2>& vertexes, std::vector <Rigidbody*>& bodies, unsigned long groupMask) {
+	if (vertexes.size() == 0) {
+		return;
+	}
+	AABB box = { vertexes[0], vertexes[0] };
+	for (int i = 1; i < vertexes.size(); i++) {
+		box.min = { std::min(box.min.x, vertexes[i].x), std::min(box.min.y, vertexes[i].y) };
+		box.max = { std::max(box.max.x, vertexes[i].x), std::max(box.max.y, vertexes[i].y) };
+	}
+	auto callback = [&](Rigidbody* body) {
+		if (queryFilter(body, groupMask) && polygonsOverlap(body, vertexes)) {
+			bodies.push_back(body);
+		}
+		return true;
+	};
+	_queryTree.Query(box, callback);
+}
+
+//append the bodies whose bounding box overlaps box
+void PhysicsEngine::QueryAABB(AABB box, std::vector <Rigidbody*>& bodies, unsigned long groupMask) {
+	auto callback = [&](Rigidbody* body) {
+		AABB bodyBox;
+		body->GetAABB(bodyBox);
+		if (queryFilter(body, groupMask) && bodyBox.overlaps(box)
+			&& (body->_getStaticWorld() == nullptr || worldOverlap(body, box))) {
+			bodies.push_back(body);
+		}
+		return true;
+	};
+	_queryTree.Query(box, callback);
+}
+
+//closest body to point within maxDistance, nullptr if there is none. A body that contains the point has distance 0
+Rigidbody* PhysicsEngine::FindNearest(vector2 point, double maxDistance, unsigned long groupMask) {
+	Rigidbody* nearest = nullptr;
+	auto callback = [&](Rigidbody* body, double maxDistance) {
+		if (!queryFilter(body, groupMask)) {
+			return maxDistance;
+		}
+		double distance = pointPolygonDistance(body, point);
+		if (distance > maxDistance || (distance == maxDistance && nearest != nullptr)) {
+			return maxDistance;
+		}
+		nearest = body;
+		return distance;
+	};
+	_queryTree.QueryNearest(point, maxDistance, callback);
+	return nearest;
+}
+
+//the bodies slower than velocity for the sleep time fall asleep with the bodies they touch. 0 (the default) disables the sleep.
+//The rotation counts with the speed of the farthest vertex of the body
 void PhysicsEngine::SetSleepVelocity(double v) {
 	_sleepVelocity = v;
 }
 
-void PhysicsEngine::NewPhysicsFrame(double timeElapsed) {
+//seconds below the sleep velocity before a body can fall asleep
+void PhysicsEngine::SetSleepTime(double seconds) {
+	_sleepTime = seconds;
+}
 
-	frameCollisions.clear();
-	for (int i = 0; i < _bodies.size(); i++) {
-		_bodies[i]->_startCollisionFrame(timeElapsed, _gravity);
-	}
+//times the contact solver goes through the contacts of a frame (8 by default). More iterations make the stacks steadier
+void PhysicsEngine::SetSolverIterations(int iterations) {
+	_solver.SetIterations(iterations);
 }
 
-void PhysicsEngine::UpdatePhysics(double timeElapsed, int thread, int threadCount) {
-	std::vector <CollisionStruct> localCollisions;
-	FMesh* mesh1 = new FMesh(), *mesh2 = new FMesh();
+//groups of contacts solved in parallel in the last frame
+int PhysicsEngine::GetSolverColors() {
+	return _solver.GetColorCount();
+}
 
-	for (int i = thread; i < _firstStatic; i += threadCount) {
-		for (int j = i + 1; j < _bodies.size(); j++) {
-			Rigidbody* body1 = _bodies[i];
-			Rigidbody* body2 = _bodies[j];
-			BoundingBox b1, b2;
+void PhysicsEngine::NewPhysicsFrame(double timeElapsed, int threadCount) {
+	PROFILE_SCOPE("NewPhysicsFrame");
 
-			//no bounding box present or the object doesn't want to be detected
-			bool check_collision = _bodies[i]->GetBoundingBox(b1) && _bodies[j]->GetBoundingBox(b2)
-				&& _bodies[i]->detectCollisions && _bodies[j]->detectCollisions;
-			if (!check_collision) {
-				continue;
-			}
+	ApplyBodyChanges();
 
-			if (b1.type == BoundingBoxType::CONVEX && b2.type == BoundingBoxType::CONVEX) {
-				Check_Convex_Convex_Collision(timeElapsed, body1, b1, body2, b2, localCollisions, *mesh1, *mesh2);
+	//wake the islands of the sleeping bodies pushed, moved or woken by the game. The sleeping bodies are not
+	//integrated and their boxes don't change, the narrowphase skips their pairs with sleeping and static bodies
+	if (_sleepingCount > 0) {
+		for (int i = 0; i < _firstStatic; i++) {
+			if (_bodies[i]->IsSleeping() && _bodies[i]->_shouldWake()) {
+				wakeIsland(_bodies[i]->_getIsland());
 			}
 		}
 	}
+	_awakeBodies.clear();
+	for (int i = 0; i < _firstStatic; i++) {
+		if (!_bodies[i]->IsSleeping()) {
+			_bodies[i]->_setIslandIndex(_awakeBodies.size());
+			_awakeBodies.push_back(_bodies[i]);
+		}
+	}
 
-	std::lock_guard <std::mutex> guard(_collision_buffer_mutex);
-	for (int i = 0; i < localCollisions.size(); i++) {
-		frameCollisions.push_back(localCollisions[i]);
+	frameCollisions.clear();
+	for (int i = 0; i < _awakeBodies.size(); i++) {
+		_awakeBodies[i]->_startCollisionFrame(timeElapsed, _gravity);
+	}
+	for (int i = _firstStatic; i < _bodies.size(); i++) {
+		_bodies[i]->_startCollisionFrame(timeElapsed, _gravity);
 	}
 
-	delete mesh1;
-	delete mesh2;
+	{
+		PROFILE_SCOPE("broadphase");
+		_broadphase.Update();
+	}
+	_totalNarrowphaseAllocations += _narrowphaseAllocations;
+	_narrowphaseAllocations = 0;
+	buildNarrowphaseChunks(threadCount);
 }
 
-void PhysicsEngine::ResolvePhysics(double timeElapsed) {
+//number of chunks of the narrowphase of this frame. UpdatePhysics() is called once for every chunk
+int PhysicsEngine::GetNarrowphaseChunks() {
+	return _chunkStart.size() - 1;
+}
 
-	for (int i = 0; i < frameCollisions.size(); i++) {
-		_resolveCollision(frameCollisions[i]);
-	}
-	/*for (int i = 0; i < _bodies.size(); i++) {
-		_bodies[i]->_applyForces(timeElapsed);
-	}*/
-	for (int i = 0; i < frameCollisions.size(); i++) {
-		_resolveFriction(frameCollisions[i]);
+//keep the pairs of the broadphase whose bodies can collide and split them in chunks with about the same cost.
+//The cost of a pair grows with the vertexes of the two polygons, a circle counts as one vertex and the static world as
+//the couple of shapes a body usually touches. There are a few chunks for every thread,
+//so a thread that ends early can take the chunks left by the others
+void PhysicsEngine::buildNarrowphaseChunks(int threadCount) {
+	const int CHUNKS_PER_THREAD = 4;
+	const std::vector <BroadphasePair>& pairs = _broadphase.GetPairs();
+	_narrowPairs.clear();
+	std::vector <double>& cost = _pairCost;
+	cost.clear();
+	double totalCost = 0;
+	for (int i = 0; i < pairs.size(); i++) {
+		Rigidbody* body1 = pairs[i].A;
+		Rigidbody* body2 = pairs[i].B;
+		BoundingBox b1, b2;
+
+		//no bounding box present or the object doesn't want to be detected
+		bool check_collision = body1->GetBoundingBox(b1) && body2->GetBoundingBox(b2)
+			&& body1->detectCollisions && body2->detectCollisions;
+		if (!check_collision) {
+			continue;
+		}
+		//nothing moves between a sleeping body and a sleeping or static one. The triggers see the sleeping bodies
+		bool resting = body1->IsSleeping() && (body2->IsSleeping() || body2->IsStatic());
+		if (resting && !body1->isTrigger && !body2->isTrigger) {
+			continue;
+		}
+		double vertexes = (b1.type == BoundingBoxType::SPHERE ? 1 : body1->_getLocalVertexes().size())
+			+ (body2->_getStaticWorld() != nullptr ? WORLD_PAIR_VERTEXES
+				: b2.type == BoundingBoxType::SPHERE ? 1 : body2->_getLocalVertexes().size());
+		totalCost += vertexes * vertexes;
+		_narrowPairs.push_back(pairs[i]);
+		cost.push_back(totalCost);
 	}
-	for (int i = 0; i < _firstStatic; i++) {
-		_bodies[i]->_updatePhysics(timeElapsed, _sleepVelocity);
+
+	int chunks = std::min <int>(_narrowPairs.size(), std::max(1, threadCount) * CHUNKS_PER_THREAD);
+	_chunkStart.resize(chunks + 1);
+	_chunkStart[0] = 0;
+	for (int c = 1; c < chunks; c++) {
+		double target = totalCost * c / chunks;
+		int first = std::lower_bound(cost.begin(), cost.end(), target) - cost.begin() + 1;
+		_chunkStart[c] = std::max(_chunkStart[c - 1], std::min <int>(first, _narrowPairs.size()));
 	}
+	_chunkStart[chunks] = _narrowPairs.size();
 
-	for (int i = 0; i < _bodies.size(); i++) {
-		_bodies[i]->_endCollisionFrame();
+	if (_chunkContacts.size() < chunks) {
+		_chunkContacts.resize(chunks);
+	}
+	for (int c = 0; c < chunks; c++) {
+		_chunkContacts[c].clear();		//the buffers keep their memory from the previous frames
 	}
 }
 
-void PhysicsEngine::_updatePhysics(double timeElapsed) {
-
-	for (int i = 0; i < _firstStatic; i++) {
-		_bodies[i]->_updatePhysics(timeElapsed, _sleepVelocity);
+//narrowphase of a chunk of pairs. The chunks run on different threads, every one writes only its own contacts
+void PhysicsEngine::UpdatePhysics(double timeElapsed, int chunk) {
+	PROFILE_SCOPE("UpdatePhysics");
+	uint64_t allocations = AllocationCounter::GetThreadAllocations();
+	std::vector <CollisionStruct>& contacts = _chunkContacts[chunk];
+	NarrowphaseScratch& scratch = _narrowphaseScratch;
+
+	for (int i = _chunkStart[chunk]; i < _chunkStart[chunk + 1]; i++) {
+		Rigidbody* body1 = _narrowPairs[i].A;
+		Rigidbody* body2 = _narrowPairs[i].B;
+		BoundingBox b1, b2;
+		body1->GetBoundingBox(b1);
+		body2->GetBoundingBox(b2);
+		if (body2->_getStaticWorld() != nullptr) {		//the first body of a pair is never static
+			Check_World_Collision(body1, b1, body2, contacts, scratch);
+		}
+		else if (b1.type == BoundingBoxType::CONVEX && b2.type == BoundingBoxType::CONVEX) {
+			Check_Convex_Convex_Collision(timeElapsed, body1, b1, body2, b2, contacts, scratch);
+		}
+		else if (b1.type == BoundingBoxType::SPHERE && b2.type == BoundingBoxType::SPHERE) {
+			Check_Circle_Circle_Collision(body1, b1, body2, b2, contacts);
+		}
+		else {
+			Check_Circle_Convex_Collision(body1, b1, body2, b2, contacts);
+		}
 	}
+
+	_narrowphaseAllocations.fetch_add(AllocationCounter::GetThreadAllocations() - allocations, std::memory_order_relaxed);
 }
 
-void PhysicsEngine::_resolveCollision(CollisionStruct& c) {
+//join the contacts of the chunks in chunk order, so the result doesn't depend on the threads
+void PhysicsEngine::mergeContacts() {
+	int chunks = GetNarrowphaseChunks();
+	int count = 0;
+	for (int c = 0; c < chunks; c++) {
+		count += _chunkContacts[c].size();
+	}
+	frameCollisions.reserve(count);
+	for (int c = 0; c < chunks; c++) {
+		frameCollisions.insert(frameCollisions.end(), _chunkContacts[c].begin(), _chunkContacts[c].end());
+	}
+}
 
-	vector2 va = c.A->velocity;
-	vector2 vb = c.B->velocity;
-	double massA = c.A->mass;
-	double massB = c.B->mass;
-	vector2 normal = c.collisionNormal;
-	double impulse = c.impulse;
+void PhysicsEngine::ResolvePhysics(double timeElapsed) {
+	PROFILE_SCOPE("ResolvePhysics");
+	mergeContacts();
 
-	c.A->velocity += { impulse / massA * normal.x, impulse / massA * normal.y };
-	c.B->velocity -= { impulse / massB * normal.x, impulse / massB * normal.y };
+	//an awake body hit a sleeping one: the island of the sleeping body wakes in the next NewPhysicsFrame(), before the
+	//broadphase, and the contact is found and solved again then. The sleeping bodies have no collision frame
+	//and no place in the solver in this one, so their contacts are dropped
+	int j = 0;
+	for (int i = 0; i < frameCollisions.size(); i++) {
+		CollisionStruct& c = frameCollisions[i];
+		if (c.A->IsSleeping() || c.B->IsSleeping()) {
+			(c.A->IsSleeping() ? c.A : c.B)->WakeUp();
+			continue;
+		}
+		if (j != i) {
+			frameCollisions[j] = c;
+		}
+		j++;
+	}
+	frameCollisions.resize(j);
 
-	c.A->getParentObject()->transform.position += c.postPosA;
-	c.B->getParentObject()->transform.position += c.postPosB;
+	_solver.Solve(frameCollisions, _awakeBodies, timeElapsed);
+	for (int i = 0; i < frameCollisions.size(); i++) {
+		CollisionStruct& c = frameCollisions[i];
+		c.A->_addCollisionImpulse(c.B, c.impulse);
+		c.B->_addCollisionImpulse(c.A, c.impulse);
+	}
+	_updatePhysics(timeElapsed);
+	sweepBullets();
 
-	vector2 ra = c.A->getRelativePoint(c.contactPoint);
-	vector2 rb = c.B->getRelativePoint(c.contactPoint);
+	for (int i = 0; i < _awakeBodies.size(); i++) {
+		_awakeBodies[i]->_endCollisionFrame();
+	}
+	for (int i = _firstStatic; i < _bodies.size(); i++) {
+		_bodies[i]->_endCollisionFrame();
+	}
 
-	c.A->angularVelocity += (ra.cross({ normal.x * impulse, normal.y * impulse }) / c.A->getMOI()) * 180 / MATH_PI;
-	c.B->angularVelocity -= (rb.cross({ normal.x * impulse, normal.y * impulse }) / c.B->getMOI()) * 180 / MATH_PI;
+	updateIslands();
 }
 
-void PhysicsEngine::_resolveFriction(CollisionStruct& c) {
-
-	vector2 v1 = c.A->velocity;
-	vector2 v2 = c.B->velocity;
-	double massA = c.A->mass;
-	double massB = c.B->mass;
-	vector2 rv = { v2.x - v1.x, v2.y - v1.y };
-	vector2 normal = c.collisionNormal;
-
-	// Solve for the tangent vector
-	double t = rv.dot(normal);
-	vector2 tangent;
-	if (t == 0) return;
-	tangent = { rv.x - normal.x * t, rv.y - normal.y * t };
-	if (tangent.magnitude() == 0) return;
-	//}
-	tangent = tangent.normalize();
-
-	// Solve for magnitude to apply along the friction vector
-	float jt = -rv.dot(tangent);
-	jt = jt / (1 / massA + 1 / massB);
+//islands of the awake bodies touching each other in this frame. An island falls asleep when all its bodies
+//were slower than the sleep velocity for the sleep time. The static bodies don't join the islands:
+//the bodies on the same floor don't wake each other
+void PhysicsEngine::updateIslands() {
+	PROFILE_SCOPE("updateIslands");
+	if (_sleepVelocity <= 0) {
+		return;
+	}
+	int count = _awakeBodies.size();
+	_islandParent.resize(count);
+	for (int i = 0; i < count; i++) {
+		_islandParent[i] = i;
+	}
+	for (int i = 0; i < frameCollisions.size(); i++) {
+		CollisionStruct& c = frameCollisions[i];
+		if (c.B->IsStatic()) {
+			continue;
+		}
+		int a = findIsland(c.A->_getIslandIndex());
+		int b = findIsland(c.B->_getIslandIndex());
+		if (a != b) {
+			_islandParent[std::max(a, b)] = std::min(a, b);
+		}
+	}
 
-	// Use to approximate mu given friction coefficients of each body
-	float mu = sqrt(c.A->staticFriction * c.A->staticFriction + c.B->staticFriction * c.B->staticFriction);
+	_islandSleepTime.assign(count, INFINITY);
+	for (int i = 0; i < count; i++) {
+		int root = findIsland(i);
+		_islandSleepTime[root] = std::min(_islandSleepTime[root], _awakeBodies[i]->_getSleepTime());
+	}
 
-	// Clamp magnitude of friction and create impulse vector
-	vector2 frictionImpulse;
-	if (fabs(jt) < fabs(c.impulse * mu))		//static friction
-		frictionImpulse = { jt * tangent.x, jt * tangent.y };
-	else {	//dynamic friction
-		float dynamicFric = sqrt(c.A->dynamicFriction * c.A->dynamicFriction + c.B->dynamicFriction * c.B->dynamicFriction);
-		frictionImpulse = { -c.impulse * tangent.x * dynamicFric, -c.impulse * tangent.y * dynamicFric };
+	//the bodies of the tired islands go to sleep, the others stay in the awake list
+	_islandOfRoot.assign(count, -1);
+	int j = 0;
+	for (int i = 0; i < count; i++) {
+		Rigidbody* body = _awakeBodies[i];
+		int root = findIsland(i);
+		if (_islandSleepTime[root] < _sleepTime) {
+			body->_setIslandIndex(j);
+			_awakeBodies[j++] = body;
+			continue;
+		}
+		if (_islandOfRoot[root] < 0) {
+			if (_freeIslands.size() > 0) {
+				_islandOfRoot[root] = _freeIslands.back();
+				_freeIslands.pop_back();
+			}
+			else {
+				_islandOfRoot[root] = _islands.size();
+				_islands.push_back({});
+			}
+		}
+		SleepingIsland& island = _islands[_islandOfRoot[root]];
+		island.bodies.push_back(body);
+		body->_sleep(_islandOfRoot[root], island.touching);
+		_sleepingCount++;
+	}
+	_awakeBodies.resize(j);
+
+	//a floor under many bodies is kept once
+	for (int i = 0; i < count; i++) {
+		if (_islandOfRoot[i] >= 0) {
+			std::vector <Rigidbody*>& touching = _islands[_islandOfRoot[i]].touching;
+			std::sort(touching.begin(), touching.end());
+			touching.erase(std::unique(touching.begin(), touching.end()), touching.end());
+		}
 	}
+}
 
-	// Apply
-	c.A->velocity += {(1 / massA)* frictionImpulse.x, (1 / massA)* frictionImpulse.y};
-	c.B->velocity -= {(1 / massB)* frictionImpulse.x, (1 / massB)* frictionImpulse.y};
+//root of the island of the awake body, halving the path to it
+int PhysicsEngine::findIsland(int body) {
+	while (_islandParent[body] != body) {
+		_islandParent[body] = _islandParent[_islandParent[body]];
+		body = _islandParent[body];
+	}
+	return body;
+}
 
-	vector2 va = c.A->velocity;
-	vector2 vb = c.B->velocity;
-	double Vt_mag = va.dot(tangent);
-	if (fabs(Vt_mag) < 0.05 && fabs(c.A->getForce().dot(tangent) < 0.05)) {
-		vector2 vt = { tangent.x * Vt_mag, tangent.y * Vt_mag };
-		c.A->velocity -= vt;
+//wake the bodies of the sleeping island. They are simulated from now on
+void PhysicsEngine::wakeIsland(int id) {
+	SleepingIsland& island = _islands[id];
+	for (int i = 0; i < island.bodies.size(); i++) {
+		island.bodies[i]->_wake();
+		island.bodies[i]->_setIslandIndex(_awakeBodies.size());
+		_awakeBodies.push_back(island.bodies[i]);
 	}
-	Vt_mag = vb.dot(tangent);
-	if (fabs(Vt_mag) < 0.05 && fabs(c.B->getForce().dot(tangent) < 0.05)) {
-		vector2 vt = { tangent.x * Vt_mag, tangent.y * Vt_mag };
-		c.B->velocity -= vt;
+	for (int i = 0; i < island.touching.size(); i++) {
+		island.touching[i]->_clearSleepingColliders(id);
 	}
+	_sleepingCount -= island.bodies.size();
+	island.bodies.clear();
+	island.touching.clear();
+	_freeIslands.push_back(id);
+}
+
+void PhysicsEngine::_updatePhysics(double timeElapsed) {
+	PROFILE_SCOPE("IntegrateBodies");
+	parallel_for(0, _awakeBodies.size(), 64, [this, timeElapsed](int i) {
+		_awakeBodies[i]->_updatePhysics(timeElapsed, _sleepVelocity);
+	});
 }
 
 void PhysicsEngine::createRegularPolygon(int sidesCount, double radius, std::vector <vector2>& vertexes) {
@@ -224,17 +602,40 @@ long PhysicsEngine::GetBodiesCount() {
 	return _bodies.size();
 }
 
-bool PhysicsEngine::checkPolygonPenetration(FMesh& m1, FMesh& m2, vector2 &mtv) {
+//heap allocations made by the narrowphase in the last physics frame. Always 0 if the allocation counter
+//is not compiled (see allocationCounter.h)
+unsigned long long PhysicsEngine::GetNarrowphaseAllocations() {
+	return _narrowphaseAllocations;
+}
+
+//heap allocations made by the narrowphase since the start, the last frame excluded
+unsigned long long PhysicsEngine::GetTotalNarrowphaseAllocations() {
+	return _totalNarrowphaseAllocations;
+}
+
+//non static bodies simulated in the last physics frame
+long PhysicsEngine::GetAwakeBodiesCount() {
+	return _firstStatic - _sleepingCount;
+}
+
+//non static bodies that were sleeping at the end of the last physics frame
+long PhysicsEngine::GetSleepingBodiesCount() {
+	return _sleepingCount;
+}
+
+//pairs of bodies whose boxes overlapped in the last physics frame
+long PhysicsEngine::GetPairsCount() {
+	return _broadphase.GetPairs().size();
+}
+
+bool PhysicsEngine::checkPolygonPenetration(ContactMesh& m1, ContactMesh& m2, vector2 &mtv) {
 
 	double overlap = INFINITY;
 	vector2 smallest = {};
 
-	auto axes1(m1.getAxes());
-	auto axes2(m2.getAxes());
-
-	// loop over the axes1
-	for (int i = 0; i < axes1->size(); i++) {
-		vector2 axis = (*axes1)[i];
+	// loop over the axes of m1
+	for (int i = 0; i < m1.v.size(); i++) {
+		vector2 axis = m1.axis(i);
 		// project both shapes onto the axis
 		Projection p1 = m1.project(axis);
 		Projection p2 = m2.project(axis);
@@ -266,9 +667,9 @@ bool PhysicsEngine::checkPolygonPenetration(FMesh& m1, FMesh& m2, vector2 &mtv)
 		}
 	
 	}
-	// loop over the axes2
-	for (int i = 0; i < axes2->size(); i++) {
-		vector2 axis = (*axes2)[i];
+	// loop over the axes of m2
+	for (int i = 0; i < m2.v.size(); i++) {
+		vector2 axis = m2.axis(i);
 		// project both shapes onto the axis
 		Projection p1 = m1.project(axis);
 		Projection p2 = m2.project(axis);
@@ -304,32 +705,17 @@ bool PhysicsEngine::checkPolygonPenetration(FMesh& m1, FMesh& m2, vector2 &mtv)
 	return true;
 }
 
-bool PhysicsEngine::checkPolygonPenetration(FMesh &mesh1, FMesh& mesh2) {
+bool PhysicsEngine::checkPolygonPenetration(ContactMesh &mesh1, ContactMesh& mesh2) {
 
 	for (int a = 0; a < mesh1.v.size(); a++) {
 		int b = (a + 1) % mesh1.v.size();		//second vertex of the side
 		//calculate the axis of projection which is the normal of the side
-		vector2 axisOfProj = { -(mesh1.v[a].y - mesh1.v[b].y), mesh1.v[a].x - mesh1.v[b].x };
-		double min_r1 = INFINITY;
-		double max_r1 = -INFINITY;
+		vector2 axisOfProj = { -(mesh1.v.y[a] - mesh1.v.y[b]), mesh1.v.x[a] - mesh1.v.x[b] };
 
-		//calculate the minimum and maximum value of projection for the first shape
-		for (int p = 0; p < mesh1.v.size(); p++) {
-			//do a dot product between the vertex and the vector of the axis of projection
-			double q = mesh1.v[p].x * axisOfProj.x + mesh1.v[p].y * axisOfProj.y;
-			min_r1 = std::min(min_r1, q);
-			max_r1 = std::max(max_r1, q);
-		}
-
-		//calculate the minimum and maximum value of projection for the second shape
-		double min_r2 = INFINITY;
-		double max_r2 = -INFINITY;
-		for (int p = 0; p < mesh2.v.size(); p++) {
-			//do a dot product between the vertex and the vector of the axis of projection
-			double q = mesh2.v[p].x * axisOfProj.x + mesh2.v[p].y * axisOfProj.y;
-			min_r2 = std::min(min_r2, q);
-			max_r2 = std::max(max_r2, q);
-		}
+		//calculate the minimum and maximum value of projection for the two shapes
+		double min_r1, max_r1, min_r2, max_r2;
+		SimdProjectMinMax(mesh1.v.x.data(), mesh1.v.y.data(), mesh1.v.size(), axisOfProj.x, axisOfProj.y, min_r1, max_r1);
+		SimdProjectMinMax(mesh2.v.x.data(), mesh2.v.y.data(), mesh2.v.size(), axisOfProj.x, axisOfProj.y, min_r2, max_r2);
 
 		if (!(max_r2 >= min_r1 && max_r1 >= min_r2)) {	//they don't overlap
 			return false;
@@ -339,51 +725,49 @@ bool PhysicsEngine::checkPolygonPenetration(FMesh &mesh1, FMesh& mesh2) {
 	return true;
 }
 
-void PhysicsEngine::findVirtualCollisionPoints(FMesh& mesh1, FMesh& mesh2, vector2 velocityAxis,
-	std::vector <struct CollisionPoint>& collisions, int round) {
+void PhysicsEngine::findVirtualCollisionPoints(ContactMesh& mesh1, ContactMesh& mesh2, vector2 velocityAxis,
+	CollisionPoints& collisions, int round) {
 
 	vector2 axisOfProj = { -velocityAxis.y, velocityAxis.x };
 	for (int i = 0; i < mesh2.v.size(); i++) {
-		double q_v = mesh2.v[i].x * axisOfProj.x + mesh2.v[i].y * axisOfProj.y;
+		double q_v = mesh2.v.x[i] * axisOfProj.x + mesh2.v.y[i] * axisOfProj.y;
 		for (int v1 = 0; v1 < mesh1.v.size(); v1++) {
 			int v2 = (v1 + 1) % mesh1.v.size();
-			double q1 = mesh1.v[v1].x * axisOfProj.x + mesh1.v[v1].y * axisOfProj.y;
-			double q2 = mesh1.v[v2].x * axisOfProj.x + mesh1.v[v2].y * axisOfProj.y;
+			double q1 = mesh1.v.x[v1] * axisOfProj.x + mesh1.v.y[v1] * axisOfProj.y;
+			double q2 = mesh1.v.x[v2] * axisOfProj.x + mesh1.v.y[v2] * axisOfProj.y;
 
 			bool contact = ((q1 <= q_v) & (q_v <= q2)) | ((q2 <= q_v) & (q_v <= q1));
 			if (!contact) continue;
 			if (q1 == q_v && q1 == q2) continue;	//all three point aligned
 
 			//calculate the normalized vector of the edge
-			vector2 d2_v = { mesh1.v[v2].x - mesh1.v[v1].x, mesh1.v[v2].y - mesh1.v[v1].y };
+			vector2 d2_v = { mesh1.v.x[v2] - mesh1.v.x[v1], mesh1.v.y[v2] - mesh1.v.y[v1] };
 			double d2_m = sqrt(d2_v.x * d2_v.x + d2_v.y * d2_v.y);
 			vector2 d2 = { d2_v.x / d2_m, d2_v.y / d2_m };
 
 			//calculate the distance of the collision point along the edge from v1 vertex
-			double h = (velocityAxis.x * mesh1.v[v1].y + velocityAxis.y * mesh2.v[i].x
-				- velocityAxis.y * mesh1.v[v1].x - velocityAxis.x * mesh2.v[i].y) / (velocityAxis.y * d2.x - velocityAxis.x * d2.y);
+			double h = (velocityAxis.x * mesh1.v.y[v1] + velocityAxis.y * mesh2.v.x[i]
+				- velocityAxis.y * mesh1.v.x[v1] - velocityAxis.x * mesh2.v.y[i]) / (velocityAxis.y * d2.x - velocityAxis.x * d2.y);
 
 			//calculate the collision point on the edge
-			vector2 collisionPoint = { mesh1.v[v1].x + d2.x * h, mesh1.v[v1].y + d2.y * h };
+			vector2 collisionPoint = { mesh1.v.x[v1] + d2.x * h, mesh1.v.y[v1] + d2.y * h };
 
 			//calculate the distance between the vertex and the collision point
 			double d;
 			if (velocityAxis.x == 0) {
-				d = fabs(collisionPoint.y - mesh2.v[i].y);
+				d = fabs(collisionPoint.y - mesh2.v.y[i]);
 			}else
-				d = fabs((mesh1.v[v1].x - mesh2.v[i].x + d2.x * h) / velocityAxis.x);
+				d = fabs((mesh1.v.x[v1] - mesh2.v.x[i] + d2.x * h) / velocityAxis.x);
 
-			collisions.push_back({ mesh2.v[i], mesh1.v[v1] , mesh1.v[v2], d, collisionPoint, round});
+			collisions.push_back({ mesh2.v.get(i), mesh1.v.get(v1) , mesh1.v.get(v2), d, collisionPoint, round});
 		}
 	}
 }
 
 void PhysicsEngine::Check_Convex_Convex_Collision(double timeElapsed,
 	Rigidbody* body1, BoundingBox& box1, Rigidbody* body2, BoundingBox& box2,
-	std::vector <CollisionStruct>& frameCollisions, FMesh &mesh1, FMesh &mesh2) {
+	std::vector <CollisionStruct>& frameCollisions, NarrowphaseScratch& scratch) {
 
-	BoundingBox* convex1 = &box1;
-	BoundingBox* convex2 = &box2;
 	vector2 pos1 = body1->getParentObject()->transform.position;
 	vector2 pos2 = body2->getParentObject()->transform.position;
 
@@ -394,9 +778,17 @@ void PhysicsEngine::Check_Convex_Convex_Collision(double timeElapsed,
 			> box1.radius + box2.radius)
 		return;
 
-	body1->getMesh(mesh1);
-	body2->getMesh(mesh2);
+	body1->_getContactMesh(scratch.mesh1, pos1);		//the meshes are relative to the first body
+	body2->_getContactMesh(scratch.mesh2, pos1);
+	convexMeshContact(body1, body2, pos1, frameCollisions, scratch);
+}
+
+//contact of the polygons in scratch.mesh1 and scratch.mesh2, relative to pos1
+void PhysicsEngine::convexMeshContact(Rigidbody* body1, Rigidbody* body2, vector2 pos1,
+	std::vector <CollisionStruct>& frameCollisions, NarrowphaseScratch& scratch) {
 
+	ContactMesh& mesh1 = scratch.mesh1;
+	ContactMesh& mesh2 = scratch.mesh2;
 	vector2 velocity1 = body1->velocity;
 	vector2 velocity2 = body2->velocity;
 
@@ -418,10 +810,18 @@ void PhysicsEngine::Check_Convex_Convex_Collision(double timeElapsed,
 		return;
 	}
 
-	//calculate the vector of the relative velocity
+	//calculate the vector of the relative velocity. The contact points are searched along it, or against the mtv
+	//when the bodies don't approach (resting and sliding contacts)
 	vector2 relVelocity = { velocity1.x - velocity2.x, velocity1.y - velocity2.y };
-	double magnitude = sqrt(relVelocity.x * relVelocity.x + relVelocity.y * relVelocity.y);
-	vector2 velocityAxis = { relVelocity.x / magnitude, relVelocity.y / magnitude };
+	double mtvLength = mtv.magnitude();
+	if (mtvLength == 0) {
+		return;
+	}
+	vector2 velocityAxis = { -mtv.x / mtvLength, -mtv.y / mtvLength };
+	if (relVelocity.dot(velocityAxis) > RESTING_VELOCITY) {
+		double magnitude = sqrt(relVelocity.x * relVelocity.x + relVelocity.y * relVelocity.y);
+		velocityAxis = { relVelocity.x / magnitude, relVelocity.y / magnitude };
+	}
 	vector2 deltaP1 = {}, deltaP2 = {};
 	//bool isStatis1 = (body1->mass == INFINITY) | body1->IsStatic();
 	bool isStatis2 = !body2->IsMovable();//(body2->mass == INFINITY) | body2->IsStatic();
@@ -441,7 +841,8 @@ void PhysicsEngine::Check_Convex_Convex_Collision(double timeElapsed,
 		}
 	}
 
-	std::vector <struct CollisionPoint> tempCollisions;
+	CollisionPoints& tempCollisions = scratch.points;
+	tempCollisions.clear();
 	findVirtualCollisionPoints(mesh1, mesh2, velocityAxis, tempCollisions, 1);
 	findVirtualCollisionPoints(mesh2, mesh1, { -velocityAxis.x, -velocityAxis.y }, tempCollisions, -1);
 
@@ -473,7 +874,6 @@ void PhysicsEngine::Check_Convex_Convex_Collision(double timeElapsed,
 	vector2 cp1_v = { velocity1.x - av1 * r1.y, velocity1.y + av1 * r1.x };
 	vector2 cp2_v = { velocity2.x - av2 * r2.y, velocity2.y + av2 * r2.x };
 	vector2 vr = { cp1_v.x - cp2_v.x,  cp1_v.y - cp2_v.y };
-	if (vr.magnitude() < 0.05) return;
 
 	//factor to adjust the collision normal based on the body order
 	double collisionBodyAdj = static_cast<double>(tempCollisions[0].body);
@@ -484,63 +884,770 @@ void PhysicsEngine::Check_Convex_Convex_Collision(double timeElapsed,
 	vector2 collisionNormal = edgeV.normal();
 	collisionNormal = { collisionBodyAdj * collisionNormal.x / mag_v, collisionBodyAdj * collisionNormal.y / mag_v };
 
-	double impulse = CollisionResponce(body1, body2, r1, r2, collisionNormal, vr);
+	double impulse = 0;		//found by the contact solver
+
+	//the contact points spread along the touching faces: the solver gets the two ends, so a body resting
+	//on a face doesn't turn around a single point. The position correction goes with the first one only
+	vector2 tangent = collisionNormal.normal();
+	vector2 firstPoint = collisionPoint, lastPoint = collisionPoint;
+	double minProjection = INFINITY, maxProjection = -INFINITY;
+	for (int i = 0; i < tempCollisions.size(); i++) {
+		vector2 p = { (tempCollisions[i].vertex.x + tempCollisions[i].collisionPoint.x) / 2,
+			(tempCollisions[i].vertex.y + tempCollisions[i].collisionPoint.y) / 2 };
+		double projection = tangent.dot(p);
+		if (projection < minProjection) {
+			minProjection = projection;
+			firstPoint = p;
+		}
+		if (projection > maxProjection) {
+			maxProjection = projection;
+			lastPoint = p;
+		}
+	}
 
+	collisionPoint = { collisionPoint.x + pos1.x, collisionPoint.y + pos1.y };		//back to world coordinates
 	body1->_setCollisions(body2, collisionPoint,  collisionNormal.invert(), vr, impulse, deltaP1);
 	body2->_setCollisions(body1, collisionPoint, collisionNormal, vr, impulse, deltaP2);
 
-	frameCollisions.push_back({body1, body2, collisionPoint, collisionNormal, vr, deltaP1, deltaP2, impulse });
+	if (maxProjection - minProjection > MANIFOLD_WIDTH) {
+		firstPoint = { firstPoint.x + pos1.x, firstPoint.y + pos1.y };
+		lastPoint = { lastPoint.x + pos1.x, lastPoint.y + pos1.y };
+		frameCollisions.push_back({ body1, body2, firstPoint, collisionNormal, vr, deltaP1, deltaP2, impulse });
+		frameCollisions.push_back({ body1, body2, lastPoint, collisionNormal, vr, {}, {}, impulse });
+	}
+	else {
+		frameCollisions.push_back({ body1, body2, collisionPoint, collisionNormal, vr, deltaP1, deltaP2, impulse });
+	}
 
 }
 
-void PhysicsEngine::filterCollisionPoints(std::vector <struct CollisionPoint>& collisions) {
-	//find first contact
-	double dmin = INFINITY;
-	int minIndex;
+//the sign of the area of the polygon: the normal of edge a->b is sign * (b - a).normal() inverted
+static double polygonOrientation(const VertexArray& v) {
+	double area = 0;
+	for (int i = 0; i < v.size(); i++) {
+		vector2 a = v.get(i);
+		vector2 b = v.get((i + 1) % v.size());
+		area += a.x * b.y - a.y * b.x;
+	}
+	return area >= 0 ? 1.0 : -1.0;
+}
+
+void PhysicsEngine::Check_Circle_Circle_Collision(Rigidbody* body1, BoundingBox& box1, Rigidbody* body2, BoundingBox& box2,
+	std::vector <CollisionStruct>& frameCollisions) {
+
+	vector2 center1 = body1->_getCenter();
+	vector2 center2 = body2->_getCenter();
+	vector2 d = { center1.x - center2.x, center1.y - center2.y };
+	double radius = box1.radius + box2.radius;
+	double distanceSquared = d.dot(d);
+	if (distanceSquared > radius * radius)
+		return;
+
+	double distance = sqrt(distanceSquared);
+	vector2 normal = distance > 0 ? vector2{ d.x / distance, d.y / distance } : vector2{ 0, -1 };		//from body2 to body1
+	double penetration = radius - distance;
+	//middle of the overlap
+	double k = box2.radius - penetration / 2;
+	vector2 point = { center2.x + normal.x * k, center2.y + normal.y * k };
+	addContact(body1, body2, point, normal, penetration, frameCollisions);
+}
+
+void PhysicsEngine::Check_Circle_Convex_Collision(Rigidbody* body1, BoundingBox& box1, Rigidbody* body2, BoundingBox& box2,
+	std::vector <CollisionStruct>& frameCollisions) {
+
+	bool circleFirst = box1.type == BoundingBoxType::SPHERE;
+	Rigidbody* circle = circleFirst ? body1 : body2;
+	Rigidbody* convex = circleFirst ? body2 : body1;
+	double radius = circleFirst ? box1.radius : box2.radius;
+
+	vector2 point, normal;
+	double penetration;
+	if (!circleConvexContact(convex->_getLocalVertexes(), convex->_getCenter(), circle->_getCenter(), radius, point, normal, penetration))
+		return;
 
-	for (int i = 0; i < collisions.size(); i++) {
-		if (collisions[i].distance < dmin) {
-			dmin = collisions[i].distance;
-			minIndex = i;
+	if (!circleFirst) {		//the normal goes from body2 to body1
+		normal = normal.invert();
+	}
+	addContact(body1, body2, point, normal, penetration, frameCollisions);
+}
+
+//contacts of the body with the shapes of the static world around it, found in the tree of the world with the box of the body.
+//The shapes collide like the bodies: a polygon gets the contact points search against every shape it overlaps
+void PhysicsEngine::Check_World_Collision(Rigidbody* body1, BoundingBox& box1, Rigidbody* world,
+	std::vector <CollisionStruct>& frameCollisions, NarrowphaseScratch& scratch) {
+
+	const StaticWorld* shapes = world->_getStaticWorld();
+	vector2 pos1 = body1->getParentObject()->transform.position;
+	vector2 center = body1->_getCenter();
+	bool circle = box1.type == BoundingBoxType::SPHERE;
+	AABB box;
+	body1->GetAABB(box);
+	auto callback = [&](int shape) {
+		if (circle) {
+			vector2 point, normal;
+			double penetration;
+			shapes->GetVertexes(shape, scratch.mesh2.v);
+			if (circleConvexContact(scratch.mesh2.v, shapes->GetShape(shape).center, center, box1.radius, point, normal, penetration)) {
+				addContact(body1, world, point, normal, penetration, frameCollisions);
+			}
+		}
+		else {
+			body1->_getContactMesh(scratch.mesh1, pos1);		//the contact with the last shape moved it
+			shapes->GetContactMesh(shape, scratch.mesh2, pos1);
+			convexMeshContact(body1, world, pos1, frameCollisions, scratch);
+		}
+		return true;
+	};
+	shapes->Query(box, callback);
+}
+
+//contact between the polygon v centered in origin and a circle: the point on the side of the polygon, the normal from the polygon
+//to the circle. The side nearest to the center is found like in the separating axis test, then the center is checked
+//against its vertexes. An edge (2 vertexes) has the two sides with opposite normals, so it works from both sides
+bool PhysicsEngine::circleConvexContact(const VertexArray& v, vector2 origin, vector2 center, double radius,
+	vector2& point, vector2& normal, double& penetration) {
+
+	if (v.size() < 2) {
+		return false;
+	}
+	vector2 p = { center.x - origin.x, center.y - origin.y };
+	double orientation = polygonOrientation(v);
+
+	int side = 0;
+	double separation = -INFINITY;
+	vector2 sideNormal = {};
+	for (int i = 0; i < v.size(); i++) {
+		vector2 a = v.get(i);
+		vector2 b = v.get((i + 1) % v.size());
+		vector2 n = vector2{ (b.y - a.y) * orientation, -(b.x - a.x) * orientation }.normalize();		//outward
+		double s = n.x * (p.x - a.x) + n.y * (p.y - a.y);
+		if (s > radius) {
+			return false;
+		}
+		if (s > separation) {
+			separation = s;
+			side = i;
+			sideNormal = n;
 		}
 	}
 
-	//erase all useless collisions
-	for (int i = 0; i < collisions.size(); i++) {
-		if (collisions[i].distance > dmin) {
-			collisions.erase(collisions.begin() + i);
-			i--;
+	vector2 a = v.get(side);
+	vector2 b = v.get((side + 1) % v.size());
+	vector2 contact;
+	if (separation <= 0) {		//the center is inside the polygon
+		normal = sideNormal;
+		penetration = radius - separation;
+		contact = { p.x - sideNormal.x * separation, p.y - sideNormal.y * separation };
+	}
+	else if ((p.x - a.x) * (b.x - a.x) + (p.y - a.y) * (b.y - a.y) <= 0 ||
+		(p.x - b.x) * (a.x - b.x) + (p.y - b.y) * (a.y - b.y) <= 0) {		//nearest to a vertex
+		vector2 vertex = (p.x - a.x) * (b.x - a.x) + (p.y - a.y) * (b.y - a.y) <= 0 ? a : b;
+		vector2 d = { p.x - vertex.x, p.y - vertex.y };
+		double distance = d.magnitude();
+		if (distance > radius || distance == 0) {
+			return false;
 		}
+		normal = { d.x / distance, d.y / distance };
+		penetration = radius - distance;
+		contact = vertex;
 	}
+	else {
+		normal = sideNormal;
+		penetration = radius - separation;
+		contact = { p.x - sideNormal.x * separation, p.y - sideNormal.y * separation };
+	}
+	point = { contact.x + origin.x, contact.y + origin.y };
+	return true;
+}
+
+//contact of the shapes that don't need the contact points search. The normal goes from body2 to body1,
+//the position correction is given like in Check_Convex_Convex_Collision()
+void PhysicsEngine::addContact(Rigidbody* body1, Rigidbody* body2, vector2 point, vector2 normal, double penetration,
+	std::vector <CollisionStruct>& frameCollisions) {
 
-	//remove double collisions
-	for (int i = 0; i < collisions.size(); i++) {
-		if (collisions[i].body != collisions[0].body) {
-			collisions.erase(collisions.begin() + i);
-			i--;
+	//if either of the two rigidbody is a trigger there is no collision so we can stop here
+	if (body1->isTrigger | body2->isTrigger) {
+		if (body1->isTrigger) {
+			body1->_setCollisions(body2, {}, {}, {}, 0, {});
 		}
+		if (body2->isTrigger) {
+			body2->_setCollisions(body1, {}, {}, {}, 0, {});
+		}
+		return;
+	}
+
+	vector2 velocity1 = body1->velocity;
+	vector2 velocity2 = body2->velocity;
+	vector2 mtv = { normal.x * penetration, normal.y * penetration };
+	vector2 deltaP1 = {}, deltaP2 = {};
+	if (!body2->IsMovable() || velocity1.magnitude() > velocity2.magnitude()) {
+		deltaP1 = mtv;
 	}
+	else {
+		deltaP2 = mtv.invert();
+	}
+
+	vector2 r1 = body1->getRelativePoint(point);
+	vector2 r2 = body2->getRelativePoint(point);
+	double av1 = body1->angularVelocity * MATH_PI / 180.0;
+	double av2 = body2->angularVelocity * MATH_PI / 180.0;
+	vector2 cp1_v = { velocity1.x - av1 * r1.y, velocity1.y + av1 * r1.x };
+	vector2 cp2_v = { velocity2.x - av2 * r2.y, velocity2.y + av2 * r2.x };
+	vector2 vr = { cp1_v.x - cp2_v.x,  cp1_v.y - cp2_v.y };
+
+	double impulse = 0;		//found by the contact solver
+	body1->_setCollisions(body2, point, normal.invert(), vr, impulse, deltaP1);
+	body2->_setCollisions(body1, point, normal, vr, impulse, deltaP2);
+
+	frameCollisions.push_back({ body1, body2, point, normal, vr, deltaP1, deltaP2, impulse });
 }
 
-double PhysicsEngine::CollisionResponce(Rigidbody* body1, Rigidbody* body2, 
-	vector2& r1, vector2 &r2, vector2& normal, vector2& vr) {
+//first time (fraction of the motion) the circle moving by d touches the circle of radius at center.
+//The circles that overlap at the start or move apart are skipped
+static bool sweepCircleCircle(vector2 start, vector2 d, vector2 center, double radius, double& t, vector2& normal) {
+	vector2 m = { start.x - center.x, start.y - center.y };
+	double c = m.dot(m) - radius * radius;
+	double b = m.dot(d);
+	double a = d.dot(d);
+	if (c <= 0 || b >= 0 || a == 0) {
+		return false;
+	}
+	double discriminant = b * b - a * c;
+	if (discriminant < 0) {
+		return false;
+	}
+	t = (-b - sqrt(discriminant)) / a;
+	if (t > 1) {
+		return false;
+	}
+	normal = vector2{ m.x + d.x * t, m.y + d.y * t }.normalize();
+	return true;
+}
 
-	double e = body1->elasticity * body2->elasticity;
-	double m1 = body1->mass;
-	double m2 = body2->mass;
+//the circle moving by d against the polygon v centered in origin: the center against the sides moved out by the radius
+//and the circles of the vertexes. The normal goes from the polygon to the circle. v can be an edge
+static bool sweepCircleConvex(vector2 start, double radius, vector2 d, const VertexArray& v, vector2 origin,
+	double& t, vector2& normal) {
+	if (v.size() < 2) {
+		return false;
+	}
+	vector2 p = { start.x - origin.x, start.y - origin.y };
+	double orientation = polygonOrientation(v);
+	bool hit = false;
+	t = INFINITY;
+	for (int i = 0; i < v.size(); i++) {
+		vector2 a = v.get(i);
+		vector2 b = v.get((i + 1) % v.size());
+		vector2 e = { b.x - a.x, b.y - a.y };
+		vector2 n = vector2{ e.y * orientation, -e.x * orientation }.normalize();		//outward
+		double separation = n.x * (p.x - a.x) + n.y * (p.y - a.y) - radius;
+		double approach = n.dot(d);
+		if (separation >= 0 && approach < 0) {
+			double time = -separation / approach;
+			vector2 q = { p.x + d.x * time - a.x, p.y + d.y * time - a.y };
+			double along = q.dot(e);
+			if (time < t && along >= 0 && along <= e.dot(e)) {
+				t = time;
+				normal = n;
+				hit = true;
+			}
+		}
+		double time;
+		vector2 vertexNormal;
+		if (sweepCircleCircle(p, d, a, radius, time, vertexNormal) && time < t) {
+			t = time;
+			normal = vertexNormal;
+			hit = true;
+		}
+	}
+	return hit && t <= 1;
+}
 
-	double I1 = body1->getMOI();
-	double I2 = body2->getMOI();
+//separating axis test of the polygon a moving by d against the polygon b: on every axis the interval of a enters the
+//one of b at some time and leaves it later. The polygons touch at the last entering time, if it comes before the first
+//leaving time. The normal is the axis of the last entering time, from b to a. b can be an edge
+static bool sweepConvexConvex(const VertexArray& va, vector2 originA, vector2 d, const VertexArray& vb, vector2 originB,
+	double& t, vector2& normal) {
+	if (va.size() < 3 || vb.size() < 2) {
+		return false;
+	}
+	double enter = -INFINITY, leave = INFINITY;
+	const VertexArray* shapes[2] = { &va, &vb };
+	for (int shape = 0; shape < 2; shape++) {
+		const VertexArray& v = *shapes[shape];
+		for (int i = 0; i < v.size(); i++) {
+			vector2 a = v.get(i);
+			vector2 b = v.get((i + 1) % v.size());
+			vector2 axis = vector2{ a.y - b.y, b.x - a.x }.normalize();
+			double minA, maxA, minB, maxB;
+			SimdProjectMinMax(va.x.data(), va.y.data(), va.size(), axis.x, axis.y, minA, maxA);
+			SimdProjectMinMax(vb.x.data(), vb.y.data(), vb.size(), axis.x, axis.y, minB, maxB);
+			minA += axis.dot(originA);
+			maxA += axis.dot(originA);
+			minB += axis.dot(originB);
+			maxB += axis.dot(originB);
+			double speed = axis.dot(d);
+			if (speed == 0) {
+				if (maxA < minB || maxB < minA) {		//never meet on this axis
+					return false;
+				}
+				continue;
+			}
+			double t0 = speed > 0 ? (minB - maxA) / speed : (maxB - minA) / speed;
+			double t1 = speed > 0 ? (maxB - minA) / speed : (minB - maxA) / speed;
+			if (t0 > enter) {
+				enter = t0;
+				normal = speed > 0 ? axis.invert() : axis;
+			}
+			leave = std::min(leave, t1);
+			if (enter > leave || enter > 1 || leave < 0) {
+				return false;
+			}
+		}
+	}
+	if (enter < 0) {		//overlapping at the start: left to the narrowphase
+		return false;
+	}
+	t = enter;
+	return true;
+}
 
-	double z = r1.cross(normal);
-	vector2 a1 = { -z * r1.y / I1, z * r1.x / I1 };
-	//vector2 a1 = IJ1.dot(temp);
-	z = r2.cross(normal);
-	//temp = { z * r2.y, z * r2.x };
-	vector2 a2 = { -z * r2.y / I2, z * r2.x / I2 };
+//time of impact of the bullet moving by motion against the body, at the positions and rotations of the pre update
+//(the rotation of the bullet during the frame is not swept). The normal goes from the body to the bullet
+bool PhysicsEngine::timeOfImpact(Rigidbody* bullet, vector2 motion, Rigidbody* body, double& t, vector2& normal) {
+	if (body->_getStaticWorld() != nullptr) {
+		return sweepWorld(bullet, motion, body, t, normal);
+	}
+	vector2 start = bullet->_getCenter();
+	vector2 center = body->_getCenter();
+	if (bullet->_isCircle() && body->_isCircle()) {
+		return sweepCircleCircle(start, motion, center, bullet->_getRadius() + body->_getRadius(), t, normal);
+	}
+	if (bullet->_isCircle()) {
+		return sweepCircleConvex(start, bullet->_getRadius(), motion, body->_getLocalVertexes(), center, t, normal);
+	}
+	if (body->_isCircle()) {		//the circle moves against the bullet
+		if (!sweepCircleConvex(center, body->_getRadius(), motion.invert(), bullet->_getLocalVertexes(), start, t, normal)) {
+			return false;
+		}
+		normal = normal.invert();
+		return true;
+	}
+	return sweepConvexConvex(bullet->_getLocalVertexes(), start, motion, body->_getLocalVertexes(), center, t, normal);
+}
 
-	double jr = -(1+e) * vr.dot(normal);
-	jr = jr / ((1 / m1) + (1 / m2) + normal.dot({ a1.x + a2.x, a1.y + a2.y }));
+//first time of impact of the bullet against the shapes of the static world found along its motion
+bool PhysicsEngine::sweepWorld(Rigidbody* bullet, vector2 motion, Rigidbody* world, double& t, vector2& normal) {
+	const StaticWorld* shapes = world->_getStaticWorld();
+	vector2 start = bullet->_getCenter();
+	AABB box;
+	bullet->GetAABB(box);
+	AABB swept = { { std::min(box.min.x, box.min.x + motion.x), std::min(box.min.y, box.min.y + motion.y) },
+		{ std::max(box.max.x, box.max.x + motion.x), std::max(box.max.y, box.max.y + motion.y) } };
+	VertexArray v;
+	bool hit = false;
+	t = INFINITY;
+	auto callback = [&](int shape) {
+		shapes->GetVertexes(shape, v);
+		vector2 center = shapes->GetShape(shape).center;
+		double time;
+		vector2 shapeNormal;
+		bool found = bullet->_isCircle() ? sweepCircleConvex(start, bullet->_getRadius(), motion, v, center, time, shapeNormal)
+			: sweepConvexConvex(bullet->_getLocalVertexes(), start, motion, v, center, time, shapeNormal);
+		if (found && time < t) {
+			t = time;
+			normal = shapeNormal;
+			hit = true;
+		}
+		return true;
+	};
+	shapes->Query(swept, callback);
+	return hit;
+}
 
-	return jr;
+//continuous collision of the bullets: the motion of the frame is swept against the bodies around and a bullet that
+//would pass through a body stops where it touches it, with the impulse of the hit applied. It is left overlapping
+//by a small distance, so the narrowphase finds the contact in the next frame
+void PhysicsEngine::sweepBullets() {
+	PROFILE_SCOPE("sweepBullets");
+	const double PENETRATION = 0.01;
+
+	for (int i = 0; i < _awakeBodies.size(); i++) {
+		Rigidbody* bullet = _awakeBodies[i];
+		if (!bullet->isBullet || bullet->isTrigger || !bullet->detectCollisions) {
+			continue;
+		}
+		BoundingBox bulletBox;
+		if (!bullet->GetBoundingBox(bulletBox)) {
+			continue;
+		}
+		vector2 start = bullet->_getCenter();
+		vector2 end = bullet->getParentObject()->transform.position;
+		vector2 motion = { end.x - start.x, end.y - start.y };
+		double distance = motion.magnitude();
+		if (distance == 0) {
+			continue;
+		}
+
+		AABB box;
+		bullet->GetAABB(box);
+		AABB swept = { { std::min(box.min.x, box.min.x + motion.x), std::min(box.min.y, box.min.y + motion.y) },
+			{ std::max(box.max.x, box.max.x + motion.x), std::max(box.max.y, box.max.y + motion.y) } };
+		Rigidbody* hit = nullptr;
+		double hitTime = INFINITY;
+		vector2 hitNormal = {};
+		auto callback = [&](Rigidbody* body) {
+			BoundingBox b;
+			if (body == bullet || body->isTrigger || !body->detectCollisions || !body->GetBoundingBox(b)) {
+				return true;
+			}
+			double t;
+			vector2 normal;
+			if (timeOfImpact(bullet, motion, body, t, normal) && t < hitTime) {
+				hit = body;
+				hitTime = t;
+				hitNormal = normal;
+			}
+			return true;
+		};
+		_queryTree.Query(swept, callback);
+		if (hit == nullptr) {
+			continue;
+		}
+
+		double t = std::min(1.0, hitTime + PENETRATION / distance);
+		bullet->getParentObject()->transform.position = { start.x + motion.x * t, start.y + motion.y * t };
+
+		//impulse along the normal, the restitution of the bodies included
+		vector2 v1 = bullet->velocity;
+		vector2 v2 = hit->velocity;
+		double approach = (v1.x - v2.x) * hitNormal.x + (v1.y - v2.y) * hitNormal.y;
+		if (approach >= 0) {
+			continue;
+		}
+		double invMass1 = bullet->mass == INFINITY ? 0 : 1 / bullet->mass;
+		double invMass2 = (hit->IsStatic() || hit->mass == INFINITY) ? 0 : 1 / hit->mass;
+		if (invMass1 + invMass2 == 0) {
+			continue;
+		}
+		double impulse = -(1 + bullet->elasticity * hit->elasticity) * approach / (invMass1 + invMass2);
+		bullet->velocity = { v1.x + hitNormal.x * impulse * invMass1, v1.y + hitNormal.y * impulse * invMass1 };
+		if (invMass2 > 0) {
+			hit->velocity = { v2.x - hitNormal.x * impulse * invMass2, v2.y - hitNormal.y * impulse * invMass2 };
+			hit->WakeUp();
+		}
+	}
+}
+
+bool PhysicsEngine::queryFilter(Rigidbody* body, unsigned long groupMask) {
+	return (groupMask & body->getParentObject()->group) != 0;
+}
+
+//clip the segment p1 + d * t against the sides of the polygon v centered in center. An edge is crossed from both sides
+static bool rayConvex(const VertexArray& v, vector2 center, vector2 p1, vector2 d, double maxFraction,
+	double& fraction, vector2& normal) {
+	vector2 p = { p1.x - center.x, p1.y - center.y };
+	if (v.size() == 2) {
+		vector2 a = v.get(0);
+		vector2 e = { v.x[1] - a.x, v.y[1] - a.y };
+		double denominator = d.cross(e);
+		if (denominator == 0) {
+			return false;
+		}
+		vector2 ap = { a.x - p.x, a.y - p.y };
+		double t = ap.cross(e) / denominator;
+		double s = ap.cross(d) / denominator;
+		if (t < 0 || t > maxFraction || s < 0 || s > 1) {
+			return false;
+		}
+		normal = vector2{ e.y, -e.x }.normalize();
+		if (normal.dot(d) > 0) {
+			normal = normal.invert();
+		}
+		fraction = t;
+		return true;
+	}
+	if (v.size() < 3) {
+		return false;
+	}
+	double orientation = polygonOrientation(v);
+
+	double lower = 0;
+	double upper = maxFraction;
+	int index = -1;
+	for (int i = 0; i < v.size(); i++) {
+		vector2 a = v.get(i);
+		vector2 b = v.get((i + 1) % v.size());
+		vector2 n = { (b.y - a.y) * orientation, -(b.x - a.x) * orientation };		//outward
+		double numerator = n.x * (a.x - p.x) + n.y * (a.y - p.y);
+		double denominator = n.dot(d);
+		if (denominator == 0) {
+			if (numerator < 0) {		//parallel and outside
+				return false;
+			}
+		}
+		else if (denominator < 0 && numerator < lower * denominator) {		//entering
+			lower = numerator / denominator;
+			index = i;
+		}
+		else if (denominator > 0 && numerator < upper * denominator) {		//leaving
+			upper = numerator / denominator;
+		}
+		if (upper < lower) {
+			return false;
+		}
+	}
+	if (index < 0) {
+		return false;
+	}
+	vector2 a = v.get(index);
+	vector2 b = v.get((index + 1) % v.size());
+	normal = vector2{ (b.y - a.y) * orientation, -(b.x - a.x) * orientation }.normalize();
+	fraction = lower;
+	return true;
+}
+
+//the vertexes are used relative to the center, without building the world mesh
+bool PhysicsEngine::rayPolygon(Rigidbody* body, vector2 p1, vector2 d, double maxFraction, double& fraction, vector2& normal) {
+	if (body->_isCircle()) {
+		return rayCircle(body, p1, d, maxFraction, fraction, normal);
+	}
+	if (body->_getStaticWorld() != nullptr) {
+		return rayWorld(body, p1, d, maxFraction, fraction, normal);
+	}
+	return rayConvex(body->_getLocalVertexes(), body->_getCenter(), p1, d, maxFraction, fraction, normal);
+}
+
+//first shape of the static world hit by the segment p1 + d * t
+bool PhysicsEngine::rayWorld(Rigidbody* world, vector2 p1, vector2 d, double maxFraction, double& fraction, vector2& normal) {
+	const StaticWorld* shapes = world->_getStaticWorld();
+	VertexArray v;
+	bool hit = false;
+	auto callback = [&](int shape, double maxFraction) {
+		double shapeFraction;
+		vector2 shapeNormal;
+		shapes->GetVertexes(shape, v);
+		if (!rayConvex(v, shapes->GetShape(shape).center, p1, d, maxFraction, shapeFraction, shapeNormal)) {
+			return maxFraction;
+		}
+		hit = true;
+		fraction = shapeFraction;
+		normal = shapeNormal;
+		return shapeFraction;
+	};
+	shapes->RayCast(p1, d, maxFraction, callback);
+	return hit;
+}
+
+//first point of the segment p1 + d * t in the circle of the body
+bool PhysicsEngine::rayCircle(Rigidbody* body, vector2 p1, vector2 d, double maxFraction, double& fraction, vector2& normal) {
+	vector2 center = body->_getCenter();
+	double radius = body->_getRadius();
+	vector2 m = { p1.x - center.x, p1.y - center.y };
+	double c = m.dot(m) - radius * radius;
+	if (c <= 0) {		//starts inside
+		return false;
+	}
+	double a = d.dot(d);
+	double b = m.dot(d);
+	double discriminant = b * b - a * c;
+	if (a == 0 || discriminant < 0) {
+		return false;
+	}
+	double t = (-b - sqrt(discriminant)) / a;
+	if (t < 0 || t > maxFraction) {
+		return false;
+	}
+	normal = vector2{ m.x + d.x * t, m.y + d.y * t }.normalize();
+	fraction = t;
+	return true;
+}
+
+bool PhysicsEngine::circlePolygon(Rigidbody* body, vector2 center, double radius) {
+	return pointPolygonDistance(body, center) <= radius;
+}
+
+//distance of the point from the polygon v centered in center, 0 if the point is inside
+static double pointConvexDistance(const VertexArray& v, vector2 center, vector2 point) {
+	if (v.size() == 0) {
+		return INFINITY;
+	}
+	vector2 p = { point.x - center.x, point.y - center.y };
+	double orientation = polygonOrientation(v);
+
+	bool inside = v.size() >= 3;
+	double distance = INFINITY;
+	for (int i = 0; i < v.size(); i++) {
+		vector2 a = v.get(i);
+		vector2 b = v.get((i + 1) % v.size());
+		vector2 e = { b.x - a.x, b.y - a.y };
+		vector2 ap = { p.x - a.x, p.y - a.y };
+		if (e.cross(ap) * orientation < 0) {
+			inside = false;
+		}
+		double length = e.dot(e);
+		double t = length > 0 ? std::max(0.0, std::min(1.0, e.dot(ap) / length)) : 0;
+		vector2 c = { ap.x - e.x * t, ap.y - e.y * t };
+		distance = std::min(distance, c.magnitude());
+	}
+	return inside ? 0 : distance;
+}
+
+//0 if the point is inside the body
+double PhysicsEngine::pointPolygonDistance(Rigidbody* body, vector2 point) {
+	if (body->_isCircle()) {
+		vector2 center = body->_getCenter();
+		vector2 d = { point.x - center.x, point.y - center.y };
+		return std::max(0.0, d.magnitude() - body->_getRadius());
+	}
+	if (body->_getStaticWorld() != nullptr) {
+		return pointWorldDistance(body, point);
+	}
+	return pointConvexDistance(body->_getLocalVertexes(), body->_getCenter(), point);
+}
+
+//distance from the nearest shape of the static world
+double PhysicsEngine::pointWorldDistance(Rigidbody* world, vector2 point) {
+	const StaticWorld* shapes = world->_getStaticWorld();
+	VertexArray v;
+	double distance = INFINITY;
+	auto callback = [&](int shape, double maxDistance) {
+		shapes->GetVertexes(shape, v);
+		distance = std::min(distance, pointConvexDistance(v, shapes->GetShape(shape).center, point));
+		return distance;
+	};
+	shapes->QueryNearest(point, INFINITY, callback);
+	return distance;
+}
+
+//separating axis test between the polygon v centered in center and a convex polygon in world coordinates
+static bool convexOverlap(const VertexArray& v, vector2 center, const std::vector <vector2>& vertexes) {
+	int count[2] = { v.size(), (int)vertexes.size() };
+	for (int shape = 0; shape < 2; shape++) {
+		for (int i = 0; i < count[shape]; i++) {
+			vector2 a, b;
+			if (shape == 0) {
+				a = v.get(i);
+				b = v.get((i + 1) % count[0]);
+			}
+			else {
+				a = vertexes[i];
+				b = vertexes[(i + 1) % count[1]];
+			}
+			vector2 axis = { a.y - b.y, b.x - a.x };
+
+			double min1 = INFINITY, max1 = -INFINITY;
+			if (count[0] > 0) {
+				SimdProjectMinMax(v.x.data(), v.y.data(), count[0], axis.x, axis.y, min1, max1);
+				min1 += axis.dot(center);
+				max1 += axis.dot(center);
+			}
+			double min2 = INFINITY, max2 = -INFINITY;
+			for (int k = 0; k < count[1]; k++) {
+				double projection = axis.x * vertexes[k].x + axis.y * vertexes[k].y;
+				min2 = std::min(min2, projection);
+				max2 = std::max(max2, projection);
+			}
+			if (max1 < min2 || max2 < min1) {
+				return false;
+			}
+		}
+	}
+	return count[0] > 0;
+}
+
+//separating axis test between the body and a convex polygon in world coordinates
+bool PhysicsEngine::polygonsOverlap(Rigidbody* body, const std::vector <vector2>& vertexes) {
+	if (body->_getStaticWorld() != nullptr) {
+		return worldOverlap(body, vertexes);
+	}
+	vector2 center = body->_getCenter();
+	if (body->_isCircle()) {		//axes of the polygon and the axis from the nearest vertex to the center
+		double radius = body->_getRadius();
+		int nearest = 0;
+		for (int i = 1; i < vertexes.size(); i++) {
+			vector2 d1 = { vertexes[i].x - center.x, vertexes[i].y - center.y };
+			vector2 d2 = { vertexes[nearest].x - center.x, vertexes[nearest].y - center.y };
+			if (d1.dot(d1) < d2.dot(d2)) {
+				nearest = i;
+			}
+		}
+		for (int i = 0; i <= vertexes.size(); i++) {
+			vector2 axis;
+			if (i < vertexes.size()) {
+				vector2 a = vertexes[i];
+				vector2 b = vertexes[(i + 1) % vertexes.size()];
+				axis = { a.y - b.y, b.x - a.x };
+			}
+			else {
+				axis = { center.x - vertexes[nearest].x, center.y - vertexes[nearest].y };
+			}
+			double extent = radius * axis.magnitude();
+			double min1 = axis.dot(center) - extent, max1 = axis.dot(center) + extent;
+			double min2 = INFINITY, max2 = -INFINITY;
+			for (int k = 0; k < vertexes.size(); k++) {
+				double projection = axis.x * vertexes[k].x + axis.y * vertexes[k].y;
+				min2 = std::min(min2, projection);
+				max2 = std::max(max2, projection);
+			}
+			if (max1 < min2 || max2 < min1) {
+				return false;
+			}
+		}
+		return true;
+	}
+	return convexOverlap(body->_getLocalVertexes(), center, vertexes);
+}
+
+//the convex polygon in world coordinates overlaps a shape of the static world
+bool PhysicsEngine::worldOverlap(Rigidbody* world, const std::vector <vector2>& vertexes) {
+	const StaticWorld* shapes = world->_getStaticWorld();
+	AABB box = { vertexes[0], vertexes[0] };
+	for (int i = 1; i < vertexes.size(); i++) {
+		box.min = { std::min(box.min.x, vertexes[i].x), std::min(box.min.y, vertexes[i].y) };
+		box.max = { std::max(box.max.x, vertexes[i].x), std::max(box.max.y, vertexes[i].y) };
+	}
+	VertexArray v;
+	bool found = false;
+	auto callback = [&](int shape) {
+		shapes->GetVertexes(shape, v);
+		found = convexOverlap(v, shapes->GetShape(shape).center, vertexes);
+		return !found;
+	};
+	shapes->Query(box, callback);
+	return found;
+}
+
+//the box overlaps the box of a shape of the static world
+bool PhysicsEngine::worldOverlap(Rigidbody* world, const AABB& box) {
+	bool found = false;
+	auto callback = [&](int shape) {
+		found = true;
+		return false;
+	};
+	world->_getStaticWorld()->Query(box, callback);
+	return found;
+}
+
+void PhysicsEngine::filterCollisionPoints(CollisionPoints& collisions) {
+	//find first contact
+	int first = 0;
+
+	for (int i = 1; i < collisions.size(); i++) {
+		if (collisions[i].distance < collisions[first].distance) {
+			first = i;
+		}
+	}
+
+	//keep the first contact in front, it gives the normal, and the other contacts within the slop, in order.
+	//Two faces almost parallel touch on the whole overlap, not in one of its corners: the resting stacks don't rock
+	std::swap(collisions[0], collisions[first]);
+	double dmax = collisions[0].distance + CONTACT_SLOP;
+	int count = 1;
+	for (int i = 1; i < collisions.size(); i++) {
+		if (collisions[i].distance <= dmax) {
+			collisions[count++] = collisions[i];
+		}
+	}
+	collisions.resize(count);
 }
@@ -0,0 +1,84 @@
+#include "physics_simd.h"
+#include "platform.h"
+
+#define SIMD_KERNELS simd_base
+#include "physics_simd_kernels.h"
+
+//the AVX2 kernels are compiled only with the cmake option FIREFLY_AVX2 (see physics_simd_avx2.cpp)
+//and run only if the cpu supports them, the other cpus keep the SSE2 kernels
+#if defined(FIREFLY_AVX2) && !defined(FIREFLY_NO_SIMD)
+#define SIMD_DISPATCH
+namespace simd_avx2 {
+	const char* InstructionSet();
+	void TransformVertexes(const physics_real* x, const physics_real* y, int count, double scaleX, double scaleY,
+		double cosRot, double sinRot, physics_real* outX, physics_real* outY);
+	void TranslateVertexes(const physics_real* x, const physics_real* y, int count, double dx, double dy,
+		physics_real* outX, physics_real* outY);
+	void ProjectMinMax(const physics_real* x, const physics_real* y, int count, double axisX, double axisY,
+		double& min, double& max);
+	int SupportPoint(const physics_real* x, const physics_real* y, int count, double axisX, double axisY);
+	double MaxLengthSquared(const physics_real* x, const physics_real* y, int count);
+}
+
+static const bool useAvx2 = CpuSupportsAvx2();
+#endif
+
+const char* SimdInstructionSet() {
+#ifdef SIMD_DISPATCH
+	if (useAvx2) {
+		return simd_avx2::InstructionSet();
+	}
+#endif
+	return simd_base::InstructionSet();
+}
+
+void SimdTransformVertexes(const physics_real* x, const physics_real* y, int count, double scaleX, double scaleY,
+	double cosRot, double sinRot, physics_real* outX, physics_real* outY) {
+#ifdef SIMD_DISPATCH
+	if (useAvx2) {
+		simd_avx2::TransformVertexes(x, y, count, scaleX, scaleY, cosRot, sinRot, outX, outY);
+		return;
+	}
+#endif
+	simd_base::TransformVertexes(x, y, count, scaleX, scaleY, cosRot, sinRot, outX, outY);
+}
+
+void SimdTranslateVertexes(const physics_real* x, const physics_real* y, int count, double dx, double dy,
+	physics_real* outX, physics_real* outY) {
+#ifdef SIMD_DISPATCH
+	if (useAvx2) {
+		simd_avx2::TranslateVertexes(x, y, count, dx, dy, outX, outY);
+		return;
+	}
+#endif
+	simd_base::TranslateVertexes(x, y, count, dx, dy, outX, outY);
+}
+
+void SimdProjectMinMax(const physics_real* x, const physics_real* y, int count, double axisX, double axisY,
+	double& min, double& max) {
+#ifdef SIMD_DISPATCH
+	if (useAvx2) {
+		simd_avx2::ProjectMinMax(x, y, count, axisX, axisY, min, max);
+		return;
+	}
+#endif
+	simd_base::ProjectMinMax(x, y, count, axisX, axisY, min, max);
+}
+
+int SimdSupportPoint(const physics_real* x, const physics_real* y, int count, double axisX, double axisY) {
+#ifdef SIMD_DISPATCH
+	if (useAvx2) {
+		return simd_avx2::SupportPoint(x, y, count, axisX, axisY);
+	}
+#endif
+	return simd_base::SupportPoint(x, y, count, axisX, axisY);
+}
+
+double SimdMaxLengthSquared(const physics_real* x, const physics_real* y, int count) {
+#ifdef SIMD_DISPATCH
+	if (useAvx2) {
+		return simd_avx2::MaxLengthSquared(x, y, count);
+	}
+#endif
+	return simd_base::MaxLengthSquared(x, y, count);
+}
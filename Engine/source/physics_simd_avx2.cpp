@@ -0,0 +1,8 @@
+//AVX2 copy of the physics kernels. This is the only file compiled with the AVX2 flags (cmake option FIREFLY_AVX2):
+//physics_simd.cpp calls it only on the cpus that support it. Without the flags the file is empty
+#ifdef __AVX2__
+
+#define SIMD_KERNELS simd_avx2
+#include "physics_simd_kernels.h"
+
+#endif
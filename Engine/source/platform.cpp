@@ -1,5 +1,16 @@
 #include "platform.h"
 
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static void fallbackTopology(CpuTopology& topology, const std::vector <int>& allowed);
+static void finishTopology(CpuTopology& topology);
+
 #ifdef _WIN32
 
 #include <Windows.h>
@@ -67,6 +78,109 @@ unsigned int GetCoresCount() {
     return processorCoreCount;
 }
 
+void WaitOnValue(std::atomic <uint32_t>* address, uint32_t value) {
+    WaitOnAddress((volatile VOID*)address, &value, sizeof(uint32_t), INFINITE);
+}
+
+void WakeOnValue(std::atomic <uint32_t>* address, bool all) {
+    if (all) {
+        WakeByAddressAll((PVOID)address);
+    }
+    else {
+        WakeByAddressSingle((PVOID)address);
+    }
+}
+
+//read the processor information records. Returns false if the call is not available
+static bool readProcessorInformation(std::vector <SYSTEM_LOGICAL_PROCESSOR_INFORMATION>& info) {
+    DWORD returnLength = 0;
+    GetLogicalProcessorInformation(NULL, &returnLength);
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || returnLength == 0) {
+        return false;
+    }
+    info.resize(returnLength / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!GetLogicalProcessorInformation(info.data(), &returnLength)) {
+        return false;
+    }
+    info.resize(returnLength / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    return true;
+}
+
+bool GetCpuTopology(CpuTopology& topology) {
+    std::vector <SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info;
+    std::vector <int> allowed;
+    DWORD_PTR processMask, systemMask;
+    bool masked = GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+    if (masked) {
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (processMask & ((ULONG_PTR)1 << cpu)) {
+                allowed.push_back(cpu);
+            }
+        }
+    }
+    if (!masked || !readProcessorInformation(info)) {
+        fallbackTopology(topology, allowed);
+        return false;
+    }
+
+    //package and last level cache of every cpu (the first processor group only)
+    int cpuPackage[64] = {};
+    int cpuCache[64] = {};
+    int packages = 0, caches = 0;
+    for (int i = 0; i < info.size(); i++) {
+        if (info[i].Relationship == RelationProcessorPackage) {
+            for (int cpu = 0; cpu < 64; cpu++) {
+                if (info[i].ProcessorMask & ((ULONG_PTR)1 << cpu)) {
+                    cpuPackage[cpu] = packages;
+                }
+            }
+            packages++;
+        }
+        else if (info[i].Relationship == RelationCache && info[i].Cache.Level == 3) {
+            for (int cpu = 0; cpu < 64; cpu++) {
+                if (info[i].ProcessorMask & ((ULONG_PTR)1 << cpu)) {
+                    cpuCache[cpu] = caches;
+                }
+            }
+            caches++;
+        }
+    }
+
+    topology.cores.clear();
+    for (int i = 0; i < info.size(); i++) {
+        if (info[i].Relationship != RelationProcessorCore) {
+            continue;
+        }
+        CpuCore core;
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if ((info[i].ProcessorMask & processMask) & ((ULONG_PTR)1 << cpu)) {
+                core.cpus.push_back(cpu);
+            }
+        }
+        if (core.cpus.size() > 0) {
+            core.package = cpuPackage[core.cpus[0]];
+            core.cacheDomain = cpuCache[core.cpus[0]];
+            topology.cores.push_back(core);
+        }
+    }
+    if (topology.cores.size() == 0) {
+        fallbackTopology(topology, allowed);
+        return false;
+    }
+    finishTopology(topology);
+    return true;
+}
+
+bool PinCurrentThread(const std::vector <int>& cpus) {
+    DWORD_PTR mask = 0;
+    for (int i = 0; i < cpus.size(); i++) {
+        if (cpus[i] < 64) {
+            mask |= (DWORD_PTR)1 << cpus[i];
+        }
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
 #ifdef NVIDIA_GRAPHICS_CARD
 extern "C"
 {
@@ -82,9 +196,237 @@ extern "C"
 #else       //_win32
 #include <thread>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string>
+#include <fstream>
+#endif
+
 unsigned int GetCoresCount() {
     return std::thread::hardware_concurrency();
 }
 
+#ifdef __linux__
+void WaitOnValue(std::atomic <uint32_t>* address, uint32_t value) {
+    syscall(SYS_futex, (uint32_t*)address, FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+}
+
+void WakeOnValue(std::atomic <uint32_t>* address, bool all) {
+    syscall(SYS_futex, (uint32_t*)address, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+}
+#else
+//no futex: poll the value, yielding the cpu
+void WaitOnValue(std::atomic <uint32_t>* address, uint32_t value) {
+    while (address->load(std::memory_order_acquire) == value) {
+        std::this_thread::yield();
+    }
+}
+
+void WakeOnValue(std::atomic <uint32_t>* address, bool all) {
+}
+#endif
+
+
+#ifdef __linux__
+static bool readText(const std::string& path, std::string& text) {
+    std::ifstream file(path);
+    return (bool)std::getline(file, text);
+}
+
+//parse a sysfs cpu list like "0-3,8,10-11"
+static bool parseCpuList(const std::string& text, std::vector <int>& cpus) {
+    cpus.clear();
+    const char* c = text.c_str();
+    while (*c != '\0' && *c != '\n') {
+        char* next;
+        long first = strtol(c, &next, 10);
+        if (next == c) {
+            return false;
+        }
+        long last = first;
+        c = next;
+        if (*c == '-') {
+            last = strtol(c + 1, &next, 10);
+            c = next;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+        if (*c == ',') {
+            c++;
+        }
+    }
+    return cpus.size() > 0;
+}
+
+//build the topology of the cpus from the sysfs folder (/sys/devices/system/cpu)
+static bool readSysfsTopology(const std::string& root, const std::vector <int>& allowed, CpuTopology& topology) {
+    topology.cores.clear();
+    std::vector <int> coreFirstCpu;     //first SMT sibling of every core, identifies the core
+    std::vector <int> domainFirstCpu;   //first cpu sharing the last level cache, identifies the cache domain
+    for (int i = 0; i < allowed.size(); i++) {
+        std::string cpuPath = root + "/cpu" + std::to_string(allowed[i]);
+        std::string text;
+        std::vector <int> siblings;
+        if (!readText(cpuPath + "/topology/physical_package_id", text)) {
+            return false;
+        }
+        int package = atoi(text.c_str());
+        if (!readText(cpuPath + "/topology/thread_siblings_list", text) || !parseCpuList(text, siblings)) {
+            siblings.assign(1, allowed[i]);
+        }
+
+        //the highest level data or unified cache
+        int level = 0;
+        int domain = allowed[i];
+        for (int index = 0; readText(cpuPath + "/cache/index" + std::to_string(index) + "/level", text); index++) {
+            int cacheLevel = atoi(text.c_str());
+            std::string type;
+            std::vector <int> shared;
+            readText(cpuPath + "/cache/index" + std::to_string(index) + "/type", type);
+            if (type != "Instruction" && cacheLevel > level &&
+                readText(cpuPath + "/cache/index" + std::to_string(index) + "/shared_cpu_list", text) && parseCpuList(text, shared)) {
+                level = cacheLevel;
+                domain = shared[0];
+            }
+        }
 
-#endif
\ No newline at end of file
+        int core = std::find(coreFirstCpu.begin(), coreFirstCpu.end(), siblings[0]) - coreFirstCpu.begin();
+        if (core == coreFirstCpu.size()) {
+            coreFirstCpu.push_back(siblings[0]);
+            int d = std::find(domainFirstCpu.begin(), domainFirstCpu.end(), domain) - domainFirstCpu.begin();
+            if (d == domainFirstCpu.size()) {
+                domainFirstCpu.push_back(domain);
+            }
+            CpuCore c;
+            c.package = package;
+            c.cacheDomain = d;
+            topology.cores.push_back(c);
+        }
+        topology.cores[core].cpus.push_back(allowed[i]);
+    }
+    return topology.cores.size() > 0;
+}
+
+bool GetCpuTopology(CpuTopology& topology) {
+    //only the cpus the process is allowed to run on (containers, taskset...)
+    std::vector <int> allowed;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed.push_back(cpu);
+            }
+        }
+    }
+    if (allowed.size() == 0 || !readSysfsTopology("/sys/devices/system/cpu", allowed, topology)) {
+        fallbackTopology(topology, allowed);
+        return false;
+    }
+    finishTopology(topology);
+    return true;
+}
+
+bool PinCurrentThread(const std::vector <int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < cpus.size(); i++) {
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return cpus.size() > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+#else
+bool GetCpuTopology(CpuTopology& topology) {
+    fallbackTopology(topology, {});
+    return false;
+}
+
+bool PinCurrentThread(const std::vector <int>& cpus) {
+    return false;
+}
+#endif
+
+#endif
+
+//one core for every cpu the process can run on, when the real topology is not available.
+//Without the affinity of the process (allowed empty) the cpus are 0 to the hardware concurrency
+static void fallbackTopology(CpuTopology& topology, const std::vector <int>& allowed) {
+    topology.cores.clear();
+    std::vector <int> cpus = allowed;
+    if (cpus.size() == 0) {
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 0; i < count; i++) {
+            cpus.push_back(i);
+        }
+    }
+    for (int i = 0; i < cpus.size(); i++) {
+        CpuCore core;
+        core.package = 0;
+        core.cacheDomain = 0;
+        core.cpus.push_back(cpus[i]);
+        topology.cores.push_back(core);
+    }
+    finishTopology(topology);
+}
+
+//sort the cores and count the cpus, the packages and the cache domains
+static void finishTopology(CpuTopology& topology) {
+    for (int i = 0; i < topology.cores.size(); i++) {
+        std::sort(topology.cores[i].cpus.begin(), topology.cores[i].cpus.end());
+    }
+    std::sort(topology.cores.begin(), topology.cores.end(), [](const CpuCore& a, const CpuCore& b) {
+        if (a.package != b.package) {
+            return a.package < b.package;
+        }
+        if (a.cacheDomain != b.cacheDomain) {
+            return a.cacheDomain < b.cacheDomain;
+        }
+        return a.cpus[0] < b.cpus[0];
+    });
+
+    std::vector <int> packages, domains;
+    topology.logicalCount = 0;
+    for (int i = 0; i < topology.cores.size(); i++) {
+        topology.logicalCount += topology.cores[i].cpus.size();
+        if (std::find(packages.begin(), packages.end(), topology.cores[i].package) == packages.end()) {
+            packages.push_back(topology.cores[i].package);
+        }
+        if (std::find(domains.begin(), domains.end(), topology.cores[i].cacheDomain) == domains.end()) {
+            domains.push_back(topology.cores[i].cacheDomain);
+        }
+    }
+    topology.packages = packages.size();
+    topology.cacheDomains = domains.size();
+}
+
+bool CpuSupportsAvx2() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) {     //the os must save the ymm registers
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
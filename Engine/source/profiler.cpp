@@ -0,0 +1,156 @@
+#include "profiler.h"
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+thread_local Profiler::ThreadBuffer* Profiler::_threadBuffer = nullptr;
+
+Profiler::Profiler() {
+	_enabled = false;
+	_bufferCount = 0;
+	_startTime = 0;
+	_startTime = Now();
+}
+
+//the buffers are not freed: threads can still be recording while the program exits
+Profiler::~Profiler() {
+}
+
+void Profiler::SetEnabled(bool enable) {
+	_enabled = enable;
+}
+
+int64_t Profiler::Now() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - _startTime;
+}
+
+//the buffer of the calling thread. Allocated the first time a thread records an event
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer() {
+	if (_threadBuffer != nullptr) {
+		return _threadBuffer;
+	}
+
+	std::lock_guard <std::mutex> guard(register_mutex);
+	int id = _bufferCount;
+	if (id >= MAX_THREADS) {
+		return nullptr;
+	}
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->head = 0;
+	buffer->clearMark = 0;
+	buffer->id = id;
+	snprintf(buffer->name, sizeof(buffer->name), "thread %d", id);
+	_buffers[id] = buffer;
+	_bufferCount = id + 1;		//publish the buffer
+	_threadBuffer = buffer;
+	return buffer;
+}
+
+//name of the calling thread in the exported trace
+void Profiler::SetThreadName(const char* name) {
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (buffer == nullptr) {
+		return;
+	}
+	std::lock_guard <std::mutex> guard(register_mutex);
+	strncpy(buffer->name, name, sizeof(buffer->name) - 1);
+	buffer->name[sizeof(buffer->name) - 1] = '\0';
+}
+
+//store an event in the buffer of the calling thread. Only the owner thread writes a buffer
+void Profiler::Record(const char* name, int64_t start, int64_t end) {
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (buffer == nullptr) {
+		return;
+	}
+	uint64_t head = buffer->head.load(std::memory_order_relaxed);
+	Event& e = buffer->events[head % BUFFER_SIZE];
+	e.name.store(name, std::memory_order_relaxed);
+	e.start.store(start, std::memory_order_relaxed);
+	e.end.store(end, std::memory_order_relaxed);
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+//forget the events recorded until now
+void Profiler::Clear() {
+	int count = _bufferCount;
+	for (int i = 0; i < count; i++) {
+		_buffers[i]->clearMark = _buffers[i]->head.load();
+	}
+}
+
+//write the text as a json string: quotes, backslashes and control characters are escaped
+static void writeJsonString(FILE* f, const char* text) {
+	fputc('"', f);
+	for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', f);
+			fputc(*c, f);
+		}
+		else if (*c < 0x20) {
+			fprintf(f, "\\u%04x", *c);
+		}
+		else {
+			fputc(*c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+//write the recorded events as a Chrome trace_event json file. Can be called while the threads are recording:
+//the events overwritten during the export are dropped
+bool Profiler::ExportChromeTrace(const std::string& path) {
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == nullptr) {
+		return false;
+	}
+
+	struct ExportedEvent {
+		const char* name;
+		int64_t start;
+		int64_t end;
+	};
+	std::vector <ExportedEvent> events;
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	int count = _bufferCount;
+	for (int i = 0; i < count; i++) {
+		ThreadBuffer* buffer = _buffers[i];
+		{
+			std::lock_guard <std::mutex> guard(register_mutex);
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->id);
+			writeJsonString(f, buffer->name);		//set by the game
+			fprintf(f, "}}");
+			first = false;
+		}
+
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t begin = std::max(buffer->clearMark.load(), head > BUFFER_SIZE ? head - BUFFER_SIZE : 0);
+		events.clear();
+		for (uint64_t j = begin; j < head; j++) {
+			Event& e = buffer->events[j % BUFFER_SIZE];
+			events.push_back({ e.name.load(std::memory_order_relaxed), e.start.load(std::memory_order_relaxed), e.end.load(std::memory_order_relaxed) });
+		}
+
+		//the events copied while the owner wrapped around the buffer may be torn
+		uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+		uint64_t valid = newHead > BUFFER_SIZE ? newHead - BUFFER_SIZE : 0;
+		for (uint64_t j = std::max(begin, valid); j < head; j++) {
+			ExportedEvent& e = events[j - begin];
+			fprintf(f, ",\n{\"name\":");
+			writeJsonString(f, e.name);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer->id, e.start / 1000.0, (e.end - e.start) / 1000.0);
+		}
+	}
+	fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(f) == 0;
+}
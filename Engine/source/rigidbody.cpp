@@ -1,12 +1,41 @@
 #include "rigidbody.h"
 #include "gameObject.h"
 #include "physics.h"
+#include "staticWorld.h"
 
 #include <vector>
+#include <algorithm>
 
 Rigidbody::Rigidbody(GameObject* parent, std::vector <vector2> &vertexes) {
+	_init(parent, vertexes);
+	PhysicsEngine::getInstance().RegisterRigidbody(this);
+}
+
+//the static collision geometry of a level as a single static body. The body takes the world and deletes it.
+//The shapes are in world coordinates: the body doesn't follow its game object
+Rigidbody::Rigidbody(GameObject* parent, StaticWorld* world) {
+	std::vector <vector2> noVertexes;
+	_init(parent, noVertexes);
+	world->Build();
+	_staticWorld = world;
+	isStatic = true;
+	mass = INFINITY;
+	useGravity = false;
+
+	AABB bounds = world->GetBounds();
+	vector2 halfSize = { (bounds.max.x - bounds.min.x) * 0.5, (bounds.max.y - bounds.min.y) * 0.5 };
+	boundingBox = new BoundingBox();
+	boundingBox->type = BoundingBoxType::CONVEX;
+	boundingBox->radius = halfSize.magnitude();
+	_aabb = bounds;
+
+	PhysicsEngine::getInstance().RegisterRigidbody(this);
+}
+
+void Rigidbody::_init(GameObject* parent, std::vector <vector2>& vertexes) {
 
 	boundingBox = nullptr;
+	_staticWorld = nullptr;
 	parentObject = parent;
 	mass = 1.0;
 	staticFriction = 0.5;
@@ -16,17 +45,29 @@ Rigidbody::Rigidbody(GameObject* parent, std::vector <vector2> &vertexes) {
 	angularVelocity = 0;
 	useGravity = true;
 	isTrigger = false;
+	isBullet = false;
 	constraints = RBContraints::NO_CONST;
 	detectCollisions = true;
-	_mesh.v = vertexes;
 	_world_mesh.v = vertexes;
 
 	centerOfMass = parent->transform.position;
 	
 	meshScale = parent->transform.scale;
 	meshRot = parent->transform.rotation;
+	_baseRot = meshRot;
+
+	//the vertexes are given at the scale of the object
+	_vertexes.resize(vertexes.size());
+	_baseVertexes.resize(vertexes.size());
+	for (int i = 0; i < vertexes.size(); i++) {
+		_vertexes.set(i, vertexes[i]);
+		_baseVertexes.set(i, { meshScale.x != 0 ? vertexes[i].x / meshScale.x : vertexes[i].x,
+			meshScale.y != 0 ? vertexes[i].y / meshScale.y : vertexes[i].y });
+	}
 	
 	_findMeshArea();
+	_updateLocalBox();
+	_updateWorldBox();
 	density = mass / area;
 	transformChanged = true;
 	isStatic = false;
@@ -34,15 +75,24 @@ Rigidbody::Rigidbody(GameObject* parent, std::vector <vector2> &vertexes) {
 	groupMask = 0xffffffff;
 
 	frameForce = { 0, 0 };
+	_pendingForce = { 0, 0 };
 	momentOfInertia = 0;
 	_meshUpdated = false;
 
-	PhysicsEngine::getInstance().RegisterRigidbody(this);
+	_sleepPosition = {};
+	_sleepRotation = 0;
+	_sleepTime = 0;
+	_island = -1;
+	_islandIndex = -1;
+	_sleeping = false;
+	_wakeRequest = false;
 }
 
 Rigidbody::~Rigidbody() {
 	if (boundingBox != nullptr)
 		delete boundingBox;
+	if (_staticWorld != nullptr)
+		delete _staticWorld;
 	PhysicsEngine::getInstance().RemoveRigidbody(this);
 }
 
@@ -51,10 +101,14 @@ GameObject* Rigidbody::getParentObject() {
 }
 
 void Rigidbody::_findMeshArea() {
+	if (_isCircle()) {
+		area = MATH_PI * boundingBox->radius * boundingBox->radius;
+		return;
+	}
 	area = 0;
-	for (int i = 0; i < _mesh.v.size(); i++) {
-		vector2 v0 = _mesh.v[i];
-		vector2 v1 = _mesh.v[(i+1) % _mesh.v.size()];
+	for (int i = 0; i < _vertexes.size(); i++) {
+		vector2 v0 = _vertexes.get(i);
+		vector2 v1 = _vertexes.get((i + 1) % _vertexes.size());
 		area += 0.5 * fabs(v0.x * v1.y - v1.x * v0.y);
 	}
 }
@@ -64,10 +118,14 @@ double Rigidbody::getMOI() {
 	std::lock_guard <std::mutex> guard(_moiMutex);
 
 	density = mass / area;
+	if (_isCircle()) {		//disk
+		momentOfInertia = 0.5 * mass * boundingBox->radius * boundingBox->radius;
+		return momentOfInertia;
+	}
 	momentOfInertia = 0;
-	for (int i = 0; i < _mesh.v.size(); i++) {
-		vector2 v0 = _mesh.v[i];
-		vector2 v1 = _mesh.v[(i + 1) % _mesh.v.size()];
+	for (int i = 0; i < _vertexes.size(); i++) {
+		vector2 v0 = _vertexes.get(i);
+		vector2 v1 = _vertexes.get((i + 1) % _vertexes.size());
 		double a = fabs(v0.x * v1.y - v1.x * v0.y);
 		double t1 = v0.y * v0.y + v0.y * v1.y + v1.y * v1.y;
 		double t2 = v0.x * v0.x + v0.x * v1.x + v1.x * v1.x;
@@ -85,15 +143,18 @@ vector2 Rigidbody::getRelativePoint(vector2 point) {
 	return {point.x - centerOfMass.x, point.y - centerOfMass.y};
 }
 
-//add force at the center of the bounding box
+//add force at the center of the bounding box. The force is applied in the next physics frame and wakes the body
 void Rigidbody::AddForce(vector2 forceVector) {
-	
+	std::lock_guard <std::mutex> guard(_forceMutex);
+	_pendingForce = { _pendingForce.x + forceVector.x, _pendingForce.y + forceVector.y };
+	_wakeRequest = true;
 }
 
 void Rigidbody::AddExplosionForce(vector2 position, double force) {
 
 }
 
+//SPHERE makes the body a circle through the farthest vertex of the mesh: the mesh is kept only for the graphics
 void Rigidbody::SetBoundingBox(BoundingBoxType type) {
 	if (boundingBox != nullptr)
 		delete boundingBox;
@@ -101,13 +162,12 @@ void Rigidbody::SetBoundingBox(BoundingBoxType type) {
 	boundingBox = new BoundingBox();
 
 	boundingBox->type = type;
-	double radius = 0;
-	for (int i = 0; i < _mesh.v.size(); i++) {
-		radius = std::max(radius, sqrt(_mesh.v[i].x * _mesh.v[i].x
-			+ _mesh.v[i].y * _mesh.v[i].y));
-	}
-	boundingBox->radius = radius;
+	boundingBox->radius = sqrt(SimdMaxLengthSquared(_vertexes.x.data(), _vertexes.y.data(), _vertexes.size()));
 
+	_updateLocalBox();
+	_updateWorldBox();
+	_findMeshArea();
+	density = mass / area;
 }
 
 bool Rigidbody::GetBoundingBox(BoundingBox& b) {
@@ -118,10 +178,39 @@ bool Rigidbody::GetBoundingBox(BoundingBox& b) {
 	return true;
 }
 
+//box of the mesh in world coordinates, at the position of the last transform update
+void Rigidbody::GetAABB(AABB& box) {
+	box = _aabb;
+}
+
+void Rigidbody::_updateWorldBox() {
+	_aabb = { { centerOfMass.x + _localBox.min.x, centerOfMass.y + _localBox.min.y },
+		{ centerOfMass.x + _localBox.max.x, centerOfMass.y + _localBox.max.y } };
+}
+
+void Rigidbody::_updateLocalBox() {
+	if (_isCircle()) {
+		double r = boundingBox->radius;
+		_localBox = { { -r, -r }, { r, r } };
+		return;
+	}
+	_localBox = { {}, {} };
+	if (_vertexes.size() == 0) {
+		return;
+	}
+	SimdProjectMinMax(_vertexes.x.data(), _vertexes.y.data(), _vertexes.size(), 1, 0, _localBox.min.x, _localBox.max.x);
+	SimdProjectMinMax(_vertexes.x.data(), _vertexes.y.data(), _vertexes.size(), 0, 1, _localBox.min.y, _localBox.max.y);
+}
 
+//the static world keeps no collisions: all the bodies of the level would search and lock its list.
+//The bodies that touch it still get theirs. A sleeping body keeps the collisions it had when it fell asleep:
+//it has no collision frame until its island wakes, and the new ones are found again then
 void Rigidbody::_setCollisions(Rigidbody* body, vector2 contactPoint, 
 	vector2 collisionNormal, vector2 velocity, double impulse, vector2 updatedPosition) {
 
+	if (_staticWorld != nullptr || _sleeping) {
+		return;
+	}
 	std::lock_guard <std::mutex> guard(_collisionMutex);
 
 	for (int i = 0; i < _prevCollision.size(); i++) {
@@ -136,63 +225,86 @@ void Rigidbody::_setCollisions(Rigidbody* body, vector2 contactPoint,
 			return;
 		}
 	}
-	_prevCollision.push_back({ body, contactPoint, collisionNormal, velocity, updatedPosition, impulse, true, true });
+	_prevCollision.push_back({ body, contactPoint, collisionNormal, velocity, updatedPosition, impulse, true, true, -1 });
 
 }
 
+//add the impulse of the contact solver to the collision with body in this frame
+void Rigidbody::_addCollisionImpulse(Rigidbody* body, double impulse) {
+
+	if (_staticWorld != nullptr) {
+		return;
+	}
+	std::lock_guard <std::mutex> guard(_collisionMutex);
+
+	for (int i = 0; i < _prevCollision.size(); i++) {
+		if (_prevCollision[i].collider == body) {
+			_prevCollision[i].impulse += impulse;
+			return;
+		}
+	}
+}
+
  void Rigidbody::_updateTransform() {
 
 	vector2 scale = parentObject->transform.scale;
-	centerOfMass = parentObject->transform.position;
+	vector2 position = parentObject->transform.position;
+	if (position.x != centerOfMass.x || position.y != centerOfMass.y) {
+		_meshUpdated = false;		//the world mesh follows the new position
+	}
+	centerOfMass = position;
+	if (_staticWorld != nullptr) {		//the shapes of the world never move
+		return;
+	}
 
 	//nothing changed
 	bool scaleChanged = !(scale.x == meshScale.x && scale.y == meshScale.y);
 	bool rotChanged = !(parentObject->transform.rotation == meshRot);
 	transformChanged = scaleChanged | rotChanged;
+	if (scaleChanged && _sleeping) {		//the bigger mesh can hit the bodies around
+		_wakeRequest = true;
+	}
 	if (!transformChanged){
+		_updateWorldBox();
 		return;
 	}
 
-	//translate, rotate and scale the polygon
-	double rot = (parentObject->transform.rotation - meshRot) * (MATH_PI / 180.0);
-	for (int i = 0; i < _mesh.v.size(); i++) {
-		_mesh.v[i] = { (_mesh.v[i].x / meshScale.x) * scale.x, (_mesh.v[i].y / meshScale.y) * scale.y };
-		_mesh.v[i] = {
-			_mesh.v[i].x * cos(rot) - _mesh.v[i].y * sin(rot),
-			_mesh.v[i].x * sin(rot) + _mesh.v[i].y * cos(rot)
-		};
-	}
+	//scale and rotate the base polygon. The mesh is made again from the base every time,
+	//so the errors of the old transforms don't add up
+	double rot = (parentObject->transform.rotation - _baseRot) * (MATH_PI / 180.0);
+	SimdTransformVertexes(_baseVertexes.x.data(), _baseVertexes.y.data(), _baseVertexes.size(), scale.x, scale.y,
+		cos(rot), sin(rot), _vertexes.x.data(), _vertexes.y.data());
 
 	//calculates the radius of the bb
 	if (scaleChanged && (boundingBox != nullptr) ) {
-		double radius = 0;
-		for (int i = 0; i < _mesh.v.size(); i++) {
-			radius = std::max(radius, sqrt(_mesh.v[i].x * _mesh.v[i].x
-				+ _mesh.v[i].y * _mesh.v[i].y));
-		}
-		boundingBox->radius = radius;
+		boundingBox->radius = sqrt(SimdMaxLengthSquared(_vertexes.x.data(), _vertexes.y.data(), _vertexes.size()));
 	}
+	_updateLocalBox();
+	_updateWorldBox();
+	_meshUpdated = false;
 
 	meshScale = scale;
 	meshRot = parentObject->transform.rotation;
 
 	//update density and area
-	vector2 realScale = { scale.x / meshScale.x, scale.y / meshScale.y };
-	area *= realScale.x * realScale.y;
-	density = mass / area;
+	if (scaleChanged) {
+		_findMeshArea();
+		density = mass / area;
+	}
 
 	return;
 }
 
- //return the mesh vertexes with all transforms applied
+ //return the mesh vertexes with all transforms applied. The world mesh is made again only after the body moved,
+ //so the static bodies make it once
  void Rigidbody::getMesh(FMesh& m) {
 
 	 std::lock_guard <std::mutex> guard(_meshMutex);
 
 	 if (!_meshUpdated) {
 		 //update the mesh in world coordinates for the current frame
-		 for (int i = 0; i < _mesh.v.size(); i++) {
-			 _world_mesh.v[i] = { _mesh.v[i].x + centerOfMass.x, _mesh.v[i].y + centerOfMass.y };
+		 for (int i = 0; i < _vertexes.size(); i++) {
+			 _world_mesh.v[i] = { _vertexes.x[i] + centerOfMass.x, _vertexes.y[i] + centerOfMass.y };
 		 }
 		 _meshUpdated = true;
 	 }
@@ -201,6 +313,38 @@ void Rigidbody::_setCollisions(Rigidbody* body, vector2 contactPoint,
 	 m.centerOfMass = centerOfMass;
  }
 
+ //vertexes of the mesh relative to the center, with rotation and scale applied
+ const VertexArray& Rigidbody::_getLocalVertexes() {
+	 return _vertexes;
+ }
+
+ //the mesh for the narrowphase, relative to origin. Doesn't take the mesh lock: the mesh and the
+ //center change only in the pre update
+ void Rigidbody::_getContactMesh(ContactMesh& m, vector2 origin) {
+	 vector2 center = { centerOfMass.x - origin.x, centerOfMass.y - origin.y };
+	 m.v.resize(_vertexes.size());
+	 SimdTranslateVertexes(_vertexes.x.data(), _vertexes.y.data(), _vertexes.size(), center.x, center.y, m.v.x.data(), m.v.y.data());
+	 m.centerOfMass = center;
+ }
+
+ vector2 Rigidbody::_getCenter() {
+	 return centerOfMass;
+ }
+
+ //the body collides as a circle of radius _getRadius()
+ bool Rigidbody::_isCircle() {
+	 return boundingBox != nullptr && boundingBox->type == BoundingBoxType::SPHERE;
+ }
+
+ double Rigidbody::_getRadius() {
+	 return boundingBox != nullptr ? boundingBox->radius : 0;
+ }
+
+ //the static collision geometry of the level if the body is the static world, nullptr otherwise
+ StaticWorld* Rigidbody::_getStaticWorld() {
+	 return _staticWorld;
+ }
+
  bool Rigidbody::isColliding(Rigidbody* body) {
 	 for (int i = 0; i < _prevCollision.size(); i++) {
 		 if (_prevCollision[i].collider == body)
@@ -209,27 +353,9 @@ void Rigidbody::_setCollisions(Rigidbody* body, vector2 contactPoint,
 	 return false;
  }
 
-//internal call. Don't use it
-void Rigidbody::_resolveCollisions(double timeElapsed) {
-
-	for (int i = 0; i < _prevCollision.size(); i++) {
-		vector2 v = velocity;
-		vector2 normal = _prevCollision[i].collisionNormal;
-		double impulse = _prevCollision[i].impulse;
-
-		velocity = { v.x - impulse / mass * normal.x, v.y - impulse / mass * normal.y };
-
-		parentObject->transform.position += _prevCollision[i].postCollisionPosition;
-
-		vector2 r = getRelativePoint(_prevCollision[i].contactPoint);
-		angularVelocity -= (r.cross({ normal.x * impulse, normal.y * impulse }) / momentOfInertia) * 180 / MATH_PI;
-	}
-}
-
+//the forces of the frame are already in the velocity (see ContactSolver)
 void Rigidbody::_updatePhysics(double timeElapsed, double sleepVelocity) {
 
-	velocity += {frameForce.x* timeElapsed / mass, frameForce.y* timeElapsed / mass};
-
 	//apply velocity contraints
 	unsigned long c = constraints;
 	if (c & RBContraints::ROT) angularVelocity = 0;
@@ -239,6 +365,18 @@ void Rigidbody::_updatePhysics(double timeElapsed, double sleepVelocity) {
 	//move the object
 	this->parentObject->transform.position += {this->velocity.x() * timeElapsed, this->velocity.y() * timeElapsed};
 	this->parentObject->transform.rotation += this->angularVelocity * timeElapsed;
+
+	//time spent below the sleep velocity. The rotation counts with the speed of the farthest vertex.
+	//The triggers never sleep, they must see the bodies that enter them
+	vector2 v = velocity;
+	double radius = boundingBox != nullptr ? boundingBox->radius : 0;
+	double speed = v.magnitude() + fabs(angularVelocity) * (MATH_PI / 180.0) * radius;
+	if (_wakeRequest.exchange(false) || isTrigger || !(speed < sleepVelocity)) {
+		_sleepTime = 0;
+	}
+	else {
+		_sleepTime += timeElapsed;
+	}
 }
 
 void Rigidbody::_resolveDrag(double timeElapsed) {
@@ -305,12 +443,16 @@ void Rigidbody::_startCollisionFrame(double timeElapsed, vector2 gravity) {
 		if(mass != INFINITY)
 			frameForce = { frameForce.x + gravity.x * mass, frameForce.y + gravity.y * mass};
 	}
+	{
+		std::lock_guard <std::mutex> guard(_forceMutex);
+		frameForce = { frameForce.x + _pendingForce.x, frameForce.y + _pendingForce.y };
+		_pendingForce = { 0, 0 };
+	}
 
 	for (int i = 0; i < _prevCollision.size(); i++) {
 		_prevCollision[i].firstCollision = false;
 		_prevCollision[i].frameCollision = false;
 	}
-	_meshUpdated = false;
 }
 
 //internal call. Don't use it
@@ -320,6 +462,10 @@ void Rigidbody::_endCollisionFrame() {
 
 	for (int i = 0; i < _prevCollision.size(); i++) {
 
+		if (_prevCollision[i].sleepingIsland >= 0) {		//the collider sleeps on this body: nothing changes
+			continue;
+		}
+
 		if (_prevCollision[i].frameCollision == false) {		//no collision detected this frame
 			Collision c = {};
 			c.collider = _prevCollision[i].collider;
@@ -377,10 +523,6 @@ void Rigidbody::_endCollisionFrame() {
 	}
 }
 
-void Rigidbody::_applyForces(double timeElapsed) {
-	velocity += {frameForce.x* timeElapsed / mass, frameForce.y* timeElapsed / mass};
-}
-
 bool Rigidbody::IsMovable() {
 	return (!isStatic) && !(constraints & (RBContraints::X_CONST | RBContraints::Y_CONST))
 		&& mass != INFINITY;
@@ -393,4 +535,98 @@ void Rigidbody::SetStatic(bool isS) {
 
 bool Rigidbody::IsStatic() {
 	return isStatic;
-}
\ No newline at end of file
+}
+
+//wake the body in the next physics frame
+void Rigidbody::WakeUp() {
+	_wakeRequest = true;
+}
+
+bool Rigidbody::IsSleeping() {
+	return _sleeping;
+}
+
+//internal call. True if the sleeping body was pushed, moved or asked to wake since it fell asleep
+bool Rigidbody::_shouldWake() {
+	vector2 v = velocity;
+	vector2 position = parentObject->transform.position;
+	return _wakeRequest || v.x != 0 || v.y != 0 || angularVelocity != 0
+		|| position.x != _sleepPosition.x || position.y != _sleepPosition.y || parentObject->transform.rotation != _sleepRotation;
+}
+
+//internal call. Stop the body in the island. The static bodies it touches keep the collision without callbacks
+//until the island wakes, and are appended to touching. Runs on a single thread
+void Rigidbody::_sleep(int island, std::vector <Rigidbody*>& touching) {
+	velocity = { 0, 0 };
+	angularVelocity = 0;
+	_sleepPosition = parentObject->transform.position;
+	_sleepRotation = parentObject->transform.rotation;
+	_island = island;
+	_sleeping = true;
+	_wakeRequest = false;
+
+	for (int i = 0; i < _prevCollision.size(); i++) {
+		Rigidbody* collider = _prevCollision[i].collider;
+		if (collider->IsStatic()) {
+			collider->_setSleepingCollider(this, island);
+			touching.push_back(collider);
+		}
+	}
+}
+
+//internal call
+void Rigidbody::_wake() {
+	_sleeping = false;
+	_wakeRequest = false;
+	_island = -1;
+	_sleepTime = 0;
+}
+
+//internal call. Drop the collisions with the removed bodies (sorted) without callbacks. The removed bodies are only
+//compared by address, they could be already deleted
+void Rigidbody::_removeColliders(const std::vector <Rigidbody*>& removed) {
+	std::lock_guard <std::mutex> guard(_collisionMutex);
+	int j = 0;
+	for (int i = 0; i < _prevCollision.size(); i++) {
+		if (!std::binary_search(removed.begin(), removed.end(), _prevCollision[i].collider)) {
+			_prevCollision[j++] = _prevCollision[i];
+		}
+	}
+	_prevCollision.erase(_prevCollision.begin() + j, _prevCollision.end());
+}
+
+int Rigidbody::_getIsland() {
+	return _island;
+}
+
+void Rigidbody::_setIslandIndex(int index) {
+	_islandIndex = index;
+}
+
+int Rigidbody::_getIslandIndex() {
+	return _islandIndex;
+}
+
+double Rigidbody::_getSleepTime() {
+	return _sleepTime;
+}
+
+//internal call. The body sleeps on this one in the island
+void Rigidbody::_setSleepingCollider(Rigidbody* body, int island) {
+	for (int i = 0; i < _prevCollision.size(); i++) {
+		if (_prevCollision[i].collider == body) {
+			_prevCollision[i].sleepingIsland = island;
+		}
+	}
+}
+
+//internal call. The island woke: its collisions go on as if they were found in this frame.
+//The removed colliders are not in the list anymore: ApplyBodyChanges() drops them before any island can wake
+void Rigidbody::_clearSleepingColliders(int island) {
+	for (int i = 0; i < _prevCollision.size(); i++) {
+		if (_prevCollision[i].sleepingIsland == island) {
+			_prevCollision[i].sleepingIsland = -1;
+			_prevCollision[i].frameCollision = true;
+		}
+	}
+}
@@ -0,0 +1,206 @@
+#include "spatialGrid.h"
+#include "structures.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <math.h>
+
+SpatialGrid::SpatialGrid(double zoneSize) {
+	_zoneSize = zoneSize;
+	_count = 0;
+}
+
+//zone coordinate of a world coordinate. Works for negative coordinates and saturates outside the 16 bit range
+int SpatialGrid::ZoneCoord(double coord) {
+	double z = floor(coord / _zoneSize);
+	if (z < INT16_MIN) return INT16_MIN;
+	if (z > INT16_MAX) return INT16_MAX;
+	return (int)z;
+}
+
+uint32_t SpatialGrid::PosToZone(vector2 pos) {
+	uint16_t xzone = (uint16_t)(int16_t)ZoneCoord(pos.x);
+	uint16_t yzone = (uint16_t)(int16_t)ZoneCoord(pos.y);
+	return ((uint32_t)xzone << 16) | yzone;
+}
+
+//return the number of zones two zones are apart.
+//i.e. return 0 if they are the same zone, 1 if the zones are connected, 2 if they are two zones apart and so on
+int SpatialGrid::ZoneDistance(uint32_t zone1, uint32_t zone2) {
+	int dx = (int)(int16_t)(zone1 >> 16) - (int)(int16_t)(zone2 >> 16);
+	int dy = (int)(int16_t)(zone1 & 0xffff) - (int)(int16_t)(zone2 & 0xffff);
+	return std::max(abs(dx), abs(dy));
+}
+
+double SpatialGrid::GetZoneSize() {
+	return _zoneSize;
+}
+
+//objects that can overlap more than the neighbouring zones are not stored in a zone
+bool SpatialGrid::IsOversized(double radius) {
+	return radius > _zoneSize / 2;
+}
+
+void SpatialGrid::Insert(uint32_t id, GameObject* obj, vector2 position, double radius, uint8_t flags) {
+	if (id >= _entries.size()) {
+		_entries.resize(id + 1, { nullptr, {0, 0}, 0, 0, 0, 0, false, false });
+	}
+	Entry& e = _entries[id];
+	if (e.inGrid) {
+		RemoveFromZone(id);
+		_count--;
+	}
+	e.obj = obj;
+	e.position = position;
+	e.radius = radius;
+	e.flags = flags;
+	AddToZone(id);
+	_count++;
+}
+
+void SpatialGrid::Remove(uint32_t id) {
+	if (id >= _entries.size() || !_entries[id].inGrid) {
+		return;
+	}
+	RemoveFromZone(id);
+	_entries[id].obj = nullptr;
+	_count--;
+}
+
+//store the new position of an object. Returns true if the object has to be moved to another zone with Move().
+//Query() reads the positions: it must not run at the same time, like for the other changes
+bool SpatialGrid::Update(uint32_t id, vector2 position, double radius) {
+	if (id >= _entries.size() || !_entries[id].inGrid) {
+		return false;
+	}
+	Entry& e = _entries[id];
+	e.position = position;
+	e.radius = radius;
+
+	bool oversized = IsOversized(radius);
+	if (oversized != e.oversized) {
+		return true;
+	}
+	return !oversized && PosToZone(position) != e.zone;
+}
+
+//move an object to the zone of its current position
+void SpatialGrid::Move(uint32_t id) {
+	if (id >= _entries.size() || !_entries[id].inGrid) {
+		return;
+	}
+	RemoveFromZone(id);
+	AddToZone(id);
+}
+
+void SpatialGrid::Clear() {
+	_entries.clear();
+	_zones.clear();
+	_oversized.clear();
+	_count = 0;
+}
+
+uint8_t SpatialGrid::GetFlags(uint32_t id) {
+	if (id >= _entries.size()) {
+		return 0;
+	}
+	return _entries[id].flags;
+}
+
+size_t SpatialGrid::Size() {
+	return _count;
+}
+
+void SpatialGrid::AddToZone(uint32_t id) {
+	Entry& e = _entries[id];
+	e.oversized = IsOversized(e.radius);
+	std::vector <uint32_t>* list;
+	if (e.oversized) {
+		list = &_oversized;
+		e.zone = 0;
+	}
+	else {
+		e.zone = PosToZone(e.position);
+		list = &_zones[e.zone];
+	}
+	e.zoneIndex = list->size();
+	list->push_back(id);
+	e.inGrid = true;
+}
+
+//swap remove from the zone list
+void SpatialGrid::RemoveFromZone(uint32_t id) {
+	Entry& e = _entries[id];
+	std::vector <uint32_t>* list;
+	auto it = _zones.end();
+	if (e.oversized) {
+		list = &_oversized;
+	}
+	else {
+		it = _zones.find(e.zone);
+		list = &it->second;
+	}
+
+	uint32_t last = list->back();
+	(*list)[e.zoneIndex] = last;
+	_entries[last].zoneIndex = e.zoneIndex;
+	list->pop_back();
+
+	if (it != _zones.end() && list->size() == 0) {
+		_zones.erase(it);
+	}
+	e.inGrid = false;
+}
+
+bool SpatialGrid::Overlaps(Entry& e, AABB& rect) {
+	double dx = std::max(std::max(rect.min.x - e.position.x, 0.0), e.position.x - rect.max.x);
+	double dy = std::max(std::max(rect.min.y - e.position.y, 0.0), e.position.y - rect.max.y);
+	return dx * dx + dy * dy <= e.radius * e.radius;
+}
+
+//append to out the objects that overlap the rectangle. If flags is not 0 only the objects with one of the flags are returned
+void SpatialGrid::Query(AABB rect, std::vector <GameObject*>& out, uint8_t flags) {
+
+	for (int i = 0; i < _oversized.size(); i++) {
+		Entry& e = _entries[_oversized[i]];
+		if ((flags == 0 || (e.flags & flags)) && Overlaps(e, rect)) {
+			out.push_back(e.obj);
+		}
+	}
+
+	//objects in a zone can stick out of it by at most half a zone
+	double margin = _zoneSize / 2;
+	int x0 = ZoneCoord(rect.min.x - margin), x1 = ZoneCoord(rect.max.x + margin);
+	int y0 = ZoneCoord(rect.min.y - margin), y1 = ZoneCoord(rect.max.y + margin);
+
+	auto checkZone = [&](std::vector <uint32_t>& zone) {
+		for (int i = 0; i < zone.size(); i++) {
+			Entry& e = _entries[zone[i]];
+			if ((flags == 0 || (e.flags & flags)) && Overlaps(e, rect)) {
+				out.push_back(e.obj);
+			}
+		}
+	};
+
+	//huge rectangle: cheaper to walk the occupied zones
+	if ((double)(x1 - x0 + 1) * (y1 - y0 + 1) > _zones.size()) {
+		for (auto& [zone, list] : _zones) {
+			int zx = (int16_t)(zone >> 16), zy = (int16_t)(zone & 0xffff);
+			if (zx >= x0 && zx <= x1 && zy >= y0 && zy <= y1) {
+				checkZone(list);
+			}
+		}
+		return;
+	}
+
+	for (int x = x0; x <= x1; x++) {
+		for (int y = y0; y <= y1; y++) {
+			uint32_t zone = ((uint32_t)(uint16_t)(int16_t)x << 16) | (uint16_t)(int16_t)y;
+			auto it = _zones.find(zone);
+			if (it != _zones.end()) {
+				checkZone(it->second);
+			}
+		}
+	}
+}
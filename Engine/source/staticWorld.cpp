@@ -0,0 +1,184 @@
+#include "staticWorld.h"
+#include "physics_simd.h"
+
+StaticWorld::StaticWorld() {
+	_bounds = { {}, {} };
+	_height = 0;
+	_built = false;
+}
+
+//convex polygon in world coordinates. The shapes can't be added after Build()
+void StaticWorld::AddPolygon(const std::vector <vector2>& vertexes) {
+	if (vertexes.size() < 3) {
+		return;
+	}
+	addShape(vertexes.data(), vertexes.size());
+}
+
+//two sided segment in world coordinates
+void StaticWorld::AddEdge(vector2 a, vector2 b) {
+	if (a.x == b.x && a.y == b.y) {
+		return;
+	}
+	vector2 vertexes[2] = { a, b };
+	addShape(vertexes, 2);
+}
+
+//the segments between the points in order, and from the last point to the first one if loop is true
+void StaticWorld::AddChain(const std::vector <vector2>& points, bool loop) {
+	for (int i = 0; i + 1 < points.size(); i++) {
+		AddEdge(points[i], points[i + 1]);
+	}
+	if (loop && points.size() > 2) {
+		AddEdge(points.back(), points[0]);
+	}
+}
+
+//grid of columns * rows tiles, row after row. A tile that is not 0 is solid: tile (column, row) is the square
+//of side tileSize at origin + (column, row) * tileSize. The solid tiles are merged in rectangles as wide and then as tall
+//as possible, so a wall of tiles becomes a single polygon and the bodies don't catch on the sides between the tiles
+void StaticWorld::AddTiles(const std::vector <uint8_t>& tiles, int columns, int rows, vector2 origin, double tileSize) {
+	if (columns <= 0 || rows <= 0 || tiles.size() < (size_t)columns * rows) {
+		return;
+	}
+	std::vector <uint8_t> merged(columns * rows, 0);
+	auto free = [&](int column, int row) {
+		return tiles[row * columns + column] != 0 && merged[row * columns + column] == 0;
+	};
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns; column++) {
+			if (!free(column, row)) {
+				continue;
+			}
+			int width = 1;
+			while (column + width < columns && free(column + width, row)) {
+				width++;
+			}
+			int height = 1;
+			while (row + height < rows) {
+				bool solid = true;
+				for (int c = column; c < column + width && solid; c++) {
+					solid = free(c, row + height);
+				}
+				if (!solid) {
+					break;
+				}
+				height++;
+			}
+			for (int r = row; r < row + height; r++) {
+				for (int c = column; c < column + width; c++) {
+					merged[r * columns + c] = 1;
+				}
+			}
+
+			vector2 min = { origin.x + column * tileSize, origin.y + row * tileSize };
+			vector2 max = { min.x + width * tileSize, min.y + height * tileSize };
+			vector2 rectangle[4] = { min, { max.x, min.y }, max, { min.x, max.y } };
+			addShape(rectangle, 4);
+		}
+	}
+}
+
+//build the tree of the shapes. Called by the rigidbody of the world if the game didn't
+void StaticWorld::Build() {
+	if (_built) {
+		return;
+	}
+	_built = true;
+	_nodes.clear();
+	if (_shapes.size() == 0) {
+		return;
+	}
+	_nodes.reserve(2 * (_shapes.size() / LEAF_SHAPES) + 1);
+	buildNode(0, _shapes.size(), 0);
+	_bounds = _nodes[0].box;
+}
+
+bool StaticWorld::IsBuilt() const {
+	return _built;
+}
+
+int StaticWorld::GetShapeCount() const {
+	return _shapes.size();
+}
+
+int StaticWorld::GetHeight() const {
+	return _height;
+}
+
+//box of all the shapes
+AABB StaticWorld::GetBounds() const {
+	return _bounds;
+}
+
+const StaticWorld::Shape& StaticWorld::GetShape(int shape) const {
+	return _shapes[shape];
+}
+
+//vertexes of the shape relative to its center
+void StaticWorld::GetVertexes(int shape, VertexArray& v) const {
+	const Shape& s = _shapes[shape];
+	v.resize(s.count);
+	for (int i = 0; i < s.count; i++) {
+		v.x[i] = _x[s.first + i];
+		v.y[i] = _y[s.first + i];
+	}
+}
+
+//the shape for the narrowphase, relative to origin
+void StaticWorld::GetContactMesh(int shape, ContactMesh& mesh, vector2 origin) const {
+	const Shape& s = _shapes[shape];
+	vector2 center = { s.center.x - origin.x, s.center.y - origin.y };
+	mesh.v.resize(s.count);
+	SimdTranslateVertexes(_x.data() + s.first, _y.data() + s.first, s.count, center.x, center.y, mesh.v.x.data(), mesh.v.y.data());
+	mesh.centerOfMass = center;
+}
+
+void StaticWorld::addShape(const vector2* vertexes, int count) {
+	if (_built) {
+		return;
+	}
+	Shape s;
+	s.box = { vertexes[0], vertexes[0] };
+	for (int i = 1; i < count; i++) {
+		s.box = combine(s.box, { vertexes[i], vertexes[i] });
+	}
+	s.center = { (s.box.min.x + s.box.max.x) * 0.5, (s.box.min.y + s.box.max.y) * 0.5 };
+	s.first = _x.size();
+	s.count = count;
+	for (int i = 0; i < count; i++) {
+		_x.push_back((physics_real)(vertexes[i].x - s.center.x));
+		_y.push_back((physics_real)(vertexes[i].y - s.center.y));
+	}
+	_shapes.push_back(s);
+}
+
+//node of the shapes from first to first + count: a leaf for a few shapes, or two children with the shapes
+//split at the median of their centers along the longest side of the box of the centers
+int StaticWorld::buildNode(int first, int count, int depth) {
+	int id = _nodes.size();
+	_nodes.push_back({});
+	_height = std::max(_height, depth);
+
+	AABB box = _shapes[first].box;
+	AABB centers = { _shapes[first].center, _shapes[first].center };
+	for (int i = first + 1; i < first + count; i++) {
+		box = combine(box, _shapes[i].box);
+		centers = combine(centers, { _shapes[i].center, _shapes[i].center });
+	}
+	if (count <= LEAF_SHAPES || depth >= MAX_DEPTH - 2) {
+		_nodes[id] = { box, first, 0, count };
+		return id;
+	}
+
+	bool splitX = centers.max.x - centers.min.x >= centers.max.y - centers.min.y;
+	int half = count / 2;
+	std::nth_element(_shapes.begin() + first, _shapes.begin() + first + half, _shapes.begin() + first + count,
+		[splitX](const Shape& a, const Shape& b) {
+			return splitX ? a.center.x < b.center.x : a.center.y < b.center.y;
+		});
+	int child1 = buildNode(first, half, depth + 1);
+	int child2 = buildNode(first + half, count - half, depth + 1);
+	_nodes[id] = { box, child1, child2, 0 };
+	return id;
+}
@@ -0,0 +1,300 @@
+#include "taskGraph.h"
+#include "multithreadManager.h"
+#include "profiler.h"
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+
+//graph run by the thread, and id of the thread in the helpers pool. Set while the thread is in WorkerLoop()
+static thread_local TaskGraph* currentGraph = nullptr;
+static thread_local int currentWorker = 0;
+
+TaskGraph::TaskGraph() {
+	_taskCount = 0;
+	_workers = 1;
+	_remaining = 0;
+	_helpers = nullptr;
+}
+
+TaskGraph::~TaskGraph() {
+	for (int i = 0; i < _tasks.size(); i++) {
+		delete _tasks[i];
+	}
+}
+
+//remove all the tasks. The allocated tasks are kept for the next frame
+void TaskGraph::Clear() {
+	_taskCount = 0;
+}
+
+//add a task that runs fn over [0, count). Returns the id of the task
+int TaskGraph::AddTask(const char* name, TaskFunction fn, void* args, int count, bool gameThreadOnly) {
+	if (_taskCount == _tasks.size()) {
+		_tasks.push_back(new Task());
+	}
+	Task* t = _tasks[_taskCount];
+	t->name = name;
+	t->fn = fn;
+	t->args = args;
+	t->count = count;
+	t->gameThreadOnly = gameThreadOnly;
+	t->waited = false;
+	t->successors.clear();
+	t->predecessors.clear();
+	return _taskCount++;
+}
+
+//task can start only after dependsOn is completed. The graph must not have cycles
+void TaskGraph::AddDependency(int task, int dependsOn) {
+	_tasks[dependsOn]->successors.push_back(task);
+	_tasks[task]->predecessors.push_back(dependsOn);
+}
+
+//change the size of a task that is not started yet. Can be called by one of the tasks it depends on.
+//Takes the lock: a nested loop started by another task can add a task and move _tasks at the same time
+void TaskGraph::SetTaskCount(int task, int count) {
+	std::lock_guard <std::mutex> guard(_mutex);
+	_tasks[task]->count = count;
+}
+
+//run all the tasks and return when they are completed. Must be called from the game thread
+void TaskGraph::Run(MultithreadManager* helpers, int helperCount) {
+	if (_taskCount == 0) {
+		return;
+	}
+	_runStart = std::chrono::high_resolution_clock::now();
+	_helpers = helpers;
+	{
+		std::lock_guard <std::mutex> guard(_mutex);
+		_workers = helperCount + 1;
+		_remaining = _taskCount;
+		_ready.clear();
+		_readyGameThread.clear();
+		for (int i = 0; i < _taskCount; i++) {
+			_tasks[i]->dependencies = _tasks[i]->predecessors.size();
+			_tasks[i]->started = false;
+		}
+		for (int i = 0; i < _taskCount; i++) {
+			if (_tasks[i]->dependencies == 0) {
+				MakeReady(i);
+			}
+		}
+	}
+
+	if (helperCount > 0) {
+		helpers->startOnHelpers(helper_routine, this);		//one worker loop per helper
+	}
+	WorkerLoop(true, 0);
+	if (helperCount > 0) {
+		helpers->Wait();
+	}
+}
+
+void TaskGraph::helper_routine(int worker, int unused, void* args) {
+	TaskGraph* graph = (TaskGraph*)args;
+	graph->WorkerLoop(false, worker);
+}
+
+//take chunks of the ready tasks until the whole graph is completed. worker is the id of the thread in the helpers pool
+void TaskGraph::WorkerLoop(bool gameThread, int worker) {
+	currentGraph = this;
+	currentWorker = worker;
+	std::unique_lock <std::mutex> lock(_mutex);
+	while (true) {
+		int task;
+		int start, end;
+		if (gameThread && _readyGameThread.size() > 0) {
+			task = _readyGameThread.back();
+			_readyGameThread.pop_back();
+			start = 0;
+			end = _tasks[task]->count;
+			_tasks[task]->next = end;
+		}
+		else if (_ready.size() > 0) {
+			task = _ready.back();
+			Task* r = _tasks[task];
+			//guided chunks: big while there is a lot left, smaller towards the end to balance uneven objects
+			int size = std::max(1, (r->count - r->next) / (_workers * 2));
+			start = r->next;
+			end = start + size;
+			r->next = end;
+			if (r->next == r->count) {		//all the chunks are taken
+				_ready.pop_back();
+			}
+		}
+		else if (_remaining == 0) {
+			currentGraph = nullptr;
+			return;
+		}
+		else {
+			_cv.wait(lock);
+			continue;
+		}
+
+		Task* t = _tasks[task];
+		if (!t->started) {
+			t->started = true;
+			t->startTime = std::chrono::high_resolution_clock::now();
+		}
+		lock.unlock();
+
+		auto chunkStart = std::chrono::steady_clock::now();
+		{
+			PROFILE_SCOPE(t->name);
+			t->fn(start, end, t->args);
+		}
+		if (_helpers != nullptr) {
+			_helpers->AddWorkerTime(worker, std::chrono::steady_clock::now() - chunkStart, end - start);
+		}
+
+		lock.lock();
+		t->itemsLeft -= end - start;
+		if (t->itemsLeft == 0) {
+			CompleteTask(task);
+		}
+	}
+}
+
+//all the dependencies of the task are completed. Requires the lock
+void TaskGraph::MakeReady(int task) {
+	Task* t = _tasks[task];
+	if (t->count <= 0) {		//nothing to do
+		CompleteTask(task);
+		return;
+	}
+
+	t->next = 0;
+	t->itemsLeft = t->count;
+
+	if (t->gameThreadOnly) {
+		_readyGameThread.push_back(task);
+	}
+	else {
+		_ready.push_back(task);
+	}
+	_cv.notify_all();
+}
+
+//requires the lock
+void TaskGraph::CompleteTask(int task) {
+	Task* t = _tasks[task];
+	t->endTime = std::chrono::high_resolution_clock::now();
+	if (!t->started) {
+		t->started = true;
+		t->startTime = t->endTime;
+	}
+	_remaining--;
+
+	for (int i = 0; i < t->successors.size(); i++) {
+		Task* s = _tasks[t->successors[i]];
+		if (--s->dependencies == 0) {
+			MakeReady(t->successors[i]);
+		}
+	}
+	if (_remaining == 0 || t->waited) {
+		_cv.notify_all();
+	}
+}
+
+//run fn over [0, count) as a new task of the graph the calling thread is running, and return when it's completed.
+//The calling thread runs chunks of the new task while the idle workers of the graph take the others.
+//Returns false without running anything if the thread is not running a task of a graph
+bool TaskGraph::RunNested(const char* name, TaskFunction fn, void* args, int count) {
+	TaskGraph* graph = currentGraph;
+	if (graph == nullptr) {
+		return false;
+	}
+	if (count <= 0) {
+		return true;
+	}
+
+	std::unique_lock <std::mutex> lock(graph->_mutex);
+	int task = graph->AddTask(name, fn, args, count);
+	Task* t = graph->_tasks[task];
+	t->waited = true;
+	t->dependencies = 0;
+	t->started = true;
+	t->startTime = std::chrono::high_resolution_clock::now();
+	graph->_remaining++;
+	graph->MakeReady(task);
+
+	int worker = currentWorker;
+	while (t->next < t->count) {
+		int size = std::max(1, (t->count - t->next) / (graph->_workers * 2));
+		int start = t->next;
+		int end = start + size;
+		t->next = end;
+		if (t->next == t->count) {		//the last chunk is taken, the others can't take it anymore
+			graph->_ready.erase(std::find(graph->_ready.begin(), graph->_ready.end(), task));
+		}
+		lock.unlock();
+
+		auto chunkStart = std::chrono::steady_clock::now();
+		fn(start, end, args);
+		if (graph->_helpers != nullptr) {
+			graph->_helpers->AddWorkerTime(worker, std::chrono::steady_clock::now() - chunkStart, end - start);
+		}
+
+		lock.lock();
+		t->itemsLeft -= end - start;
+		if (t->itemsLeft == 0) {
+			graph->CompleteTask(task);
+		}
+	}
+
+	while (t->itemsLeft > 0) {		//wait for the chunks taken by the other threads
+		graph->_cv.wait(lock);
+	}
+	return true;
+}
+
+//append the chain of tasks that determined the length of the last run: starting from the last task
+//to complete, go back to the dependency that completed last
+void TaskGraph::GetCriticalPath(std::vector <TaskTiming>& path, std::chrono::high_resolution_clock::time_point frameStart) {
+	int last = -1;
+	for (int i = 0; i < _taskCount; i++) {
+		if (last == -1 || _tasks[i]->endTime > _tasks[last]->endTime) {
+			last = i;
+		}
+	}
+
+	size_t first = path.size();
+	while (last != -1) {
+		Task* t = _tasks[last];
+		std::chrono::duration<double> start = t->startTime - frameStart;
+		std::chrono::duration<double> duration = t->endTime - t->startTime;
+		path.push_back({ t->name, start.count(), duration.count() });
+
+		last = -1;
+		for (int i = 0; i < t->predecessors.size(); i++) {
+			int p = t->predecessors[i];
+			if (last == -1 || _tasks[p]->endTime > _tasks[last]->endTime) {
+				last = p;
+			}
+		}
+	}
+	std::reverse(path.begin() + first, path.end());
+}
+
+//add the duration of the tasks of the last run to the statistics of the tasks with the same name
+void TaskGraph::AddTaskStats(std::vector <TaskStats>& stats) {
+	for (int i = 0; i < _taskCount; i++) {
+		Task* t = _tasks[i];
+		std::chrono::duration<double> duration = t->endTime - t->startTime;
+
+		int j = 0;
+		while (j < stats.size() && strcmp(stats[j].name, t->name) != 0) {
+			j++;
+		}
+		if (j == stats.size()) {
+			stats.push_back({ t->name, 0, 0, 0 });
+		}
+		stats[j].runs++;
+		stats[j].totalTime += duration.count();
+		stats[j].maxTime = std::max(stats[j].maxTime, duration.count());
+	}
+}
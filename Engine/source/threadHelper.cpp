@@ -1,69 +1,36 @@
 #include "threadHelper.h"
 #include "multithreadManager.h"
+#include "epochManager.h"
+#include "profiler.h"
+#include "platform.h"
 #include <thread>
+#include <stdio.h>
 
-ThreadHelper::ThreadHelper(MultithreadManager* boss, int helperID){
+ThreadHelper::ThreadHelper(MultithreadManager* boss, int helperID, uint32_t generation, int cpu){
 	this->boss = boss;
 	this->helperID = helperID;
-	this->_killThread = false;
-	this->_waitVariable = false;
-	//this->thrMutex.lock();
+	this->_cpu = cpu;
+	this->_generation = generation;
 	this->thr = std::thread([this] {this->workThread();});
-	this->thr.detach();
-}
-
-//setup the thread to start a job
-void ThreadHelper::startWork(int begin, int end, void(*function)(int start_index, int end_index, void* args), void* args) {
-	this->startIndex = begin;
-	this->endIndex = end;
-	this->arguments = args;
-	this->_workDone = false;
-	this->jobFunction = function;
-	{
-		std::lock_guard<std::mutex> lk(this->thrMutex);
-		this->_waitVariable = true;		//release the mutex lock
-	}
-	workCv.notify_all();
 }
 
 void ThreadHelper::workThread() {
 	
-	_threadIsAlive = true;
-	std::unique_lock<std::mutex> lk(this->thrMutex);
-	workCv.wait(lk, [this] {return this->_waitVariable;});		//wait for a job
-	lk.unlock();
-
-	while (!this->_killThread) {
-
-		this->jobFunction(this->startIndex, this->endIndex, this->arguments);
-
-		this->_workDone = true;
-		this->_waitVariable = false;
-
-		this->boss->updateActiveTasks();		//tells the multithreadWork object that it completed his job
-		{
-			std::unique_lock<std::mutex> lk(this->thrMutex);
-			workCv.wait(lk, [this] {return this->_waitVariable;});		//wait for the next job
-			lk.unlock();
-		}
-		
+	if (this->_cpu >= 0) {
+		PinCurrentThread(std::vector <int>(1, this->_cpu));
 	}
+	EpochManager::getInstance().RegisterThread();
+	char threadName[32];
+	snprintf(threadName, sizeof(threadName), "helper %d", this->helperID);
+	PROFILE_THREAD_NAME(threadName);
+	EpochManager::getInstance().Offline();		//a parked helper doesn't hold back the object reclamation
 
-	_threadIsAlive = false;
-}
+	this->boss->helperLoop(this->helperID + 1, this->_generation);		//worker 0 is the thread that waits for the work
 
-bool ThreadHelper::workDone() {
-	return this->_workDone;
+	EpochManager::getInstance().UnregisterThread();
 }
 
+//wait for the thread to leave its loop. The pool must be stopping
 void ThreadHelper::killThread() {
-	//wait for the 
-	this->_killThread = true;
-	{
-		std::lock_guard<std::mutex> lk(this->thrMutex);
-		this->_waitVariable = true;
-	}
-	workCv.notify_all();
-
-	while (this->_threadIsAlive)volatile int a = 0;
-}
\ No newline at end of file
+	this->thr.join();
+}
@@ -9,11 +9,13 @@
 
 class FireflyScene : public Scene {
 public:
-	FireflyScene(unsigned int id);
+	FireflyScene(unsigned int id, int fireflies = 80);
 	void onload();
 	void onfree();
 	void scene_callback(GameEvent event, double timeElapsed);
 	void gui_listener(GUI_Element* element, GuiAction action);
+private:
+	int _fireflies;		//number of fireflies spawned by onload
 };
 
 #endif  //FIREFLY_SCENE_H
@@ -0,0 +1,102 @@
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gameEngine.h"
+#include "structures.h"
+
+#include "firefly_scene.h"
+#include "game_options.h"
+#include "physics.h"
+#include "allocationCounter.h"
+
+#undef main		//must be here to avoid complainings from the linker
+
+//Simulation benchmark: runs the firefly scene without window and audio for a fixed number of frames
+//and prints the time spent in every phase of the frame.
+//usage: fireflyBench [fireflies] [frames] [pin]
+
+static int fireflyCount = 1000;
+
+void InitBench() {
+	GameEngine& game_Engine = GameEngine::getInstance();
+
+	game_Engine.CreateScene(new FireflyScene(0, fireflyCount));
+	game_Engine.LoadScene(0);
+}
+
+int main(int argc, char** argv) {
+	GraphicsOptions g_options;
+	AudioOptions a_options;
+	EngineOptions e_options;
+
+	if (argc > 1) {
+		fireflyCount = atoi(argv[1]);
+	}
+	unsigned long frames = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 600;
+
+	std::vector<unsigned short> channel_groups;
+	channel_groups.push_back(10);
+
+	g_options.activeLayers = 10;
+	g_options.mode = WindowMode::MODE_WINDOW;
+	g_options.width = 1920;
+	g_options.height = 1080;
+
+	a_options.defaultMusicVol = 128;
+	a_options.defaultTrackVol = 128;
+	a_options.groupChannels = channel_groups;
+
+	e_options.headless = true;
+	e_options.frameCount = frames;
+	e_options.pinThreads = (argc > 3 && strcmp(argv[3], "pin") == 0);
+
+	GameEngine& game_Engine = GameEngine::getInstance();
+	game_Engine.SetGameFPS(1000000);		//don't limit the game loop
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	game_Engine.GameEngine_Start(InitBench, g_options, a_options, e_options);
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+	FrameStats stats = game_Engine.GetGameFrameStats();
+	printf("fireflies: %d, frames: %lu, time: %.3f s\n", fireflyCount, frames, elapsed.count());
+	printf("rigidbodies: %ld, overlapping pairs: %ld\n", PhysicsEngine::getInstance().GetBodiesCount(),
+		PhysicsEngine::getInstance().GetPairsCount());
+	printf("awake bodies: %ld, sleeping bodies: %ld\n", PhysicsEngine::getInstance().GetAwakeBodiesCount(),
+		PhysicsEngine::getInstance().GetSleepingBodiesCount());
+	printf("contact solver colours: %d\n", PhysicsEngine::getInstance().GetSolverColors());
+	printf("average fps: %.1f (last %d frames: %.1f, frame time %.3f ms, jitter %.3f ms)\n",
+		frames / elapsed.count(), (int)std::min<unsigned long>(frames, 120), stats.averageFPS,
+		stats.averageFrameTime * 1000.0, stats.jitter * 1000.0);
+	if (AllocationCounter::IsEnabled()) {
+		printf("narrowphase allocations: %llu in the last frame, %llu before\n",
+			PhysicsEngine::getInstance().GetNarrowphaseAllocations(), PhysicsEngine::getInstance().GetTotalNarrowphaseAllocations());
+	}
+	printf("\n");
+
+	//phases of the frame. The time of a phase goes from the start of its first chunk to the end of its last one
+	printf("%-22s %10s %12s %12s\n", "phase", "runs", "avg ms", "max ms");
+	std::vector <TaskStats> phases = game_Engine.GetPhaseStats();
+	for (int i = 0; i < phases.size(); i++) {
+		printf("%-22s %10llu %12.4f %12.4f\n", phases[i].name, phases[i].runs,
+			phases[i].totalTime / phases[i].runs * 1000.0, phases[i].maxTime * 1000.0);
+	}
+
+	//time spent working by every thread of the pool over the whole run
+	printf("\n%-10s %10s %8s %12s %10s %8s\n", "worker", "busy s", "util %", "items", "chunks", "steals");
+	std::vector <WorkerStats> workers = game_Engine.GetWorkerStats();
+	for (int i = 0; i < workers.size(); i++) {
+		printf("%-10s %10.3f %8.1f %12llu %10llu %8llu\n", i == 0 ? "game" : "helper", workers[i].busyTime,
+			workers[i].utilisation * 100.0, workers[i].items, workers[i].chunks, workers[i].steals);
+	}
+
+	printf("\ncritical path of the last frame:\n");
+	std::vector <TaskTiming> path = game_Engine.GetFrameCriticalPath();
+	for (int i = 0; i < path.size(); i++) {
+		printf("  %-20s start %8.4f ms  duration %8.4f ms\n", path[i].name, path[i].start * 1000.0, path[i].duration * 1000.0);
+	}
+	return 0;
+}
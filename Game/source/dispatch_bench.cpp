@@ -0,0 +1,158 @@
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "multithreadManager.h"
+#include "platform.h"
+
+#undef main		//must be here to avoid complainings from the linker
+
+//Dispatch benchmark: round trip latency of an empty startWork() / Wait() of the helpers pool,
+//compared with the dispatch used before (a mutex and a condition variable per helper, completion counted under a mutex).
+//usage: dispatchBench [helpers] [iterations]
+
+//the old dispatch, kept here only as a reference for the measures
+class LegacyPool {
+	struct Helper {
+		std::thread thr;
+		std::mutex thrMutex;
+		std::condition_variable workCv;
+		bool waitVariable = false;
+		bool kill = false;
+	};
+public:
+	LegacyPool(int threads) {
+		_activeTasks = 0;
+		for (int i = 0; i < threads; i++) {
+			_helpers.push_back(new Helper());
+		}
+		for (int i = 0; i < threads; i++) {
+			Helper* h = _helpers[i];
+			h->thr = std::thread([this, h, i] {this->workThread(h, i);});
+		}
+	}
+
+	~LegacyPool() {
+		for (int i = 0; i < _helpers.size(); i++) {
+			{
+				std::lock_guard<std::mutex> lk(_helpers[i]->thrMutex);
+				_helpers[i]->kill = true;
+				_helpers[i]->waitVariable = true;
+			}
+			_helpers[i]->workCv.notify_all();
+			_helpers[i]->thr.join();
+			delete _helpers[i];
+		}
+	}
+
+	void startWork(int count, void(*function)(int start_index, int end_index, void* args), void* args) {
+		_function = function;
+		_args = args;
+		_count = count;
+		_activeTasks = _helpers.size();
+		for (int i = 0; i < _helpers.size(); i++) {
+			{
+				std::lock_guard<std::mutex> lk(_helpers[i]->thrMutex);
+				_helpers[i]->waitVariable = true;
+			}
+			_helpers[i]->workCv.notify_all();
+		}
+	}
+
+	void Wait() {
+		std::unique_lock<std::mutex> lk(_taskMutex);
+		_taskCv.wait(lk, [this] {return _activeTasks == 0;});
+	}
+
+private:
+	void workThread(Helper* h, int id) {
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lk(h->thrMutex);
+				h->workCv.wait(lk, [h] {return h->waitVariable;});
+				h->waitVariable = false;
+				if (h->kill) {
+					return;
+				}
+			}
+			int perThread = _count / _helpers.size();
+			int end = (id == _helpers.size() - 1) ? _count : (id + 1) * perThread;
+			_function(id * perThread, end, _args);
+			{
+				std::lock_guard<std::mutex> lk(_taskMutex);
+				_activeTasks--;
+			}
+			_taskCv.notify_one();
+		}
+	}
+
+	std::vector <Helper*> _helpers;
+	std::mutex _taskMutex;
+	std::condition_variable _taskCv;
+	int _activeTasks;
+	void (*_function)(int start_index, int end_index, void* args);
+	void* _args;
+	int _count;
+};
+
+static void empty_routine(int start_index, int end_index, void* args) {
+}
+
+//run the empty job and print the distribution of the round trip times
+template <typename Pool>
+static void measure(const char* name, Pool& pool, int helpers, int iterations) {
+	std::vector <double> times;
+	times.reserve(iterations);
+	for (int i = 0; i < iterations / 10; i++) {		//warm up
+		pool.startWork(helpers + 1, empty_routine, nullptr);
+		pool.Wait();
+	}
+	for (int i = 0; i < iterations; i++) {
+		auto start = std::chrono::steady_clock::now();
+		pool.startWork(helpers + 1, empty_routine, nullptr);
+		pool.Wait();
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		times.push_back(elapsed.count());
+	}
+
+	std::sort(times.begin(), times.end());
+	double total = 0;
+	for (int i = 0; i < times.size(); i++) {
+		total += times[i];
+	}
+	printf("%-22s %10.2f %10.2f %10.2f %10.2f\n", name, total / times.size(),
+		times[times.size() / 2], times[(size_t)(times.size() * 0.99)], times.back());
+}
+
+int main(int argc, char** argv) {
+	int cores = GetCoresCount();
+	int helpers = (argc > 1) ? atoi(argv[1]) : std::max(1, cores - 1);
+	int iterations = (argc > 2) ? atoi(argv[2]) : 20000;
+	iterations = std::max(iterations, 10);
+
+	printf("helpers: %d, iterations: %d\n", helpers, iterations);
+	printf("%-22s %10s %10s %10s %10s\n", "dispatch", "avg us", "p50 us", "p99 us", "max us");
+
+	{
+		LegacyPool legacy(helpers);
+		measure("mutex + condvar", legacy, helpers, iterations);
+	}
+	{
+		MultithreadManager pool(helpers);
+		pool.SetSpinTime(std::chrono::microseconds(0));
+		measure("futex park", pool, helpers, iterations);
+		pool.destroy();
+	}
+	{
+		MultithreadManager pool(helpers);
+		pool.SetSpinTime(std::chrono::microseconds(30));		//the default when the helpers don't outnumber the cores
+		measure("spin + futex park", pool, helpers, iterations);
+		pool.destroy();
+	}
+	return 0;
+}
@@ -17,10 +17,11 @@ Firefly::Firefly(double max_acceleration, double max_velocity) :
 	double y = -6 + (rand() % 1000) / 80.0;
 	transform.position = {x, y};
 
-    //add a rigidbody to the game object
+    //add a rigidbody to the game object. It collides as a circle, the polygon is only its mesh
 	std::vector <vector2> mesh;
 	PhysicsEngine::getInstance().createRegularPolygon(20, 0.5, mesh);
 	AttachRigidbody(mesh);
+	rigidbody->SetBoundingBox(BoundingBoxType::SPHERE);
 
     //register the game object
 	RegisterObject();
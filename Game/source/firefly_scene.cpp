@@ -11,8 +11,8 @@
 
 #include <iostream>
 
-FireflyScene::FireflyScene(unsigned int id) : Scene(id){
-    
+FireflyScene::FireflyScene(unsigned int id, int fireflies) : Scene(id){
+    _fireflies = fireflies;
 }
 
 //on load function. Is called only once when the scene is loaded
@@ -37,7 +37,7 @@ void FireflyScene::onload(){
     mainLight->SetVisible(false);
 
     //create the fireflies
-    for (int i = 0; i < 80; i++) {
+    for (int i = 0; i < _fireflies; i++) {
         //create the firefly object
         GameObject* firefly = new Firefly(0.15, 1);
 
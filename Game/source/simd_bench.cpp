@@ -0,0 +1,157 @@
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "physics_simd.h"
+#include "structures.h"
+
+#undef main		//must be here to avoid complainings from the linker
+
+//Physics kernels benchmark: the vertex loops of the narrowphase on the polygons of the fireflies (20 sides),
+//stored as an array of vector2 and transformed vertex by vertex like before, compared with the kernels of physics_simd.h
+//on the same vertexes stored as structure of arrays.
+//usage: simdBench [bodies] [iterations]
+
+static const int SIDES = 20;
+
+//one body in both layouts
+struct BenchBody {
+	std::vector <vector2> aos;
+	std::vector <physics_real> x, y;
+	std::vector <physics_real> baseX, baseY;
+	vector2 scale;
+};
+
+static double sink = 0;		//keeps the compiler from removing the loops
+
+//run the routine on all the bodies and return the nanoseconds per body
+template <typename Routine>
+static double measure(std::vector <BenchBody>& bodies, int iterations, Routine routine) {
+	for (int i = 0; i < bodies.size(); i++) {		//warm up
+		routine(bodies[i], 0);
+	}
+	auto start = std::chrono::steady_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (int i = 0; i < bodies.size(); i++) {
+			routine(bodies[i], it);
+		}
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / ((double)iterations * bodies.size());
+}
+
+static void print(const char* name, double legacy, double simd) {
+	printf("%-22s %12.2f %12.2f %9.2fx\n", name, legacy, simd, legacy / simd);
+}
+
+int main(int argc, char** argv) {
+	int count = (argc > 1) ? atoi(argv[1]) : 1000;
+	int iterations = (argc > 2) ? atoi(argv[2]) : 1000;
+	count = std::max(count, 1);
+	iterations = std::max(iterations, 1);
+
+	std::vector <BenchBody> bodies(count);
+	for (int i = 0; i < count; i++) {
+		BenchBody& b = bodies[i];
+		b.scale = { 1.0 + (i % 7) * 0.1, 1.0 + (i % 5) * 0.1 };
+		for (int k = 0; k < SIDES; k++) {
+			double angle = 2 * MATH_PI * k / SIDES;
+			vector2 v = { 0.5 * cos(angle), 0.5 * sin(angle) };
+			b.aos.push_back(v);
+			b.baseX.push_back((physics_real)v.x);
+			b.baseY.push_back((physics_real)v.y);
+		}
+		b.x = b.baseX;
+		b.y = b.baseY;
+	}
+
+	printf("bodies: %d, sides: %d, iterations: %d, kernels: %s, precision: %s\n", count, SIDES, iterations,
+		SimdInstructionSet(), sizeof(physics_real) == sizeof(float) ? "float" : "double");
+	printf("%-22s %12s %12s %10s\n", "kernel", "vector2 ns", "simd ns", "speedup");
+
+	//rotate and scale the polygon by one step, as the rigidbodies did: undo the old scale and rotate every vertex
+	double step = 1.0 * (MATH_PI / 180.0);
+	double transformLegacy = measure(bodies, iterations, [step](BenchBody& b, int it) {
+		for (int i = 0; i < b.aos.size(); i++) {
+			b.aos[i] = { (b.aos[i].x / b.scale.x) * b.scale.x, (b.aos[i].y / b.scale.y) * b.scale.y };
+			b.aos[i] = {
+				b.aos[i].x * cos(step) - b.aos[i].y * sin(step),
+				b.aos[i].x * sin(step) + b.aos[i].y * cos(step)
+			};
+		}
+		sink += b.aos[0].x;
+	});
+	//rebuild the polygon from the base one
+	double transformSimd = measure(bodies, iterations, [step](BenchBody& b, int it) {
+		double rot = step * it;
+		SimdTransformVertexes(b.baseX.data(), b.baseY.data(), SIDES, b.scale.x, b.scale.y, cos(rot), sin(rot),
+			b.x.data(), b.y.data());
+		sink += b.x[0];
+	});
+	print("transform", transformLegacy, transformSimd);
+
+	//separating axis test: project the polygon on the normals of all its sides
+	double satLegacy = measure(bodies, iterations, [](BenchBody& b, int it) {
+		for (int a = 0; a < SIDES; a++) {
+			int n = (a + 1) % SIDES;
+			vector2 axis = { -(b.aos[a].y - b.aos[n].y), b.aos[a].x - b.aos[n].x };
+			axis = axis.normalize();
+			double min = axis.dot(b.aos[0]);
+			double max = min;
+			for (int i = 1; i < SIDES; i++) {
+				double p = axis.dot(b.aos[i]);
+				if (p < min) {
+					min = p;
+				}
+				else if (p > max) {
+					max = p;
+				}
+			}
+			sink += max - min;
+		}
+	});
+	double satSimd = measure(bodies, iterations, [](BenchBody& b, int it) {
+		for (int a = 0; a < SIDES; a++) {
+			int n = (a + 1) % SIDES;
+			vector2 axis = { -(b.y[a] - b.y[n]), b.x[a] - b.x[n] };
+			axis = axis.normalize();
+			double min, max;
+			SimdProjectMinMax(b.x.data(), b.y.data(), SIDES, axis.x, axis.y, min, max);
+			sink += max - min;
+		}
+	});
+	print("SAT projections", satLegacy, satSimd);
+
+	//support point along 8 directions
+	vector2 directions[8];
+	for (int d = 0; d < 8; d++) {
+		directions[d] = { cos(d * MATH_PI / 4), sin(d * MATH_PI / 4) };
+	}
+	double supportLegacy = measure(bodies, iterations, [&directions](BenchBody& b, int it) {
+		for (int d = 0; d < 8; d++) {
+			vector2 dir = directions[d];
+			int best = 0;
+			double bestProjection = dir.dot(b.aos[0]);
+			for (int i = 1; i < SIDES; i++) {
+				double p = dir.dot(b.aos[i]);
+				if (p > bestProjection) {
+					bestProjection = p;
+					best = i;
+				}
+			}
+			sink += best;
+		}
+	});
+	double supportSimd = measure(bodies, iterations, [&directions](BenchBody& b, int it) {
+		for (int d = 0; d < 8; d++) {
+			sink += SimdSupportPoint(b.x.data(), b.y.data(), SIDES, directions[d].x, directions[d].y);
+		}
+	});
+	print("support points", supportLegacy, supportSimd);
+
+	printf("(%g)\n", sink > 0 ? 0.0 : 1.0);
+	return 0;
+}